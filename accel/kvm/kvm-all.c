@@ -67,6 +67,7 @@
 struct KVMParkedVcpu {
     unsigned long vcpu_id;
     int kvm_fd;
+    uint32_t kvm_fetch_index;
     QLIST_ENTRY(KVMParkedVcpu) node;
 };
 
@@ -104,6 +105,15 @@ struct KVMState
 #endif
     KVMMemoryListener memory_listener;
     QLIST_HEAD(, KVMParkedVcpu) kvm_parked_vcpus;
+    /* KVM_GET_DIRTY_LOG leaves pages dirty until KVM_CLEAR_DIRTY_LOG */
+    bool manual_dirty_log_protect;
+    /* entries of each vCPU's dirty ring, 0 if dirty bitmaps are used */
+    uint32_t kvm_dirty_ring_size;
+    uint32_t kvm_dirty_ring_bytes;
+    QemuThread dirty_ring_reaper;
+    /* memory listener of each address space id, to look up ring entries */
+    KVMMemoryListener **as_kml;
+    int nr_as;
 
     /* memory encryption */
     void *memcrypt_handle;
@@ -129,6 +139,15 @@ bool kvm_ioeventfd_any_length_allowed;
 bool kvm_msi_use_devid;
 static bool kvm_immediate_exit;
 
+/*
+ * Protects the slots of all KVMMemoryListeners against the migration
+ * thread, which clears their dirty logs without taking the BQL.
+ */
+static QemuMutex kml_slots_lock;
+
+#define kvm_slots_lock(kml)      qemu_mutex_lock(&kml_slots_lock)
+#define kvm_slots_unlock(kml)    qemu_mutex_unlock(&kml_slots_lock)
+
 static const KVMCapabilityInfo kvm_required_capabilites[] = {
     KVM_CAP_INFO(USER_MEMORY),
     KVM_CAP_INFO(DESTROY_MEMORY_REGION_WORKS),
@@ -281,6 +300,133 @@ static int kvm_set_user_memory_region(KVMMemoryListener *kml, KVMSlot *slot, boo
     return ret;
 }
 
+/*
+ * Dirty ring
+ *
+ * With a dirty ring, KVM appends the pages written by each vCPU to a ring
+ * shared with QEMU, instead of setting bits in a dirty bitmap per slot.
+ * Harvesting the rings costs as much as the number of pages written since
+ * the last harvest, while KVM_GET_DIRTY_LOG costs as much as guest memory.
+ *
+ * The rings are harvested when one of them is full, when the dirty log is
+ * synced, and periodically by a reaper thread so that they rarely fill up.
+ * All of this happens with the slots lock held, which serializes it with
+ * slot updates and with the KVM_RESET_DIRTY_RINGS that hands harvested
+ * entries back to KVM.
+ *
+ * Writes still in the PML buffer of a running vCPU are only pushed to its
+ * ring on the next exit; they are harvested by a later sync, at the latest
+ * when the VM is stopped for the last one.
+ */
+
+/* Interval at which the reaper harvests the rings, in microseconds */
+#define KVM_DIRTY_RING_REAP_INTERVAL_US 1000000
+
+static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
+{
+    return atomic_load_acquire(&gfn->flags) == KVM_DIRTY_GFN_F_DIRTY;
+}
+
+static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
+{
+    atomic_store_release(&gfn->flags, KVM_DIRTY_GFN_F_RESET);
+}
+
+static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_slot,
+                                     uint64_t offset)
+{
+    int as_id = as_slot >> 16;
+    int slot_id = as_slot & 0xffff;
+    ram_addr_t psize = qemu_real_host_page_size;
+    KVMSlot *mem;
+
+    if (as_id >= s->nr_as || !s->as_kml[as_id] || slot_id >= s->nr_slots) {
+        return;
+    }
+    mem = &s->as_kml[as_id]->slots[slot_id];
+
+    /* The slot may have been removed after the page was written */
+    if (offset >= mem->memory_size / psize) {
+        return;
+    }
+    cpu_physical_memory_set_dirty_range(mem->ram_start_offset + offset * psize,
+                                        psize, DIRTY_CLIENTS_NOCODE);
+}
+
+static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
+{
+    struct kvm_dirty_gfn *cur;
+    uint32_t fetch = cpu->kvm_fetch_index;
+    uint32_t count = 0;
+
+    for (;;) {
+        cur = &cpu->kvm_dirty_gfns[fetch & (s->kvm_dirty_ring_size - 1)];
+        if (!dirty_gfn_is_dirtied(cur)) {
+            break;
+        }
+        kvm_dirty_ring_mark_page(s, cur->slot, cur->offset);
+        dirty_gfn_set_collected(cur);
+        fetch++;
+        count++;
+    }
+    cpu->kvm_fetch_index = fetch;
+    stat64_add(&cpu->dirty_pages, count);
+
+    return count;
+}
+
+/* Called with the slots lock held */
+static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
+{
+    CPUState *cpu;
+    uint64_t total = 0;
+    int ret;
+
+    rcu_read_lock();
+    CPU_FOREACH(cpu) {
+        if (cpu->kvm_dirty_gfns) {
+            total += kvm_dirty_ring_reap_one(s, cpu);
+        }
+    }
+    rcu_read_unlock();
+
+    if (total) {
+        ret = kvm_vm_ioctl(s, KVM_RESET_DIRTY_RINGS);
+        if (ret < 0) {
+            error_report("%s: KVM_RESET_DIRTY_RINGS failed: %s", __func__,
+                         strerror(-ret));
+            abort();
+        }
+    }
+    trace_kvm_dirty_ring_reap(total);
+
+    return total;
+}
+
+static uint64_t kvm_dirty_ring_reap(KVMState *s)
+{
+    uint64_t total;
+
+    kvm_slots_lock(&s->memory_listener);
+    total = kvm_dirty_ring_reap_locked(s);
+    kvm_slots_unlock(&s->memory_listener);
+
+    return total;
+}
+
+static void *kvm_dirty_ring_reaper_thread(void *opaque)
+{
+    KVMState *s = opaque;
+
+    rcu_register_thread();
+    for (;;) {
+        g_usleep(KVM_DIRTY_RING_REAP_INTERVAL_US);
+        kvm_dirty_ring_reap(s);
+    }
+
+    return NULL;
+}
+
 int kvm_destroy_vcpu(CPUState *cpu)
 {
     KVMState *s = kvm_state;
@@ -302,15 +448,29 @@ int kvm_destroy_vcpu(CPUState *cpu)
         goto err;
     }
 
+    if (cpu->kvm_dirty_gfns) {
+        /* The ring stays with the parked vCPU; empty it first */
+        kvm_slots_lock(&s->memory_listener);
+        kvm_dirty_ring_reap_locked(s);
+        ret = munmap(cpu->kvm_dirty_gfns, s->kvm_dirty_ring_bytes);
+        cpu->kvm_dirty_gfns = NULL;
+        kvm_slots_unlock(&s->memory_listener);
+        if (ret < 0) {
+            goto err;
+        }
+    }
+
     vcpu = g_malloc0(sizeof(*vcpu));
     vcpu->vcpu_id = kvm_arch_vcpu_id(cpu);
     vcpu->kvm_fd = cpu->kvm_fd;
+    vcpu->kvm_fetch_index = cpu->kvm_fetch_index;
     QLIST_INSERT_HEAD(&kvm_state->kvm_parked_vcpus, vcpu, node);
 err:
     return ret;
 }
 
-static int kvm_get_vcpu(KVMState *s, unsigned long vcpu_id)
+static int kvm_get_vcpu(KVMState *s, unsigned long vcpu_id,
+                        uint32_t *fetch_index)
 {
     struct KVMParkedVcpu *cpu;
 
@@ -320,11 +480,13 @@ static int kvm_get_vcpu(KVMState *s, unsigned long vcpu_id)
 
             QLIST_REMOVE(cpu, node);
             kvm_fd = cpu->kvm_fd;
+            *fetch_index = cpu->kvm_fetch_index;
             g_free(cpu);
             return kvm_fd;
         }
     }
 
+    *fetch_index = 0;
     return kvm_vm_ioctl(s, KVM_CREATE_VCPU, (void *)vcpu_id);
 }
 
@@ -332,11 +494,13 @@ int kvm_init_vcpu(CPUState *cpu)
 {
     KVMState *s = kvm_state;
     long mmap_size;
+    uint32_t fetch_index;
+    void *gfns;
     int ret;
 
     DPRINTF("kvm_init_vcpu\n");
 
-    ret = kvm_get_vcpu(s, kvm_arch_vcpu_id(cpu));
+    ret = kvm_get_vcpu(s, kvm_arch_vcpu_id(cpu), &fetch_index);
     if (ret < 0) {
         DPRINTF("kvm_create_vcpu failed\n");
         goto err;
@@ -366,6 +530,22 @@ int kvm_init_vcpu(CPUState *cpu)
             (void *)cpu->kvm_run + s->coalesced_mmio * PAGE_SIZE;
     }
 
+    if (s->kvm_dirty_ring_size) {
+        gfns = mmap(NULL, s->kvm_dirty_ring_bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, cpu->kvm_fd,
+                    qemu_real_host_page_size * KVM_DIRTY_LOG_PAGE_OFFSET);
+        if (gfns == MAP_FAILED) {
+            ret = -errno;
+            DPRINTF("mmap'ing vcpu dirty ring failed\n");
+            goto err;
+        }
+        /* the reaper may be walking the rings already */
+        kvm_slots_lock(&s->memory_listener);
+        cpu->kvm_fetch_index = fetch_index;
+        cpu->kvm_dirty_gfns = gfns;
+        kvm_slots_unlock(&s->memory_listener);
+    }
+
     ret = kvm_arch_init_vcpu(cpu);
 err:
     return ret;
@@ -393,6 +573,11 @@ static int kvm_slot_update_flags(KVMMemoryListener *kml, KVMSlot *mem,
                                  MemoryRegion *mr)
 {
     mem->flags = kvm_mem_flags(mr);
+    if (!(mem->flags & KVM_MEM_LOG_DIRTY_PAGES)) {
+        /* the next log must not clear pages dirtied in this one */
+        g_free(mem->dirty_bmap);
+        mem->dirty_bmap = NULL;
+    }
 
     /* If nothing changed effectively, no need to issue ioctl */
     if (mem->flags == mem->old_flags) {
@@ -433,7 +618,9 @@ static void kvm_log_start(MemoryListener *listener,
         return;
     }
 
+    kvm_slots_lock(kml);
     r = kvm_section_update_flags(kml, section);
+    kvm_slots_unlock(kml);
     if (r < 0) {
         abort();
     }
@@ -450,7 +637,9 @@ static void kvm_log_stop(MemoryListener *listener,
         return;
     }
 
+    kvm_slots_lock(kml);
     r = kvm_section_update_flags(kml, section);
+    kvm_slots_unlock(kml);
     if (r < 0) {
         abort();
     }
@@ -462,7 +651,7 @@ static int kvm_get_dirty_pages_log_range(MemoryRegionSection *section,
 {
     ram_addr_t start = section->offset_within_region +
                        memory_region_get_ram_addr(section->mr);
-    ram_addr_t pages = int128_get64(section->size) / getpagesize();
+    ram_addr_t pages = int128_get64(section->size) / qemu_real_host_page_size;
 
     cpu_physical_memory_set_dirty_lebitmap(bitmap, start, pages);
     return 0;
@@ -476,8 +665,14 @@ static int kvm_get_dirty_pages_log_range(MemoryRegionSection *section,
  * memory_region_set_dirty().  This means all bits are set
  * to dirty.
  *
+ * With manual dirty log protection, the pages stay dirty and writable
+ * in KVM until kvm_log_clear() is called for them, and the bitmap is
+ * kept in the slot for that.
+ *
  * @start_add: start of logged region.
  * @end_addr: end of logged region.
+ *
+ * Called with the slots lock held.
  */
 static int kvm_physical_sync_dirty_bitmap(KVMMemoryListener *kml,
                                           MemoryRegionSection *section)
@@ -507,24 +702,124 @@ static int kvm_physical_sync_dirty_bitmap(KVMMemoryListener *kml,
          * So for now, let's align to 64 instead of HOST_LONG_BITS here, in
          * a hope that sizeof(long) won't become >8 any time soon.
          */
-        size = ALIGN(((mem->memory_size) >> TARGET_PAGE_BITS),
-                     /*HOST_LONG_BITS*/ 64) / 8;
-        d.dirty_bitmap = g_malloc0(size);
+        if (!mem->dirty_bmap) {
+            size = ALIGN(mem->memory_size / qemu_real_host_page_size,
+                         /*HOST_LONG_BITS*/ 64) / 8;
+            mem->dirty_bmap = g_malloc0(size);
+        }
+        d.dirty_bitmap = mem->dirty_bmap;
 
         d.slot = mem->slot | (kml->as_id << 16);
         if (kvm_vm_ioctl(s, KVM_GET_DIRTY_LOG, &d) == -1) {
             DPRINTF("ioctl failed %d\n", errno);
-            g_free(d.dirty_bitmap);
             return -1;
         }
 
         kvm_get_dirty_pages_log_range(section, d.dirty_bitmap);
-        g_free(d.dirty_bitmap);
     }
 
     return 0;
 }
 
+/*
+ * Write-protect again the pages in [@start, @start + @size) of slot @mem
+ * that were dirty in its last KVM_GET_DIRTY_LOG; @start and @size are
+ * byte offsets within the slot.  Pages dirtied since then are left alone,
+ * because their dirtiness has not been seen by QEMU yet.
+ */
+static int kvm_log_clear_one_slot(KVMSlot *mem, int as_id, uint64_t start,
+                                  uint64_t size)
+{
+    KVMState *s = kvm_state;
+    uint64_t psize = qemu_real_host_page_size;
+    uint64_t slot_pages = mem->memory_size / psize;
+    uint64_t first = start / psize;
+    uint64_t last = MIN(DIV_ROUND_UP(start + size, psize), slot_pages);
+    uint64_t *dirty = (uint64_t *)mem->dirty_bmap;
+    struct kvm_clear_dirty_log d = {};
+    uint64_t bmap_start, bmap_npages, *bmap_clear;
+    uint64_t i;
+    bool found = false;
+    int ret = 0;
+
+    if (!dirty || first >= last) {
+        return 0;
+    }
+
+    /*
+     * KVM clears in units of 64 pages, except at the end of the slot;
+     * clear only the bits we were asked for within those.
+     */
+    bmap_start = QEMU_ALIGN_DOWN(first, 64);
+    bmap_npages = MIN(QEMU_ALIGN_UP(last, 64), slot_pages) - bmap_start;
+    bmap_clear = g_new0(uint64_t, DIV_ROUND_UP(bmap_npages, 64));
+
+    for (i = 0; i < DIV_ROUND_UP(bmap_npages, 64); i++) {
+        uint64_t base = bmap_start + i * 64;
+        uint64_t lo = MAX(first, base) - base;
+        uint64_t hi = MIN(last, base + 64) - base;
+        uint64_t word = le64_to_cpu(dirty[bmap_start / 64 + i]);
+        uint64_t bits = word & MAKE_64BIT_MASK(lo, hi - lo);
+
+        if (bits) {
+            dirty[bmap_start / 64 + i] = cpu_to_le64(word & ~bits);
+            bmap_clear[i] = cpu_to_le64(bits);
+            found = true;
+        }
+    }
+
+    if (found) {
+        d.slot = mem->slot | (as_id << 16);
+        d.first_page = bmap_start;
+        d.num_pages = bmap_npages;
+        d.dirty_bitmap = bmap_clear;
+        ret = kvm_vm_ioctl(s, KVM_CLEAR_DIRTY_LOG, &d);
+        trace_kvm_clear_dirty_log(d.slot, d.first_page, d.num_pages, ret);
+    }
+    g_free(bmap_clear);
+    return ret;
+}
+
+static int kvm_physical_log_clear(KVMMemoryListener *kml,
+                                  MemoryRegionSection *section)
+{
+    KVMState *s = kvm_state;
+    uint64_t start = section->offset_within_address_space;
+    uint64_t size = int128_get64(section->size);
+    int ret = 0;
+    int i;
+
+    if (!s->manual_dirty_log_protect || !size) {
+        return 0;
+    }
+
+    kvm_slots_lock(kml);
+    for (i = 0; i < s->nr_slots; i++) {
+        KVMSlot *mem = &kml->slots[i];
+        uint64_t offset, count;
+
+        if (!mem->memory_size ||
+            mem->start_addr >= start + size ||
+            start >= mem->start_addr + mem->memory_size) {
+            continue;
+        }
+        if (start < mem->start_addr) {
+            offset = 0;
+            count = MIN(mem->memory_size, start + size - mem->start_addr);
+        } else {
+            offset = start - mem->start_addr;
+            count = MIN(mem->memory_size - offset, size);
+        }
+        ret = kvm_log_clear_one_slot(mem, kml->as_id, offset, count);
+        if (ret < 0) {
+            break;
+        }
+    }
+    kvm_slots_unlock(kml);
+
+    return ret;
+}
+
 static void kvm_coalesce_mmio_region(MemoryListener *listener,
                                      MemoryRegionSection *secion,
                                      hwaddr start, hwaddr size)
@@ -742,16 +1037,24 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     ram = memory_region_get_ram_ptr(mr) + section->offset_within_region +
           (start_addr - section->offset_within_address_space);
 
+    kvm_slots_lock(kml);
+
     if (!add) {
         mem = kvm_lookup_matching_slot(kml, start_addr, size);
         if (!mem) {
-            return;
+            goto out;
         }
         if (mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
-            kvm_physical_sync_dirty_bitmap(kml, section);
+            if (kvm_state->kvm_dirty_ring_size) {
+                kvm_dirty_ring_reap_locked(kvm_state);
+            } else {
+                kvm_physical_sync_dirty_bitmap(kml, section);
+            }
         }
 
         /* unregister the slot */
+        g_free(mem->dirty_bmap);
+        mem->dirty_bmap = NULL;
         mem->memory_size = 0;
         mem->flags = 0;
         err = kvm_set_user_memory_region(kml, mem, false);
@@ -760,7 +1063,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                     __func__, strerror(-err));
             abort();
         }
-        return;
+        goto out;
     }
 
     /* register the new slot */
@@ -768,6 +1071,8 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     mem->memory_size = size;
     mem->start_addr = start_addr;
     mem->ram = ram;
+    mem->ram_start_offset = memory_region_get_ram_addr(mr) +
+                            (ram - memory_region_get_ram_ptr(mr));
     mem->flags = kvm_mem_flags(mr);
 
     err = kvm_set_user_memory_region(kml, mem, true);
@@ -776,6 +1081,9 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                 strerror(-err));
         abort();
     }
+
+out:
+    kvm_slots_unlock(kml);
 }
 
 static void kvm_region_add(MemoryListener *listener,
@@ -802,12 +1110,33 @@ static void kvm_log_sync(MemoryListener *listener,
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
     int r;
 
+    kvm_slots_lock(kml);
     r = kvm_physical_sync_dirty_bitmap(kml, section);
+    kvm_slots_unlock(kml);
     if (r < 0) {
         abort();
     }
 }
 
+static void kvm_log_sync_global(MemoryListener *listener)
+{
+    kvm_dirty_ring_reap(kvm_state);
+}
+
+static void kvm_log_clear(MemoryListener *listener,
+                          MemoryRegionSection *section)
+{
+    KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    int r;
+
+    r = kvm_physical_log_clear(kml, section);
+    if (r < 0) {
+        error_report("%s: KVM_CLEAR_DIRTY_LOG failed: %s", __func__,
+                     strerror(-r));
+        abort();
+    }
+}
+
 static void kvm_mem_ioeventfd_add(MemoryListener *listener,
                                   MemoryRegionSection *section,
                                   bool match_data, uint64_t data,
@@ -884,6 +1213,8 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
 
     kml->slots = g_malloc0(s->nr_slots * sizeof(KVMSlot));
     kml->as_id = as_id;
+    assert(as_id < s->nr_as);
+    s->as_kml[as_id] = kml;
 
     for (i = 0; i < s->nr_slots; i++) {
         kml->slots[i].slot = i;
@@ -893,7 +1224,12 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
     kml->listener.region_del = kvm_region_del;
     kml->listener.log_start = kvm_log_start;
     kml->listener.log_stop = kvm_log_stop;
-    kml->listener.log_sync = kvm_log_sync;
+    if (s->kvm_dirty_ring_size) {
+        kml->listener.log_sync_global = kvm_log_sync_global;
+    } else {
+        kml->listener.log_sync = kvm_log_sync;
+        kml->listener.log_clear = kvm_log_clear;
+    }
     kml->listener.priority = 10;
 
     memory_listener_register(&kml->listener, as);
@@ -1500,6 +1836,8 @@ static int kvm_init(MachineState *ms)
     int type = 0;
     const char *kvm_type;
 
+    qemu_mutex_init(&kml_slots_lock);
+
     s = KVM_STATE(ms->accelerator);
 
     /*
@@ -1547,6 +1885,12 @@ static int kvm_init(MachineState *ms)
         s->nr_slots = 32;
     }
 
+    s->nr_as = kvm_check_extension(s, KVM_CAP_MULTI_ADDRESS_SPACE);
+    if (s->nr_as <= 1) {
+        s->nr_as = 1;
+    }
+    s->as_kml = g_new0(KVMMemoryListener *, s->nr_as);
+
     kvm_type = qemu_opt_get(qemu_get_machine_opts(), "kvm-type");
     if (mc->kvm_type) {
         type = mc->kvm_type(kvm_type);
@@ -1643,6 +1987,51 @@ static int kvm_init(MachineState *ms)
         (kvm_check_extension(s, KVM_CAP_READONLY_MEM) > 0);
 #endif
 
+    /* Must be enabled before any vCPU is created */
+    s->kvm_dirty_ring_size = machine_kvm_dirty_ring_size(ms);
+    if (s->kvm_dirty_ring_size) {
+        uint64_t ring_bytes = (uint64_t)s->kvm_dirty_ring_size *
+                              sizeof(struct kvm_dirty_gfn);
+
+        ret = kvm_vm_check_extension(s, KVM_CAP_DIRTY_LOG_RING);
+        if (ret <= 0) {
+            warn_report("KVM dirty ring not available, using dirty bitmaps");
+            s->kvm_dirty_ring_size = 0;
+        } else if (ring_bytes > ret) {
+            error_report("KVM dirty ring size %" PRIu32 " too big "
+                         "(maximum is %zu)", s->kvm_dirty_ring_size,
+                         ret / sizeof(struct kvm_dirty_gfn));
+            ret = -EINVAL;
+            goto err;
+        } else {
+            ret = kvm_vm_enable_cap(s, KVM_CAP_DIRTY_LOG_RING, 0, ring_bytes);
+            if (ret) {
+                error_report("Enabling of KVM dirty ring failed: %s",
+                             strerror(-ret));
+                goto err;
+            }
+            s->kvm_dirty_ring_bytes = ring_bytes;
+        }
+    }
+
+    /*
+     * Let migration re-protect pages just before it sends them, rather
+     * than all of guest memory at once at every KVM_GET_DIRTY_LOG.  Not
+     * needed with the dirty ring, which only reports each page once.
+     */
+    if (!s->kvm_dirty_ring_size &&
+        kvm_vm_check_extension(s, KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2) &
+        KVM_DIRTY_LOG_MANUAL_PROTECT_ENABLE) {
+        ret = kvm_vm_enable_cap(s, KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2, 0,
+                                KVM_DIRTY_LOG_MANUAL_PROTECT_ENABLE);
+        if (ret) {
+            warn_report("Could not enable manual dirty log protection: %s",
+                        strerror(-ret));
+        } else {
+            s->manual_dirty_log_protect = true;
+        }
+    }
+
     kvm_eventfds_allowed =
         (kvm_check_extension(s, KVM_CAP_IOEVENTFD) > 0);
 
@@ -1699,6 +2088,12 @@ static int kvm_init(MachineState *ms)
 
     s->sync_mmu = !!kvm_vm_check_extension(kvm_state, KVM_CAP_SYNC_MMU);
 
+    if (s->kvm_dirty_ring_size) {
+        qemu_thread_create(&s->dirty_ring_reaper, "kvm-reaper",
+                           kvm_dirty_ring_reaper_thread, s,
+                           QEMU_THREAD_DETACHED);
+    }
+
     return 0;
 
 err:
@@ -1710,6 +2105,7 @@ err:
         close(s->fd);
     }
     g_free(s->memory_listener.slots);
+    g_free(s->as_kml);
 
     return ret;
 }
@@ -1983,6 +2379,12 @@ int kvm_cpu_exec(CPUState *cpu)
                              run->mmio.is_write);
             ret = 0;
             break;
+        case KVM_EXIT_DIRTY_RING_FULL:
+            /* Called outside BQL */
+            trace_kvm_dirty_ring_full(cpu->cpu_index);
+            kvm_dirty_ring_reap(kvm_state);
+            ret = 0;
+            break;
         case KVM_EXIT_IRQ_WINDOW_OPEN:
             DPRINTF("irq_window_open\n");
             ret = EXCP_INTERRUPT;
@@ -16,11 +16,37 @@
 #include "tcg/tcg.h"
 #include "exec/cpu-common.h"
 #include "exec/exec-all.h"
+#include "perf.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
 
 void tb_flush(CPUState *cpu)
 {
 }
 
+void tb_cache_enable(const char *path, size_t max_size, const char *config)
+{
+}
+
+void tb_cache_save(void)
+{
+}
+
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
 }
+
+TBStatsInfoList *qmp_query_tb_stats(bool has_count, int64_t count,
+                                    Error **errp)
+{
+    error_setg(errp, "TB statistics are only available with accel=tcg");
+    return NULL;
+}
+
+void perf_enable_perfmap(void)
+{
+}
+
+void perf_enable_jitdump(void)
+{
+}
@@ -59,6 +59,21 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+/*
+ * 16-byte atomics may be detected at run time; callers check
+ * HAVE_CMPXCHG128 before using cmpxchgo, and HAVE_ATOMIC128 before
+ * using ldo and sto, see qemu/atomic128.h.
+ */
+#if DATA_SIZE == 16
+# define ATOMIC_CMPXCHG(P, C, N)  atomic16_cmpxchg(P, C, N)
+# define ATOMIC_LOAD(P, V)        (*(V) = atomic16_read(P))
+# define ATOMIC_STORE(P, V)       atomic16_set(P, *(V))
+#else
+# define ATOMIC_CMPXCHG(P, C, N)  atomic_cmpxchg__nocheck(P, C, N)
+# define ATOMIC_LOAD(P, V)        __atomic_load(P, V, __ATOMIC_RELAXED)
+# define ATOMIC_STORE(P, V)       __atomic_store(P, V, __ATOMIC_RELAXED)
+#endif
+
 #define ATOMIC_TRACE_RMW do {                                           \
         uint8_t info = glue(trace_mem_build_info_no_se, MEND)(SHIFT, false); \
                                                                         \
@@ -100,7 +115,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
     DATA_TYPE ret;
 
     ATOMIC_TRACE_RMW;
-    ret = atomic_cmpxchg__nocheck(haddr, cmpv, newv);
+    ret = ATOMIC_CMPXCHG(haddr, cmpv, newv);
     ATOMIC_MMU_CLEANUP;
     return ret;
 }
@@ -112,7 +127,7 @@ ABI_TYPE ATOMIC_NAME(ld)(CPUArchState *env, target_ulong addr EXTRA_ARGS)
     DATA_TYPE val, *haddr = ATOMIC_MMU_LOOKUP;
 
     ATOMIC_TRACE_LD;
-    __atomic_load(haddr, &val, __ATOMIC_RELAXED);
+    ATOMIC_LOAD(haddr, &val);
     ATOMIC_MMU_CLEANUP;
     return val;
 }
@@ -124,7 +139,7 @@ void ATOMIC_NAME(st)(CPUArchState *env, target_ulong addr,
     DATA_TYPE *haddr = ATOMIC_MMU_LOOKUP;
 
     ATOMIC_TRACE_ST;
-    __atomic_store(haddr, &val, __ATOMIC_RELAXED);
+    ATOMIC_STORE(haddr, &val);
     ATOMIC_MMU_CLEANUP;
 }
 #else
@@ -228,7 +243,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
     DATA_TYPE ret;
 
     ATOMIC_TRACE_RMW;
-    ret = atomic_cmpxchg__nocheck(haddr, BSWAP(cmpv), BSWAP(newv));
+    ret = ATOMIC_CMPXCHG(haddr, BSWAP(cmpv), BSWAP(newv));
     ATOMIC_MMU_CLEANUP;
     return BSWAP(ret);
 }
@@ -240,7 +255,7 @@ ABI_TYPE ATOMIC_NAME(ld)(CPUArchState *env, target_ulong addr EXTRA_ARGS)
     DATA_TYPE val, *haddr = ATOMIC_MMU_LOOKUP;
 
     ATOMIC_TRACE_LD;
-    __atomic_load(haddr, &val, __ATOMIC_RELAXED);
+    ATOMIC_LOAD(haddr, &val);
     ATOMIC_MMU_CLEANUP;
     return BSWAP(val);
 }
@@ -253,7 +268,7 @@ void ATOMIC_NAME(st)(CPUArchState *env, target_ulong addr,
 
     ATOMIC_TRACE_ST;
     val = BSWAP(val);
-    __atomic_store(haddr, &val, __ATOMIC_RELAXED);
+    ATOMIC_STORE(haddr, &val);
     ATOMIC_MMU_CLEANUP;
 }
 #else
@@ -347,6 +362,10 @@ GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
 #undef ATOMIC_TRACE_LD
 #undef ATOMIC_TRACE_RMW
 
+#undef ATOMIC_CMPXCHG
+#undef ATOMIC_LOAD
+#undef ATOMIC_STORE
+
 #undef BSWAP
 #undef ABI_TYPE
 #undef DATA_TYPE
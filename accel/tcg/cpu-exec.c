@@ -27,7 +27,9 @@
 #include "qemu/timer.h"
 #include "qemu/rcu.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-jmp-list.h"
 #include "exec/tb-lookup.h"
+#include "exec/tb-stats.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
@@ -174,6 +176,10 @@ static inline tcg_target_ulong cpu_tb_exec(CPUState *cpu, TranslationBlock *itb)
     tb_exit = ret & TB_EXIT_MASK;
     trace_exec_tb_exit(last_tb, tb_exit);
 
+    if (last_tb && last_tb->tb_stats) {
+        last_tb->tb_stats->exit_count++;
+    }
+
     if (tb_exit > TB_EXIT_IDX1) {
         /* We didn't start executing this TB (eg because the instruction
          * counter hit zero); we must restore the guest PC to the address
@@ -357,37 +363,39 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     uintptr_t old;
 
     assert(n < ARRAY_SIZE(tb->jmp_list_next));
-    qemu_spin_lock(&tb_next->jmp_lock);
 
-    /* make sure the destination TB is valid */
-    if (tb_next->cflags & CF_INVALID) {
-        goto out_unlock_next;
+    /* don't bother with a destination TB that is going away */
+    if (tb_cflags(tb_next) & CF_INVALID) {
+        return;
     }
     /* Atomically claim the jump destination slot only if it was NULL */
     old = atomic_cmpxchg(&tb->jmp_dest[n], (uintptr_t)NULL, (uintptr_t)tb_next);
     if (old) {
-        goto out_unlock_next;
+        return;
     }
 
-    /* patch the native jump address */
+    /*
+     * Patch the native jump address before publishing the jump, so that
+     * tb_jmp_unlink resets it if tb_next is invalidated from now on.
+     */
     tb_set_jmp_target(tb, n, (uintptr_t)tb_next->tc.ptr);
 
-    /* add in TB jmp list */
-    tb->jmp_list_next[n] = tb_next->jmp_list_head;
-    tb_next->jmp_list_head = (uintptr_t)tb | n;
-
-    qemu_spin_unlock(&tb_next->jmp_lock);
+    /* add in TB jmp list; this fails once tb_next's jumps were reset */
+    if (unlikely(!tb_jmp_list_push(&tb_next->jmp_list_head,
+                                   (uintptr_t)tb | n,
+                                   &tb->jmp_list_next[n]))) {
+        tb_set_jmp_target(tb, n, (uintptr_t)(tb->tc.ptr +
+                                             tb->jmp_reset_offset[n]));
+        /* release the slot, but keep the LSB if tb is being invalidated */
+        atomic_and(&tb->jmp_dest[n], (uintptr_t)NULL | 1);
+        return;
+    }
 
     qemu_log_mask_and_addr(CPU_LOG_EXEC, tb->pc,
                            "Linking TBs %p [" TARGET_FMT_lx
                            "] index %d -> %p [" TARGET_FMT_lx "]\n",
                            tb->tc.ptr, tb->pc, n,
                            tb_next->tc.ptr, tb_next->pc);
-    return;
-
- out_unlock_next:
-    qemu_spin_unlock(&tb_next->jmp_lock);
-    return;
 }
 
 static inline TranslationBlock *tb_find(CPUState *cpu,
@@ -405,6 +413,14 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         mmap_unlock();
         /* We add the TB in the virtual pc hash table for the fast lookup */
         atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+    } else if (unlikely(tb_superblock_threshold) &&
+               atomic_read(&tb->exec_count) == tb_superblock_threshold &&
+               tb_superblock_counted(tb) &&
+               atomic_cmpxchg(&tb->exec_count, tb_superblock_threshold,
+                              tb_superblock_threshold + 1) ==
+               tb_superblock_threshold) {
+        /* The TB just became hot and exited to let us do this */
+        tb = tb_gen_superblock(cpu, tb);
     }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
@@ -0,0 +1,279 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * The jitdump spec can be found at [1].
+ *
+ * [1] https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/tree/tools/perf/Documentation/jitdump-specification.txt
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "elf.h"
+#include "disas/disas.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "perf.h"
+
+static FILE *safe_fopen_w(const char *path)
+{
+    int saved_errno;
+    FILE *f;
+    int fd;
+
+    /* Delete the old file, if any. */
+    unlink(path);
+
+    /* Avoid symlink attacks by using O_CREAT | O_EXCL. */
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    f = fdopen(fd, "w+");
+    if (f == NULL) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    return f;
+}
+
+static FILE *perfmap;
+static FILE *jitdump;
+static QemuMutex jitdump_lock;
+
+/*
+ * vCPU threads may still be translating code while QEMU exits, so the
+ * files are only flushed and left for the kernel to close.
+ */
+static void perf_flush(void)
+{
+    if (perfmap) {
+        fflush(perfmap);
+    }
+    if (jitdump) {
+        qemu_mutex_lock(&jitdump_lock);
+        fflush(jitdump);
+        qemu_mutex_unlock(&jitdump_lock);
+    }
+}
+
+static void perf_register_flush(void)
+{
+    static bool registered;
+
+    if (!registered) {
+        atexit(perf_flush);
+        registered = true;
+    }
+}
+
+void perf_enable_perfmap(void)
+{
+    char map_file[32];
+
+    snprintf(map_file, sizeof(map_file), "/tmp/perf-%d.map", getpid());
+    perfmap = safe_fopen_w(map_file);
+    if (perfmap == NULL) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    map_file, strerror(errno));
+        return;
+    }
+    perf_register_flush();
+}
+
+#ifdef CONFIG_POSIX
+static void *perf_marker;
+#endif
+static uint64_t jitdump_code_index;
+
+#define JITHEADER_MAGIC 0x4A695444
+#define JITHEADER_VERSION 1
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+enum jit_record_type {
+    JIT_CODE_LOAD = 0,
+};
+
+struct jr_prefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+struct jr_code_load {
+    struct jr_prefix p;
+
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+static uint32_t get_e_machine(void)
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__arm__)
+    return EM_ARM;
+#elif defined(_ARCH_PPC64)
+    return EM_PPC64;
+#elif defined(_ARCH_PPC)
+    return EM_PPC;
+#elif defined(__s390x__)
+    return EM_S390;
+#elif defined(__mips__)
+    return EM_MIPS;
+#elif defined(__sparc__) && HOST_LONG_BITS == 64
+    return EM_SPARCV9;
+#elif defined(__sparc__)
+    return EM_SPARC;
+#else
+    return EM_NONE;
+#endif
+}
+
+void perf_enable_jitdump(void)
+{
+    struct jitheader header;
+    char jitdump_file[32];
+    const char *dir;
+    char *path;
+
+    dir = getenv("JITDUMPDIR");
+    snprintf(jitdump_file, sizeof(jitdump_file), "jit-%d.dump", getpid());
+    path = g_build_filename(dir ? dir : ".", jitdump_file, NULL);
+    jitdump = safe_fopen_w(path);
+    if (jitdump == NULL) {
+        warn_report("Could not open %s: %s, proceeding without jitdump",
+                    path, strerror(errno));
+        g_free(path);
+        return;
+    }
+
+#ifdef CONFIG_POSIX
+    /*
+     * perf only processes the dump if it sees an executable mapping of
+     * it in the trace, so create one and keep it for the lifetime of
+     * the process.
+     */
+    perf_marker = mmap(NULL, qemu_real_host_page_size,
+                       PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                       fileno(jitdump), 0);
+    if (perf_marker == MAP_FAILED) {
+        warn_report("Could not map %s: %s, proceeding without jitdump",
+                    path, strerror(errno));
+        fclose(jitdump);
+        jitdump = NULL;
+        g_free(path);
+        return;
+    }
+#endif
+    g_free(path);
+
+    qemu_mutex_init(&jitdump_lock);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = JITHEADER_MAGIC;
+    header.version = JITHEADER_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = get_e_machine();
+    header.pid = getpid();
+    header.timestamp = get_clock();
+    fwrite(&header, sizeof(header), 1, jitdump);
+
+    perf_register_flush();
+}
+
+static void write_perfmap_entry(const void *start, size_t size,
+                                const char *name)
+{
+    /* perf-<pid>.map lines are written in one go, so no lock is needed. */
+    fprintf(perfmap, "%"PRIxPTR" %zx %s\n", (uintptr_t)start, size, name);
+}
+
+static void write_jr_code_load(const void *start, size_t size,
+                               const char *name)
+{
+    struct jr_code_load load;
+    size_t name_size = strlen(name) + 1;
+
+    load.p.id = JIT_CODE_LOAD;
+    load.p.total_size = sizeof(load) + name_size + size;
+    load.p.timestamp = get_clock();
+    load.pid = getpid();
+    load.tid = qemu_get_thread_id();
+    load.vma = (uintptr_t)start;
+    load.code_addr = (uintptr_t)start;
+    load.code_size = size;
+
+    qemu_mutex_lock(&jitdump_lock);
+    load.code_index = jitdump_code_index++;
+    fwrite(&load, sizeof(load), 1, jitdump);
+    fwrite(name, name_size, 1, jitdump);
+    fwrite(start, size, 1, jitdump);
+    qemu_mutex_unlock(&jitdump_lock);
+}
+
+void perf_report_prologue(const void *start, size_t size)
+{
+    if (perfmap) {
+        write_perfmap_entry(start, size, "tcg-prologue-buffer");
+    }
+    if (jitdump) {
+        write_jr_code_load(start, size, "tcg-prologue-buffer");
+    }
+}
+
+void perf_report_code(uint64_t guest_pc, const void *start, size_t size)
+{
+    const char *symbol;
+    char *name;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    /*
+     * Name the code after the guest function it belongs to, if the
+     * symbol table is known, so that perf can aggregate samples by guest
+     * function.  Otherwise fall back to the guest address of the TB.
+     */
+    symbol = lookup_symbol(guest_pc);
+    if (symbol[0] != '\0') {
+        name = g_strdup_printf("guest-%s", symbol);
+    } else {
+        name = g_strdup_printf("guest-0x%"PRIx64, guest_pc);
+    }
+
+    if (perfmap) {
+        write_perfmap_entry(start, size, name);
+    }
+    if (jitdump) {
+        write_jr_code_load(start, size, name);
+    }
+    g_free(name);
+}
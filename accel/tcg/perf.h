@@ -0,0 +1,27 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+/* Start writing /tmp/perf-<pid>.map */
+void perf_enable_perfmap(void);
+
+/* Start writing jit-<pid>.dump in $JITDUMPDIR, or the current directory */
+void perf_enable_jitdump(void);
+
+/* Add information about the TCG prologue to perf map and jitdump */
+void perf_report_prologue(const void *start, size_t size);
+
+/*
+ * Add information about a translation block to perf map and jitdump.
+ * @guest_pc is the guest address the host code at @start was translated
+ * from, and is used together with the guest symbol table (if any) to
+ * name the code.
+ */
+void perf_report_code(uint64_t guest_pc, const void *start, size_t size);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Per-TranslationBlock execution and translation statistics
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/tb-hash.h"
+#include "exec/tb-stats.h"
+#include "qemu/qht.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+
+#define TB_STATS_HTABLE_SIZE (1 << 12)
+
+bool tb_stats_enabled;
+
+static struct qht tb_stats_htable;
+
+static bool tb_stats_cmp(const void *ap, const void *bp)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+        a->pc == b->pc &&
+        a->cs_base == b->cs_base &&
+        a->flags == b->flags;
+}
+
+void tb_stats_init(void)
+{
+    qht_init(&tb_stats_htable, tb_stats_cmp, TB_STATS_HTABLE_SIZE,
+             QHT_MODE_AUTO_RESIZE);
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags)
+{
+    TBStatistics *s, *new;
+    void *existing;
+    uint32_t hash = tb_hash_func(phys_pc, pc, flags, 0, 0);
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+    };
+
+    s = qht_lookup(&tb_stats_htable, &key, hash);
+    if (likely(s)) {
+        return s;
+    }
+
+    new = g_new0(TBStatistics, 1);
+    new->phys_pc = phys_pc;
+    new->pc = pc;
+    new->cs_base = cs_base;
+    new->flags = flags;
+    qemu_spin_init(&new->lock);
+
+    /* Another vCPU may have inserted the same block in the meantime */
+    if (!qht_insert(&tb_stats_htable, new, hash, &existing)) {
+        g_free(new);
+        return existing;
+    }
+    return new;
+}
+
+void tb_stats_enable(bool enable)
+{
+    if (atomic_read(&tb_stats_enabled) == enable) {
+        return;
+    }
+    atomic_set(&tb_stats_enabled, enable);
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+static void tb_stats_reset_one(struct qht *ht, void *p, uint32_t hash,
+                               void *userp)
+{
+    TBStatistics *s = p;
+
+    s->exec_count = 0;
+    s->exit_count = 0;
+
+    qemu_spin_lock(&s->lock);
+    s->translations = 0;
+    s->translate_time_ns = 0;
+    qemu_spin_unlock(&s->lock);
+}
+
+void tb_stats_reset(void)
+{
+    qht_iter(&tb_stats_htable, tb_stats_reset_one, NULL);
+}
+
+static void tb_stats_collect(struct qht *ht, void *p, uint32_t hash,
+                             void *userp)
+{
+    g_ptr_array_add(userp, p);
+}
+
+static gint tb_stats_cmp_exec_count(gconstpointer ap, gconstpointer bp)
+{
+    const TBStatistics *a = *(TBStatistics **)ap;
+    const TBStatistics *b = *(TBStatistics **)bp;
+
+    return a->exec_count < b->exec_count ? 1 :
+           a->exec_count > b->exec_count ? -1 : 0;
+}
+
+TBStatsInfoList *qmp_query_tb_stats(bool has_count, int64_t count,
+                                    Error **errp)
+{
+    TBStatsInfoList *head = NULL, **tail = &head;
+    GPtrArray *array;
+    guint i;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return NULL;
+    }
+    if (!has_count) {
+        count = 10;
+    } else if (count < 0) {
+        error_setg(errp, "Parameter 'count' expects a non-negative value");
+        return NULL;
+    }
+
+    array = g_ptr_array_new();
+    qht_iter(&tb_stats_htable, tb_stats_collect, array);
+    g_ptr_array_sort(array, tb_stats_cmp_exec_count);
+
+    for (i = 0; i < array->len && i < count; i++) {
+        TBStatistics *s = g_ptr_array_index(array, i);
+        TBStatsInfoList *entry = g_new0(TBStatsInfoList, 1);
+        TBStatsInfo *info = g_new0(TBStatsInfo, 1);
+
+        info->pc = s->pc;
+        info->phys_pc = s->phys_pc;
+        info->cs_base = s->cs_base;
+        info->flags = s->flags;
+        info->exec_count = s->exec_count;
+        info->exit_count = s->exit_count;
+
+        qemu_spin_lock(&s->lock);
+        info->translations = s->translations;
+        info->translate_time_ns = s->translate_time_ns;
+        info->guest_insns = s->guest_insns;
+        info->tcg_ops = s->tcg_ops;
+        info->host_code_size = s->host_code_size;
+        info->spills = s->spills;
+        qemu_spin_unlock(&s->lock);
+
+        entry->value = info;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    g_ptr_array_free(array, true);
+
+    return head;
+}
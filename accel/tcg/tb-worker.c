@@ -0,0 +1,262 @@
+/*
+ * Background translation of likely successor TBs (user-mode only).
+ *
+ * When a vCPU misses in the TB hash table it has to translate the code
+ * before it can continue.  To take some of that work off the critical
+ * path, tb_gen_code hands the direct branch targets of each new TB to a
+ * pool of worker threads, which translate them with the cs_base and
+ * flags of the parent TB.  The resulting TBs are linked into the hash
+ * table as usual, so that the vCPU finds them in tb_find and chains them
+ * like any other TB.  Speculative TBs do not queue their own successors.
+ *
+ * The workers also translate batches of TBs that are expected to run,
+ * such as those recorded by an earlier run of the same program, when
+ * they have no successors to translate.
+ *
+ * Translation is serialized by mmap_lock in user-mode, and the workers
+ * take it as well; what they save the vCPUs is the latency of the
+ * translation, not the work itself.  In system emulation guest code is
+ * fetched through the softmmu TLB of the vCPU, which only its thread may
+ * refill, so the workers are not available there.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "tcg.h"
+#include "tb-worker.h"
+
+#define TB_WORKER_QUEUE_SIZE 64
+
+typedef struct TBWorkerRequest {
+    CPUState *cpu;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBWorkerRequest;
+
+typedef struct TBWorkerBatch {
+    CPUState *cpu;
+    TBWorkerPrefetch *tbs;
+    size_t n;
+    size_t next;
+    QSIMPLEQ_ENTRY(TBWorkerBatch) entry;
+} TBWorkerBatch;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    /* Ring of pending requests, protected by @lock */
+    TBWorkerRequest queue[TB_WORKER_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int count;
+    /* Pending prefetch batches, protected by @lock */
+    QSIMPLEQ_HEAD(, TBWorkerBatch) batches;
+    /* Set at init time, and cleared in the child after fork */
+    unsigned int nb_workers;
+} tb_worker;
+
+static void tb_worker_translate(const TBWorkerRequest *req)
+{
+    const int prot = PAGE_VALID | PAGE_READ | PAGE_EXEC;
+    target_ulong page = req->pc & TARGET_PAGE_MASK;
+
+    rcu_read_lock();
+    mmap_lock();
+    /*
+     * The translator loads guest code directly from host memory, and a
+     * fault on this thread could not be delivered to the guest.  Only
+     * translate if both the page of @pc and the next one, into which the
+     * TB may extend, can be read.  Holding mmap_lock keeps them mapped.
+     */
+    if ((page_get_flags(page) & prot) == prot &&
+        (page_get_flags(page + TARGET_PAGE_SIZE) & prot) == prot &&
+        !tb_htable_lookup(req->cpu, req->pc, req->cs_base, req->flags,
+                          req->cflags)) {
+        tb_gen_code(req->cpu, req->pc, req->cs_base, req->flags,
+                    req->cflags | CF_SPECULATIVE);
+    }
+    mmap_unlock();
+    rcu_read_unlock();
+}
+
+static void tb_worker_batch_free(TBWorkerBatch *batch)
+{
+    object_unref(OBJECT(batch->cpu));
+    g_free(batch->tbs);
+    g_free(batch);
+}
+
+/* Take the next TB of the first batch; called with the lock held */
+static void tb_worker_batch_next(TBWorkerRequest *req)
+{
+    TBWorkerBatch *batch = QSIMPLEQ_FIRST(&tb_worker.batches);
+    const TBWorkerPrefetch *p = &batch->tbs[batch->next++];
+
+    object_ref(OBJECT(batch->cpu));
+    req->cpu = batch->cpu;
+    req->pc = p->pc;
+    req->cs_base = p->cs_base;
+    req->flags = p->flags;
+    req->cflags = p->cflags;
+    if (batch->next == batch->n) {
+        QSIMPLEQ_REMOVE_HEAD(&tb_worker.batches, entry);
+        tb_worker_batch_free(batch);
+    }
+}
+
+static void *tb_worker_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+
+    for (;;) {
+        TBWorkerRequest req;
+
+        qemu_mutex_lock(&tb_worker.lock);
+        while (tb_worker.count == 0 && QSIMPLEQ_EMPTY(&tb_worker.batches)) {
+            qemu_cond_wait(&tb_worker.cond, &tb_worker.lock);
+        }
+        if (tb_worker.count) {
+            req = tb_worker.queue[tb_worker.head];
+            tb_worker.head = (tb_worker.head + 1) % TB_WORKER_QUEUE_SIZE;
+            tb_worker.count--;
+        } else {
+            tb_worker_batch_next(&req);
+        }
+        qemu_mutex_unlock(&tb_worker.lock);
+
+        tb_worker_translate(&req);
+        object_unref(OBJECT(req.cpu));
+    }
+    return NULL;
+}
+
+void tb_worker_init(unsigned int nb_workers)
+{
+    unsigned int i;
+
+    if (nb_workers == 0) {
+        return;
+    }
+    qemu_mutex_init(&tb_worker.lock);
+    qemu_cond_init(&tb_worker.cond);
+    QSIMPLEQ_INIT(&tb_worker.batches);
+    tb_worker.nb_workers = nb_workers;
+
+    for (i = 0; i < nb_workers; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "tb-worker", tb_worker_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+    }
+}
+
+void tb_worker_queue_successors(CPUState *cpu, TranslationBlock *tb)
+{
+    TCGContext *s = tcg_ctx;
+    uint32_t cflags = tb_cflags(tb);
+    bool queued = false;
+    int i;
+
+    if (tb_worker.nb_workers == 0 || s->nb_tb_successors == 0) {
+        return;
+    }
+    /*
+     * Single-instruction and I/O TBs are one-offs, and their successors
+     * would be looked up with different cflags anyway.
+     */
+    if (cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE | CF_SPECULATIVE) ||
+        cpu->singlestep_enabled) {
+        return;
+    }
+    cflags &= CF_HASH_MASK;
+
+    qemu_mutex_lock(&tb_worker.lock);
+    for (i = 0; i < s->nb_tb_successors; i++) {
+        target_ulong pc = s->tb_successors[i];
+        TBWorkerRequest *req;
+
+        /* When the workers fall behind, drop the request */
+        if (tb_worker.count == TB_WORKER_QUEUE_SIZE) {
+            break;
+        }
+        if (tb_htable_lookup(cpu, pc, tb->cs_base, tb->flags, cflags)) {
+            continue;
+        }
+        req = &tb_worker.queue[(tb_worker.head + tb_worker.count) %
+                               TB_WORKER_QUEUE_SIZE];
+        /* The vCPU thread may exit before the request is served */
+        object_ref(OBJECT(cpu));
+        req->cpu = cpu;
+        req->pc = pc;
+        req->cs_base = tb->cs_base;
+        req->flags = tb->flags;
+        req->cflags = cflags;
+        tb_worker.count++;
+        queued = true;
+    }
+    if (queued) {
+        qemu_cond_signal(&tb_worker.cond);
+    }
+    qemu_mutex_unlock(&tb_worker.lock);
+}
+
+bool tb_worker_prefetch(CPUState *cpu, TBWorkerPrefetch *tbs, size_t n)
+{
+    TBWorkerBatch *batch;
+
+    if (tb_worker.nb_workers == 0 || n == 0) {
+        g_free(tbs);
+        return false;
+    }
+    batch = g_new0(TBWorkerBatch, 1);
+    object_ref(OBJECT(cpu));
+    batch->cpu = cpu;
+    batch->tbs = tbs;
+    batch->n = n;
+
+    qemu_mutex_lock(&tb_worker.lock);
+    QSIMPLEQ_INSERT_TAIL(&tb_worker.batches, batch, entry);
+    qemu_cond_signal(&tb_worker.cond);
+    qemu_mutex_unlock(&tb_worker.lock);
+    return true;
+}
+
+/* Called with mmap_lock held, so no worker is translating */
+void tb_worker_fork_start(void)
+{
+    if (tb_worker.nb_workers) {
+        qemu_mutex_lock(&tb_worker.lock);
+    }
+}
+
+void tb_worker_fork_end(int child)
+{
+    if (tb_worker.nb_workers == 0) {
+        return;
+    }
+    if (child) {
+        /* Only the forking thread survives; drop the pending requests */
+        tb_worker.nb_workers = 0;
+        tb_worker.head = 0;
+        tb_worker.count = 0;
+        while (!QSIMPLEQ_EMPTY(&tb_worker.batches)) {
+            TBWorkerBatch *batch = QSIMPLEQ_FIRST(&tb_worker.batches);
+
+            QSIMPLEQ_REMOVE_HEAD(&tb_worker.batches, entry);
+            tb_worker_batch_free(batch);
+        }
+        qemu_mutex_init(&tb_worker.lock);
+        qemu_cond_init(&tb_worker.cond);
+    } else {
+        qemu_mutex_unlock(&tb_worker.lock);
+    }
+}
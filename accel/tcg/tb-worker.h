@@ -0,0 +1,42 @@
+/*
+ * Background translation of likely successor TBs (user-mode only).
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef ACCEL_TCG_TB_WORKER_H
+#define ACCEL_TCG_TB_WORKER_H
+
+#include "exec/exec-all.h"
+
+/* Start @nb_workers threads that translate successors of new TBs */
+void tb_worker_init(unsigned int nb_workers);
+
+/*
+ * Queue the successors of @tb recorded during its translation (see
+ * translator_add_successor) for translation by the workers.
+ * Called with mmap_lock held, right after @tb has been linked.
+ */
+void tb_worker_queue_successors(CPUState *cpu, TranslationBlock *tb);
+
+/* A TB to be translated ahead of time, see tb_worker_prefetch */
+typedef struct TBWorkerPrefetch {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBWorkerPrefetch;
+
+/*
+ * Have the workers translate the @n TBs in @tbs for @cpu, when they have
+ * no successors to translate.  Takes ownership of @tbs, which must have
+ * been allocated with g_malloc.  Returns false, and frees @tbs, if there
+ * are no workers.
+ */
+bool tb_worker_prefetch(CPUState *cpu, TBWorkerPrefetch *tbs, size_t n);
+
+/* Quiesce the workers around fork(); the child runs without them */
+void tb_worker_fork_start(void);
+void tb_worker_fork_end(int child);
+
+#endif
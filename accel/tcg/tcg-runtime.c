@@ -163,7 +163,43 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+/*
+ * Like lookup_tb_ptr, but also record the destination in the branch
+ * cache @opaque, which may be NULL; see translator_lookup_and_goto_ptr.
+ */
+void *HELPER(lookup_tb_ptr_cached)(CPUArchState *env, void *opaque)
+{
+    TBBranchCache *bc = opaque;
+    CPUState *cpu = ENV_GET_CPU(env);
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    uint32_t flags;
+
+    tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, curr_cflags());
+    if (tb == NULL) {
+        return tcg_ctx->code_gen_epilogue;
+    }
+    if (bc && (!bc->is_call || bc->ret_pc == pc)) {
+        atomic_set(&bc->tb, tb);
+    }
+    qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
+                           "Chain %d: %p ["
+                           TARGET_FMT_lx "/" TARGET_FMT_lx "/%#x] %s\n",
+                           cpu->cpu_index, tb->tc.ptr, cs_base, pc, flags,
+                           lookup_symbol(pc));
+    return tb->tc.ptr;
+}
+
 void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(ENV_GET_CPU(env), GETPC());
 }
+
+void HELPER(defer_io)(CPUArchState *env)
+{
+#ifdef CONFIG_USER_ONLY
+    g_assert_not_reached();
+#else
+    cpu_io_recompile(ENV_GET_CPU(env), GETPC());
+#endif
+}
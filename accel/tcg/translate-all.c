@@ -51,9 +51,17 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-jmp-list.h"
+#include "exec/tb-stats.h"
 #include "translate-all.h"
-#include "qemu/bitmap.h"
+#include "perf.h"
+#ifdef CONFIG_USER_ONLY
+#include "tb-worker.h"
+#endif
+#include "qemu/crc32c.h"
 #include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "qemu-version.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
 #include "exec/log.h"
@@ -99,17 +107,13 @@
 #define assert_memory_lock() tcg_debug_assert(have_mmap_lock())
 #endif
 
-#define SMC_BITMAP_USE_THRESHOLD 10
-
 typedef struct PageDesc {
-    /* list of TBs intersecting this ram page */
-    uintptr_t first_tb;
-#ifdef CONFIG_SOFTMMU
-    /* in order to optimize self modifying code, we count the number
-       of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
-    unsigned int code_write_count;
-#else
+    /*
+     * Byte ranges of the TBs intersecting this ram page.  code_ranges[n]
+     * holds tb->page_range[n] of the TBs whose n-th page is this one.
+     */
+    IntervalTreeRoot code_ranges[2];
+#ifdef CONFIG_USER_ONLY
     unsigned long flags;
 #endif
 #ifndef CONFIG_USER_ONLY
@@ -161,17 +165,33 @@ struct page_collection {
     struct page_entry *max;
 };
 
-/* list iterators for lists of tagged pointers in TranslationBlock */
-#define TB_FOR_EACH_TAGGED(head, tb, n, field)                          \
-    for (n = (head) & 1, tb = (TranslationBlock *)((head) & ~1);        \
-         tb; tb = (TranslationBlock *)tb->field[n], n = (uintptr_t)tb & 1, \
-             tb = (TranslationBlock *)((uintptr_t)tb & ~1))
+static inline TranslationBlock *page_range_tb(IntervalTreeNode *node,
+                                              unsigned int n)
+{
+    return n ? container_of(node, TranslationBlock, page_range[1]) :
+               container_of(node, TranslationBlock, page_range[0]);
+}
+
+/*
+ * Iterate over the TBs of @pagedesc with code in [@start, @last].  The TB
+ * being visited may be removed from the page.
+ */
+#define PAGE_FOR_EACH_TB_RANGE(pagedesc, start, last, node, tb, n)      \
+    for (n = 0; n < 2; n++)                                             \
+        for (node = interval_tree_iter_first(&(pagedesc)->code_ranges[n], \
+                                             start, last);              \
+             node && (tb = page_range_tb(node, n));                     \
+             node = interval_tree_iter_next(&(pagedesc)->code_ranges[n], \
+                                            node, start, last))
 
-#define PAGE_FOR_EACH_TB(pagedesc, tb, n)                       \
-    TB_FOR_EACH_TAGGED((pagedesc)->first_tb, tb, n, page_next)
+#define PAGE_FOR_EACH_TB(pagedesc, node, tb, n)                         \
+    PAGE_FOR_EACH_TB_RANGE(pagedesc, 0, UINT64_MAX, node, tb, n)
 
-#define TB_FOR_EACH_JMP(head_tb, tb, n)                                 \
-    TB_FOR_EACH_TAGGED((head_tb)->jmp_list_head, tb, n, jmp_list_next)
+static inline bool page_has_code(const PageDesc *pd)
+{
+    return !interval_tree_is_empty(&pd->code_ranges[0]) ||
+           !interval_tree_is_empty(&pd->code_ranges[1]);
+}
 
 /* In system mode we want L1_MAP to be based on ram offsets,
    while in user mode we want it to be based on virtual addresses.  */
@@ -215,6 +235,8 @@ TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
+bool serial_atomics;
+bool serial_io;
 
 static void page_table_config_init(void)
 {
@@ -802,6 +824,7 @@ struct page_collection *
 page_collection_lock(tb_page_addr_t start, tb_page_addr_t end)
 {
     struct page_collection *set = g_malloc(sizeof(*set));
+    uint64_t first = start, last = (uint64_t)end - 1;
     tb_page_addr_t index;
     PageDesc *pd;
 
@@ -818,6 +841,7 @@ page_collection_lock(tb_page_addr_t start, tb_page_addr_t end)
     g_tree_foreach(set->tree, page_entry_lock, NULL);
 
     for (index = start; index <= end; index++) {
+        IntervalTreeNode *node;
         TranslationBlock *tb;
         int n;
 
@@ -830,7 +854,8 @@ page_collection_lock(tb_page_addr_t start, tb_page_addr_t end)
             goto retry;
         }
         assert_page_locked(pd);
-        PAGE_FOR_EACH_TB(pd, tb, n) {
+        /* only the TBs in the range are going to be invalidated */
+        PAGE_FOR_EACH_TB_RANGE(pd, first, last, node, tb, n) {
             if (page_trylock_add(set, tb->page_addr[0]) ||
                 (tb->page_addr[1] != -1 &&
                  page_trylock_add(set, tb->page_addr[1]))) {
@@ -1140,6 +1165,14 @@ static void tb_htable_init(void)
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
 }
 
+#ifdef CONFIG_USER_ONLY
+static inline void tb_cache_reset(void)
+{
+}
+#else
+static void tb_cache_reset(void);
+#endif
+
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
    (in bytes) allocated to the translation buffer. Zero means default
    size. */
@@ -1149,6 +1182,7 @@ void tcg_exec_init(unsigned long tb_size)
     cpu_gen_init();
     page_init();
     tb_htable_init();
+    tb_stats_init();
     code_gen_alloc(tb_size);
 #if defined(CONFIG_SOFTMMU)
     /* There's no guest base to take into account, so go ahead and
@@ -1174,18 +1208,7 @@ static TranslationBlock *tb_alloc(target_ulong pc)
     return tb;
 }
 
-/* call with @p->lock held */
-static inline void invalidate_page_bitmap(PageDesc *p)
-{
-    assert_page_locked(p);
-#ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
-    p->code_write_count = 0;
-#endif
-}
-
-/* Set to NULL all the 'first_tb' fields in all PageDescs. */
+/* Empty the code_ranges trees of all PageDescs. */
 static void page_flush_tb_1(int level, void **lp)
 {
     int i;
@@ -1198,8 +1221,8 @@ static void page_flush_tb_1(int level, void **lp)
 
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
-            pd[i].first_tb = (uintptr_t)NULL;
-            invalidate_page_bitmap(pd + i);
+            interval_tree_init(&pd[i].code_ranges[0]);
+            interval_tree_init(&pd[i].code_ranges[1]);
             page_unlock(&pd[i]);
         }
     } else {
@@ -1229,6 +1252,138 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * Caches of the TB being translated, moved to tb->branch_caches once the
+ * TB is linked.  Protected by mmap_lock.
+ */
+static TBBranchCache *tb_branch_caches;
+
+TBBranchCache *tb_branch_cache_new(void)
+{
+    TBBranchCache *bc = g_new0(TBBranchCache, 1);
+
+    assert_memory_lock();
+    bc->next = tb_branch_caches;
+    tb_branch_caches = bc;
+    return bc;
+}
+
+static void tb_branch_cache_free_list(TBBranchCache *bc)
+{
+    TBBranchCache *next;
+
+    for (; bc; bc = next) {
+        next = bc->next;
+        g_free(bc);
+    }
+}
+
+/*
+ * Free the caches left behind by a translation that was abandoned or
+ * discarded; its code never ran, so nobody else can point to them.
+ */
+static void tb_branch_cache_discard(void)
+{
+    assert_memory_lock();
+    tb_branch_cache_free_list(tb_branch_caches);
+    tb_branch_caches = NULL;
+}
+
+static void tb_branch_cache_attach(TranslationBlock *tb)
+{
+    assert_memory_lock();
+    tb->branch_caches = tb_branch_caches;
+    tb_branch_caches = NULL;
+}
+
+typedef struct TBBranchCacheRelease {
+    struct rcu_head rcu;
+    TBBranchCache *list;
+} TBBranchCacheRelease;
+
+static void tb_branch_cache_free_rcu(TBBranchCacheRelease *r)
+{
+    tb_branch_cache_free_list(r->list);
+    g_free(r);
+}
+
+/*
+ * One grace period after the invalidation, no vCPU runs the code of the
+ * TB anymore, so its call sites cannot push their caches again; remove
+ * them from the return-address stacks, and free them after another grace
+ * period, once no vCPU can be using an entry it popped before.
+ */
+static void tb_branch_cache_purge_rcu(TBBranchCacheRelease *r)
+{
+    TBBranchCache *bc;
+    CPUState *cpu;
+    int i;
+
+    cpu_list_lock();
+    CPU_FOREACH(cpu) {
+        for (bc = r->list; bc; bc = bc->next) {
+            if (!bc->is_call) {
+                continue;
+            }
+            for (i = 0; i < TB_RAS_SIZE; i++) {
+                atomic_cmpxchg(&cpu->tb_ras[i], bc, NULL);
+            }
+        }
+    }
+    cpu_list_unlock();
+    call_rcu(r, tb_branch_cache_free_rcu, rcu);
+}
+
+/* Free the caches of @tb, which has just been invalidated */
+static void tb_branch_cache_release(TranslationBlock *tb)
+{
+    TBBranchCacheRelease *r;
+
+    assert_memory_lock();
+    if (!tb->branch_caches) {
+        return;
+    }
+    r = g_new(TBBranchCacheRelease, 1);
+    r->list = tb->branch_caches;
+    tb->branch_caches = NULL;
+    call_rcu(r, tb_branch_cache_purge_rcu, rcu);
+}
+
+static gboolean tb_branch_cache_flush_iter(gpointer key, gpointer value,
+                                           gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    tb_branch_cache_free_list(tb->branch_caches);
+    tb->branch_caches = NULL;
+    return false;
+}
+
+/* Called by tb_flush with the vCPUs stopped and their tb_ras cleared */
+static void tb_branch_cache_free_all(void)
+{
+    tcg_tb_foreach(tb_branch_cache_flush_iter, NULL);
+    tb_branch_cache_discard();
+}
+#else
+static inline void tb_branch_cache_discard(void)
+{
+}
+
+static inline void tb_branch_cache_attach(TranslationBlock *tb)
+{
+}
+
+static inline void tb_branch_cache_release(TranslationBlock *tb)
+{
+}
+
+static inline void tb_branch_cache_free_all(void)
+{
+}
+#endif
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
@@ -1251,7 +1406,10 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
+        memset(cpu->tb_ras, 0, sizeof(cpu->tb_ras));
     }
+    tb_branch_cache_free_all();
+    tb_cache_reset();
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
@@ -1274,6 +1432,63 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+/* Fraction of the regions that are recycled at a time */
+#define TB_EVICT_FRACTION 8
+
+/* Changes whenever code is flushed or evicted */
+static unsigned tb_evict_gen(void)
+{
+    return atomic_mb_read(&tb_ctx.tb_flush_count) +
+           atomic_mb_read(&tb_ctx.tb_evict_count);
+}
+
+static void tb_jmp_list_purge(TranslationBlock *orig);
+
+static void tb_evict_one(gpointer data, gpointer user_data)
+{
+    tb_phys_invalidate(data, -1);
+    /* no other TB can keep pointing to the evicted code */
+    tb_jmp_list_purge(data);
+}
+
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data evict_gen)
+{
+    size_t n = 0;
+
+    mmap_lock();
+    /* Someone else may have made room in the meantime */
+    if (tb_evict_gen() != evict_gen.host_int) {
+        goto done;
+    }
+    n = tcg_region_evict(MAX(tcg_nb_regions() / TB_EVICT_FRACTION, 1),
+                         tb_evict_one, NULL);
+    if (n) {
+        atomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    }
+done:
+    mmap_unlock();
+
+    if (n == 0 && tb_evict_gen() == evict_gen.host_int) {
+        /* every region is being filled by some vCPU */
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+    }
+}
+
+/*
+ * Make room in code_gen_buffer for new translations.  Rather than
+ * flushing all the code, evict the oldest regions: only their TBs are
+ * unlinked from the hash table, the pages and the jump lists, and the
+ * rest of the code keeps running.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    if (tcg_nb_regions() == 1) {
+        tb_flush(cpu);
+        return;
+    }
+    async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_INT(tb_evict_gen()));
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1327,74 +1542,59 @@ static void tb_page_check(void)
 #endif /* CONFIG_USER_ONLY */
 
 /*
+ * Remove @tb from @pd, which is its @n-th page.
+ *
  * user-mode: call with mmap_lock held
  * !user-mode: call with @pd->lock held
  */
-static inline void tb_page_remove(PageDesc *pd, TranslationBlock *tb)
+static inline void tb_page_remove(PageDesc *pd, TranslationBlock *tb,
+                                  unsigned int n)
 {
-    TranslationBlock *tb1;
-    uintptr_t *pprev;
-    unsigned int n1;
-
     assert_page_locked(pd);
-    pprev = &pd->first_tb;
-    PAGE_FOR_EACH_TB(pd, tb1, n1) {
-        if (tb1 == tb) {
-            *pprev = tb1->page_next[n1];
-            return;
-        }
-        pprev = &tb1->page_next[n1];
-    }
-    g_assert_not_reached();
+    interval_tree_remove(&tb->page_range[n], &pd->code_ranges[n]);
 }
 
-/* remove @orig from its @n_orig-th jump list */
+/*
+ * Cut @orig's @n_orig-th jump from its destination: no jump can be chained
+ * there anymore.  The entry of @orig stays in the jump list of the
+ * destination, which is cheaper than taking the destination's lock to
+ * remove it; tb_jmp_list_purge takes care of it later, and until then
+ * resetting the jump again when the destination is invalidated is harmless.
+ */
 static inline void tb_remove_from_jmp_list(TranslationBlock *orig, int n_orig)
 {
-    uintptr_t ptr, ptr_locked;
-    TranslationBlock *dest;
-    TranslationBlock *tb;
-    uintptr_t *pprev;
+    /* mark the LSB of jmp_dest[] so that no further jumps can be inserted */
+    atomic_or(&orig->jmp_dest[n_orig], 1);
+}
+
+static uintptr_t *tb_jmp_list_next(uintptr_t entry)
+{
+    TranslationBlock *tb = (TranslationBlock *)(entry & ~1);
+
+    return &tb->jmp_list_next[entry & 1];
+}
+
+/*
+ * Drop the entries of the invalidated TB @orig from the jump lists of its
+ * destinations.  Must be done before the memory of @orig is reused, since
+ * resetting the jumps of a destination writes to its origins.
+ */
+static void tb_jmp_list_purge(TranslationBlock *orig)
+{
     int n;
 
-    /* mark the LSB of jmp_dest[] so that no further jumps can be inserted */
-    ptr = atomic_or_fetch(&orig->jmp_dest[n_orig], 1);
-    dest = (TranslationBlock *)(ptr & ~1);
-    if (dest == NULL) {
-        return;
-    }
+    for (n = 0; n < 2; n++) {
+        uintptr_t ptr = atomic_read(&orig->jmp_dest[n]);
+        TranslationBlock *dest = (TranslationBlock *)(ptr & ~1);
 
-    qemu_spin_lock(&dest->jmp_lock);
-    /*
-     * While acquiring the lock, the jump might have been removed if the
-     * destination TB was invalidated; check again.
-     */
-    ptr_locked = atomic_read(&orig->jmp_dest[n_orig]);
-    if (ptr_locked != ptr) {
-        qemu_spin_unlock(&dest->jmp_lock);
-        /*
-         * The only possibility is that the jump was unlinked via
-         * tb_jump_unlink(dest). Seeing here another destination would be a bug,
-         * because we set the LSB above.
-         */
-        g_assert(ptr_locked == 1 && dest->cflags & CF_INVALID);
-        return;
-    }
-    /*
-     * We first acquired the lock, and since the destination pointer matches,
-     * we know for sure that @orig is in the jmp list.
-     */
-    pprev = &dest->jmp_list_head;
-    TB_FOR_EACH_JMP(dest, tb, n) {
-        if (tb == orig && n == n_orig) {
-            *pprev = tb->jmp_list_next[n];
-            /* no need to set orig->jmp_dest[n]; setting the LSB was enough */
-            qemu_spin_unlock(&dest->jmp_lock);
-            return;
+        if (dest == NULL) {
+            continue;
         }
-        pprev = &tb->jmp_list_next[n];
+        qemu_spin_lock(&dest->jmp_lock);
+        tb_jmp_list_remove(&dest->jmp_list_head, (uintptr_t)orig | n,
+                           tb_jmp_list_next);
+        qemu_spin_unlock(&dest->jmp_lock);
     }
-    g_assert_not_reached();
 }
 
 /* reset the jump entry 'n' of a TB so that it is not chained to
@@ -1405,22 +1605,28 @@ static inline void tb_reset_jump(TranslationBlock *tb, int n)
     tb_set_jmp_target(tb, n, addr);
 }
 
-/* remove any jumps to the TB */
+/*
+ * Remove any jumps to the TB.  Closing the list hands all of its entries
+ * to us at once, and keeps new jumps from being chained behind our back,
+ * so they can be reset without holding the lock.
+ */
 static inline void tb_jmp_unlink(TranslationBlock *dest)
 {
-    TranslationBlock *tb;
-    int n;
+    uintptr_t entry;
 
     qemu_spin_lock(&dest->jmp_lock);
+    entry = tb_jmp_list_close(&dest->jmp_list_head);
+    qemu_spin_unlock(&dest->jmp_lock);
 
-    TB_FOR_EACH_JMP(dest, tb, n) {
+    while (entry) {
+        TranslationBlock *tb = (TranslationBlock *)(entry & ~1);
+        int n = entry & 1;
+
+        /* read the link before the jump can be chained elsewhere */
+        entry = atomic_read(&tb->jmp_list_next[n]);
         tb_reset_jump(tb, n);
         atomic_and(&tb->jmp_dest[n], (uintptr_t)NULL | 1);
-        /* No need to clear the list entry; setting the dest ptr is enough */
     }
-    dest->jmp_list_head = (uintptr_t)NULL;
-
-    qemu_spin_unlock(&dest->jmp_lock);
 }
 
 /*
@@ -1437,10 +1643,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     assert_memory_lock();
 
-    /* make sure no further incoming jumps will be chained to this TB */
-    qemu_spin_lock(&tb->jmp_lock);
-    atomic_set(&tb->cflags, tb->cflags | CF_INVALID);
-    qemu_spin_unlock(&tb->jmp_lock);
+    /* tb_add_jump gives up on this TB from now on; see also tb_jmp_unlink */
+    atomic_or(&tb->cflags, CF_INVALID);
 
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
@@ -1454,12 +1658,10 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* remove the TB from the page list */
     if (rm_from_page_list) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
-        tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
+        tb_page_remove(p, tb, 0);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
-            tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
+            tb_page_remove(p, tb, 1);
         }
     }
 
@@ -1478,6 +1680,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
 
+    tb_branch_cache_release(tb);
+
     atomic_set(&tcg_ctx->tb_phys_invalidate_count,
                tcg_ctx->tb_phys_invalidate_count + 1);
 }
@@ -1502,33 +1706,12 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
 }
 
-#ifdef CONFIG_SOFTMMU
-/* call with @p->lock held */
-static void build_page_bitmap(PageDesc *p)
-{
-    int n, tb_start, tb_end;
-    TranslationBlock *tb;
-
-    assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
-
-    PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
-    }
-}
+#ifdef CONFIG_USER_ONLY
+/*
+ * Number of times that the host protection of a guest page was changed to
+ * track self-modifying code.  Protected by mmap_lock.
+ */
+static unsigned int page_protect_changes;
 #endif
 
 /* add the tb in the target page and protect it if necessary
@@ -1539,19 +1722,27 @@ static void build_page_bitmap(PageDesc *p)
 static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
                                unsigned int n, tb_page_addr_t page_addr)
 {
+    IntervalTreeNode *range = &tb->page_range[n];
 #ifndef CONFIG_USER_ONLY
     bool page_already_protected;
 #endif
 
     assert_page_locked(p);
 
+    /* NOTE: this is subtle as a TB may span two physical pages */
     tb->page_addr[n] = page_addr;
-    tb->page_next[n] = p->first_tb;
+    if (n == 0) {
+        range->start = page_addr + (tb->pc & ~TARGET_PAGE_MASK);
+        range->last = MIN(range->start + tb->size,
+                          page_addr + TARGET_PAGE_SIZE) - 1;
+    } else {
+        range->start = page_addr;
+        range->last = page_addr + ((tb->pc + tb->size - 1) & ~TARGET_PAGE_MASK);
+    }
 #ifndef CONFIG_USER_ONLY
-    page_already_protected = p->first_tb != (uintptr_t)NULL;
+    page_already_protected = page_has_code(p);
 #endif
-    p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+    interval_tree_insert(range, &p->code_ranges[n]);
 
 #if defined(CONFIG_USER_ONLY)
     if (p->flags & PAGE_WRITE) {
@@ -1575,6 +1766,7 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
           }
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
+        page_protect_changes++;
         if (DEBUG_TB_INVALIDATE_GATE) {
             printf("protecting code page: 0x" TB_PAGE_ADDR_FMT "\n", page_addr);
         }
@@ -1646,11 +1838,9 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
 
         /* remove TB from the page(s) if we couldn't insert it */
         if (unlikely(existing_tb)) {
-            tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
+            tb_page_remove(p, tb, 0);
             if (p2) {
-                tb_page_remove(p2, tb);
-                invalidate_page_bitmap(p2);
+                tb_page_remove(p2, tb, 1);
             }
             tb = existing_tb;
         }
@@ -1669,7 +1859,284 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+#ifndef CONFIG_USER_ONLY
+/*
+ * Persistent TB cache
+ *
+ * Generated code is not position independent, and reusing host code read
+ * from a file would require trusting that file as much as the QEMU binary.
+ * So what is saved on exit is only the list of TBs that were translated:
+ * the guest physical address of each, with its cs_base, flags, cflags and
+ * a CRC of the guest code it was translated from.
+ *
+ * A later run translates the recorded TBs ahead of time.  When a vCPU has
+ * translated a TB, the recorded TBs that start in the same guest page are
+ * translated as well, at the same offset in the virtual page of the new
+ * TB, provided that the guest code is unchanged.  Only TBs that fit in a
+ * single page are recorded, so that this never touches another page and
+ * cannot fault.  The code is generated afresh for this process, so it is
+ * as correct as if the vCPU had translated it on demand.
+ */
+#define TB_CACHE_MAGIC "QEMUTBC"
+#define TB_CACHE_VERSION 2
+#define TB_CACHE_DEFAULT_SIZE (8 * MiB)
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t id_crc;        /* QEMU binary, target and configuration */
+    uint32_t nb_records;
+    uint32_t pad;
+} TBCacheHeader;
+
+typedef struct TBCacheRecord {
+    uint64_t phys_pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;        /* only the CF_HASH_MASK bits */
+    uint32_t size;          /* of the guest code */
+    uint32_t guest_crc;
+} TBCacheRecord;
+
+typedef struct TBCacheItem {
+    TBCacheRecord rec;
+    /* set once the TB has been considered for translation */
+    bool done;
+} TBCacheItem;
+
+static struct {
+    char *path;
+    size_t max_size;
+    uint32_t id_crc;
+    /* recorded TBs, sorted by phys_pc */
+    TBCacheItem *items;
+    size_t nb_items;
+} tb_cache;
+
+/* CRC of the @size bytes of guest code at @phys_pc, all in one page */
+static uint32_t tb_cache_guest_crc(tb_page_addr_t phys_pc, uint32_t size)
+{
+    uint32_t crc;
+
+    rcu_read_lock();
+    crc = crc32c(0xffffffff, qemu_map_ram_ptr(NULL, phys_pc), size);
+    rcu_read_unlock();
+    return crc;
+}
+
+static bool tb_cache_is_persistent(const TranslationBlock *tb)
+{
+    return !(tb->cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE |
+                           CF_INVALID | CF_TRACE)) &&
+           tb->page_addr[0] != -1 && tb->page_addr[1] == -1;
+}
+
+static int tb_cache_item_cmp(const void *ap, const void *bp)
+{
+    const TBCacheItem *a = ap;
+    const TBCacheItem *b = bp;
+
+    if (a->rec.phys_pc != b->rec.phys_pc) {
+        return a->rec.phys_pc < b->rec.phys_pc ? -1 : 1;
+    }
+    return 0;
+}
+
+static void tb_cache_load(void)
+{
+    TBCacheHeader h;
+    size_t i;
+    FILE *f;
+
+    f = fopen(tb_cache.path, "rb");
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            warn_report("Could not open TB cache %s: %s", tb_cache.path,
+                        strerror(errno));
+        }
+        return;
+    }
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, TB_CACHE_MAGIC, sizeof(h.magic)) ||
+        h.version != TB_CACHE_VERSION) {
+        warn_report("%s is not a TB cache file, ignoring it", tb_cache.path);
+        goto out;
+    }
+    if (h.id_crc != tb_cache.id_crc) {
+        /* Not for this binary or this configuration; it will be replaced */
+        goto out;
+    }
+    if (h.nb_records > tb_cache.max_size / sizeof(TBCacheRecord)) {
+        goto out;
+    }
+
+    tb_cache.items = g_new0(TBCacheItem, h.nb_records);
+    for (i = 0; i < h.nb_records; i++) {
+        TBCacheRecord *r = &tb_cache.items[i].rec;
+
+        if (fread(r, sizeof(*r), 1, f) != 1 ||
+            r->size == 0 ||
+            r->size > TARGET_PAGE_SIZE - (r->phys_pc & ~TARGET_PAGE_MASK)) {
+            warn_report("TB cache %s is truncated or corrupt, ignoring it",
+                        tb_cache.path);
+            g_free(tb_cache.items);
+            tb_cache.items = NULL;
+            goto out;
+        }
+    }
+    tb_cache.nb_items = h.nb_records;
+    qsort(tb_cache.items, tb_cache.nb_items, sizeof(TBCacheItem),
+          tb_cache_item_cmp);
+ out:
+    fclose(f);
+}
+
+void tb_cache_enable(const char *path, size_t max_size, const char *config)
+{
+    GString *id = g_string_new(NULL);
+
+    tb_cache.path = g_strdup(path);
+    tb_cache.max_size = max_size ? max_size : TB_CACHE_DEFAULT_SIZE;
+
+    g_string_append_printf(id, "%s%s %s %s", QEMU_VERSION, QEMU_PKGVERSION,
+                           TARGET_NAME, config);
+    tb_cache.id_crc = crc32c(0xffffffff, (uint8_t *)id->str, id->len);
+    g_string_free(id, true);
+
+    tb_cache_load();
+}
+
+/* Make all the recorded TBs available for translation again, on tb_flush */
+static void tb_cache_reset(void)
+{
+    size_t i;
+
+    for (i = 0; i < tb_cache.nb_items; i++) {
+        tb_cache.items[i].done = false;
+    }
+}
+
+/*
+ * Translate the recorded TBs that start in the same guest page as @tb,
+ * which @cpu has just translated, so that the TLB entry for that page
+ * is valid.
+ */
+static void tb_cache_prefetch(CPUState *cpu, TranslationBlock *tb)
+{
+    tb_page_addr_t page = tb->page_addr[0];
+    uint32_t cflags = tb->cflags & CF_HASH_MASK;
+    size_t lo = 0, hi = tb_cache.nb_items;
+
+    if (!tb_cache.nb_items ||
+        tb->cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE |
+                      CF_SPECULATIVE | CF_TRACE)) {
+        return;
+    }
+
+    /* find the first record in the page */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (tb_cache.items[mid].rec.phys_pc < page) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < tb_cache.nb_items; lo++) {
+        TBCacheItem *item = &tb_cache.items[lo];
+        const TBCacheRecord *r = &item->rec;
+        target_ulong pc;
+
+        if (r->phys_pc >= page + TARGET_PAGE_SIZE) {
+            break;
+        }
+        if (r->cflags != cflags || atomic_xchg(&item->done, true)) {
+            continue;
+        }
+        pc = (tb->pc & TARGET_PAGE_MASK) | (r->phys_pc & ~TARGET_PAGE_MASK);
+        if (tb_cache_guest_crc(r->phys_pc, r->size) != r->guest_crc ||
+            tb_htable_lookup(cpu, pc, r->cs_base, r->flags, cflags)) {
+            continue;
+        }
+        if (!tb_gen_code(cpu, pc, r->cs_base, r->flags,
+                         cflags | CF_SPECULATIVE)) {
+            /* code_gen_buffer is full */
+            break;
+        }
+    }
+}
+
+static gboolean tb_cache_collect(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    GArray *records = data;
+    TBCacheRecord r;
+
+    if (tb_cache_is_persistent(tb)) {
+        memset(&r, 0, sizeof(r));
+        r.phys_pc = tb->page_addr[0] | (tb->pc & ~TARGET_PAGE_MASK);
+        r.cs_base = tb->cs_base;
+        r.flags = tb->flags;
+        r.cflags = tb->cflags & CF_HASH_MASK;
+        r.size = tb->size;
+        r.guest_crc = tb_cache_guest_crc(r.phys_pc, r.size);
+        g_array_append_val(records, r);
+    }
+    return false;
+}
+
+/* Called at exit, with the vCPUs stopped */
+void tb_cache_save(void)
+{
+    GArray *records;
+    TBCacheHeader h;
+    char *tmp;
+    FILE *f;
+    bool ok;
+
+    if (tb_cache.path == NULL) {
+        return;
+    }
+
+    records = g_array_new(false, false, sizeof(TBCacheRecord));
+    tcg_tb_foreach(tb_cache_collect, records);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TB_CACHE_MAGIC, sizeof(h.magic));
+    h.version = TB_CACHE_VERSION;
+    h.id_crc = tb_cache.id_crc;
+    h.nb_records = MIN(records->len, tb_cache.max_size / sizeof(TBCacheRecord));
+
+    /* Write to a temporary file, so that concurrent runs see a whole file */
+    tmp = g_strdup_printf("%s.%d", tb_cache.path, getpid());
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        warn_report("Could not create TB cache %s: %s", tmp, strerror(errno));
+        goto out;
+    }
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+         fwrite(records->data, sizeof(TBCacheRecord), h.nb_records, f) ==
+         h.nb_records;
+    if (fclose(f) || !ok) {
+        warn_report("Could not write TB cache %s", tmp);
+        unlink(tmp);
+    } else if (rename(tmp, tb_cache.path)) {
+        warn_report("Could not rename TB cache to %s: %s", tb_cache.path,
+                    strerror(errno));
+        unlink(tmp);
+    }
+ out:
+    g_free(tmp);
+    g_array_free(records, true);
+}
+#endif /* !CONFIG_USER_ONLY */
+
+/*
+ * Called with mmap_lock held for user mode emulation.
+ * Returns NULL only for CF_SPECULATIVE, if code_gen_buffer is full.
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
@@ -1680,6 +2147,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size;
+    int64_t tb_stats_start = 0;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1697,8 +2165,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        if (cflags & CF_SPECULATIVE) {
+            /* Not worth a flush; the vCPUs will ask for one soon enough */
+            return NULL;
+        }
+        /* make room for the new code */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1712,7 +2184,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
+    tb->tb_stats = NULL;
+    if (atomic_read(&tb_stats_enabled) && !(cflags & CF_NOCACHE)) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags);
+        tb_stats_start = get_clock();
+    }
+#ifdef CONFIG_USER_ONLY
+    tb->branch_caches = NULL;
+#endif
+    tb_branch_cache_discard();
     tcg_ctx->tb_cflags = cflags;
+    tcg_ctx->nb_tb_successors = 0;
 
 #ifdef CONFIG_PROFILER
     /* includes aborted translations because of exceptions */
@@ -1761,6 +2244,19 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->tb_stats) {
+        TBStatistics *stats = tb->tb_stats;
+
+        qemu_spin_lock(&stats->lock);
+        stats->translations++;
+        stats->translate_time_ns += get_clock() - tb_stats_start;
+        stats->guest_insns = tb->icount;
+        stats->tcg_ops = tcg_ctx->nb_ops;
+        stats->host_code_size = gen_code_size;
+        stats->spills = tcg_ctx->nb_spills;
+        qemu_spin_unlock(&stats->lock);
+    }
+
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     atomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1836,13 +2332,106 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
 
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+        tb_branch_cache_discard();
         atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         return existing_tb;
     }
+    tb_branch_cache_attach(tb);
     tcg_tb_insert(tb);
+    perf_report_code(pc, tb->tc.ptr, tb->tc.size);
+#ifdef CONFIG_USER_ONLY
+    tb_worker_queue_successors(cpu, tb);
+#else
+    tb_cache_prefetch(cpu, tb);
+#endif
     return tb;
 }
 
+/*
+ * Whether @next can follow @tb in a superblock starting with @head: it
+ * must be hot, start after @tb in the same page as @head, and be entered
+ * in the same CPU state.  The translator relies on the latter, since it
+ * carries its state over from one block to the next.
+ */
+static bool tb_superblock_follows(TranslationBlock *head, TranslationBlock *tb,
+                                  TranslationBlock *next)
+{
+    return !(tb_cflags(next) & (CF_INVALID | CF_TRACE)) &&
+        atomic_read(&next->exec_count) >= tb_superblock_threshold / 2 &&
+        next->pc >= tb->pc + tb->size &&
+        (next->pc & TARGET_PAGE_MASK) == (head->pc & TARGET_PAGE_MASK) &&
+        next->cs_base == head->cs_base && next->flags == head->flags &&
+        (tb_cflags(next) & CF_HASH_MASK) == (tb_cflags(head) & CF_HASH_MASK);
+}
+
+/* Return the hottest successor @tb is chained to that can follow it */
+static TranslationBlock *tb_superblock_next(TranslationBlock *head,
+                                            TranslationBlock *tb)
+{
+    TranslationBlock *best = NULL;
+    int n;
+
+    for (n = 0; n < 2; n++) {
+        uintptr_t dest = atomic_read(&tb->jmp_dest[n]);
+        TranslationBlock *next = (TranslationBlock *)(dest & ~1);
+
+        if (next == NULL || (dest & 1) ||
+            !tb_superblock_follows(head, tb, next)) {
+            continue;
+        }
+        if (best == NULL ||
+            atomic_read(&next->exec_count) > atomic_read(&best->exec_count)) {
+            best = next;
+        }
+    }
+    return best;
+}
+
+/*
+ * Retranslate @tb, which has just become hot, as a superblock (CF_TRACE)
+ * that also contains the hot path through the TBs it is chained to, so
+ * that the optimizer and register allocator see the whole path and
+ * there is no TB transition along it.  Exits off the path become side
+ * exits of the superblock.  The blocks of the path stay in the cache for
+ * those side exits to reach them.
+ *
+ * Only forward branches within the page of @tb are followed; anything
+ * else, in particular the back edge of a loop, ends the superblock.
+ *
+ * Returns the TB to execute.  Called from the execution loop, in which
+ * TBs cannot be freed under our feet.
+ */
+TranslationBlock *tb_gen_superblock(CPUState *cpu, TranslationBlock *tb)
+{
+    target_ulong path[TCG_MAX_SB_PATH];
+    TranslationBlock *cur, *sb;
+    int n = 0;
+
+    if (cpu->singlestep_enabled || singlestep) {
+        return tb;
+    }
+    path[n++] = tb->pc;
+    for (cur = tb_superblock_next(tb, tb); cur && n < TCG_MAX_SB_PATH;
+         cur = tb_superblock_next(tb, cur)) {
+        path[n++] = cur->pc;
+    }
+    if (n == 1) {
+        return tb;
+    }
+
+    mmap_lock();
+    /* Remove @tb from the hash table so that @sb can take its place */
+    tb_phys_invalidate(tb, -1);
+    memcpy(tcg_ctx->sb_path, path, n * sizeof(path[0]));
+    tcg_ctx->sb_path_len = n;
+    sb = tb_gen_code(cpu, tb->pc, tb->cs_base, tb->flags,
+                     (tb_cflags(tb) & CF_HASH_MASK) | CF_TRACE);
+    mmap_unlock();
+
+    atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(sb->pc)], sb);
+    return sb;
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1854,8 +2443,8 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
                                       tb_page_addr_t end,
                                       int is_cpu_write_access)
 {
+    IntervalTreeNode *node;
     TranslationBlock *tb;
-    tb_page_addr_t tb_start, tb_end;
     int n;
 #ifdef TARGET_HAS_PRECISE_SMC
     CPUState *cpu = current_cpu;
@@ -1877,52 +2466,36 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 #endif
 
     /* we remove all the TBs in the range [start, end[ */
-    /* XXX: see if in some cases it could be faster to invalidate all
-       the code */
-    PAGE_FOR_EACH_TB(p, tb, n) {
-        assert_page_locked(p);
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-            tb_end = tb_start + tb->size;
-        } else {
-            tb_start = tb->page_addr[1];
-            tb_end = tb_start + ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        if (!(tb_end <= start || tb_start >= end)) {
+    PAGE_FOR_EACH_TB_RANGE(p, start, (uint64_t)end - 1, node, tb, n) {
 #ifdef TARGET_HAS_PRECISE_SMC
-            if (current_tb_not_found) {
-                current_tb_not_found = 0;
-                current_tb = NULL;
-                if (cpu->mem_io_pc) {
-                    /* now we have a real cpu fault */
-                    current_tb = tcg_tb_lookup(cpu->mem_io_pc);
-                }
-            }
-            if (current_tb == tb &&
-                (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
-                /* If we are modifying the current TB, we must stop
-                its execution. We could be more precise by checking
-                that the modification is after the current PC, but it
-                would require a specialized function to partially
-                restore the CPU state */
-
-                current_tb_modified = 1;
-                cpu_restore_state_from_tb(cpu, current_tb,
-                                          cpu->mem_io_pc, true);
-                cpu_get_tb_cpu_state(env, &current_pc, &current_cs_base,
-                                     &current_flags);
+        if (current_tb_not_found) {
+            current_tb_not_found = 0;
+            current_tb = NULL;
+            if (cpu->mem_io_pc) {
+                /* now we have a real cpu fault */
+                current_tb = tcg_tb_lookup(cpu->mem_io_pc);
             }
-#endif /* TARGET_HAS_PRECISE_SMC */
-            tb_phys_invalidate__locked(tb);
         }
+        if (current_tb == tb &&
+            (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
+            /* If we are modifying the current TB, we must stop
+            its execution. We could be more precise by checking
+            that the modification is after the current PC, but it
+            would require a specialized function to partially
+            restore the CPU state */
+
+            current_tb_modified = 1;
+            cpu_restore_state_from_tb(cpu, current_tb,
+                                      cpu->mem_io_pc, true);
+            cpu_get_tb_cpu_state(env, &current_pc, &current_cs_base,
+                                 &current_flags);
+        }
+#endif /* TARGET_HAS_PRECISE_SMC */
+        tb_phys_invalidate__locked(tb);
     }
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
-    if (!p->first_tb) {
-        invalidate_page_bitmap(p);
+    if (!page_has_code(p)) {
         tlb_unprotect_code(start);
     }
 #endif
@@ -2028,21 +2601,12 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
     }
 
     assert_page_locked(p);
-    if (!p->code_bitmap &&
-        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
-        build_page_bitmap(p);
-    }
-    if (p->code_bitmap) {
-        unsigned int nr;
-        unsigned long b;
-
-        nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
-        if (b & ((1 << len) - 1)) {
-            goto do_invalidate;
-        }
-    } else {
-    do_invalidate:
+    atomic_set(&tcg_ctx->smc_write_count, tcg_ctx->smc_write_count + 1);
+    /* most writes to a page with code, e.g. to data next to it, miss */
+    if (interval_tree_iter_first(&p->code_ranges[0], start, start + len - 1) ||
+        interval_tree_iter_first(&p->code_ranges[1], start, start + len - 1)) {
+        atomic_set(&tcg_ctx->smc_write_hit_count,
+                   tcg_ctx->smc_write_hit_count + 1);
         tb_invalidate_phys_page_range__locked(pages, p, start, start + len, 1);
     }
 }
@@ -2055,6 +2619,7 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
  */
 static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
 {
+    IntervalTreeNode *node;
     TranslationBlock *tb;
     PageDesc *p;
     int n;
@@ -2076,8 +2641,13 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
         return false;
     }
 
+    atomic_set(&tcg_ctx->smc_write_count, tcg_ctx->smc_write_count + 1);
+    if (page_has_code(p)) {
+        atomic_set(&tcg_ctx->smc_write_hit_count,
+                   tcg_ctx->smc_write_hit_count + 1);
+    }
 #ifdef TARGET_HAS_PRECISE_SMC
-    if (p->first_tb && pc != 0) {
+    if (page_has_code(p) && pc != 0) {
         current_tb = tcg_tb_lookup(pc);
     }
     if (cpu != NULL) {
@@ -2085,7 +2655,7 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
     }
 #endif
     assert_page_locked(p);
-    PAGE_FOR_EACH_TB(p, tb, n) {
+    PAGE_FOR_EACH_TB(p, node, tb, n) {
 #ifdef TARGET_HAS_PRECISE_SMC
         if (current_tb == tb &&
             (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
@@ -2101,9 +2671,8 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
                                  &current_flags);
         }
 #endif /* TARGET_HAS_PRECISE_SMC */
-        tb_phys_invalidate(tb, addr);
+        tb_phys_invalidate__locked(tb);
     }
-    p->first_tb = (uintptr_t)NULL;
 #ifdef TARGET_HAS_PRECISE_SMC
     if (current_tb_modified) {
         /* Force execution of one insn next time.  */
@@ -2200,6 +2769,14 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
         tcg_tb_remove(tb);
     }
 
+    if (qemu_tcg_mttcg_enabled() && (tb_cflags(tb) & CF_PARALLEL)) {
+        /*
+         * With multi-threaded icount, the I/O insn runs after all vCPUs
+         * have reached the end of the quantum; return to the vCPU thread.
+         */
+        atomic_set(&cpu->exit_request, 1);
+    }
+
     /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
      * the first in the TB) then we end up generating a whole new TB and
      *  repeating the fault, which is horribly inefficient.
@@ -2299,9 +2876,16 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
+    static struct {
+        int64_t ns;
+        size_t invalidate_count;
+        size_t smc_writes;
+        size_t smc_hits;
+    } last;
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs;
+    size_t nb_tbs, invalidate_count, smc_writes, smc_hits;
+    int64_t now;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2336,7 +2920,29 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
-    cpu_fprintf(f, "TB invalidate count %zu\n", tcg_tb_phys_invalidate_count());
+    cpu_fprintf(f, "TB evict count      %u (%zu of %zu regions recycled)\n",
+                atomic_read(&tb_ctx.tb_evict_count),
+                tcg_region_evict_count(), tcg_nb_regions());
+    invalidate_count = tcg_tb_phys_invalidate_count();
+    cpu_fprintf(f, "TB invalidate count %zu\n", invalidate_count);
+    tcg_smc_write_counts(&smc_writes, &smc_hits);
+    cpu_fprintf(f, "SMC write count     %zu (%zu hit code)\n",
+                smc_writes, smc_hits);
+    /* the rates are computed over the interval since the previous call */
+    now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    if (last.ns && now > last.ns) {
+        double secs = (now - last.ns) / (double)NANOSECONDS_PER_SECOND;
+
+        cpu_fprintf(f, "TB invalidate rate  %0.1f/s\n",
+                    (invalidate_count - last.invalidate_count) / secs);
+        cpu_fprintf(f, "SMC write rate      %0.1f/s (%0.1f/s hit code)\n",
+                    (smc_writes - last.smc_writes) / secs,
+                    (smc_hits - last.smc_hits) / secs);
+    }
+    last.ns = now;
+    last.invalidate_count = invalidate_count;
+    last.smc_writes = smc_writes;
+    last.smc_hits = smc_hits;
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
     tcg_dump_info(f, cpu_fprintf);
 }
@@ -2467,6 +3073,12 @@ void page_dump(FILE *f)
     walk_memory_regions(f, dump_region);
 }
 
+unsigned int page_protect_count(void)
+{
+    assert_memory_lock();
+    return page_protect_changes;
+}
+
 int page_get_flags(target_ulong address)
 {
     PageDesc *p;
@@ -2510,7 +3122,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
            the code inside.  */
         if (!(p->flags & PAGE_WRITE) &&
             (flags & PAGE_WRITE) &&
-            p->first_tb) {
+            page_has_code(p)) {
             tb_invalidate_phys_page(addr, 0);
         }
         p->flags = flags;
@@ -2632,6 +3244,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             }
             mprotect((void *)g2h(host_start), qemu_host_page_size,
                      prot & PAGE_BITS);
+            page_protect_changes++;
         }
         mmap_unlock();
         /* If current TB was invalidated return to main loop */
@@ -14,6 +14,7 @@
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
 #include "exec/exec-all.h"
+#include "exec/tb-hash.h"
 #include "exec/gen-icount.h"
 #include "exec/log.h"
 #include "exec/translator.h"
@@ -31,6 +32,56 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/*
+ * Superblocks
+ *
+ * A superblock is a TB formed by tb_gen_superblock() out of a hot TB and
+ * the hot successors it is chained to, whose start addresses are passed
+ * in tcg_ctx->sb_path.  The translator goes through the blocks in order:
+ * when an instruction exits to the next block on the path, the target
+ * calls translator_superblock_continue() instead of emitting a goto_tb,
+ * and translation goes on at the destination.  Any other exit becomes a
+ * side exit of the superblock.
+ *
+ * The blocks must be at increasing addresses within one page, so that
+ * [pc_first, pc_next) still covers all the code of the TB for the
+ * purpose of invalidation.
+ */
+bool translator_superblock_continue(DisasContextBase *db, target_ulong dest)
+{
+    TCGContext *s = tcg_ctx;
+
+    if (!(tb_cflags(db->tb) & CF_TRACE) || db->sb_label ||
+        db->sb_index + 1 >= s->sb_path_len ||
+        s->sb_path[db->sb_index + 1] != dest || dest <= db->pc_next) {
+        return false;
+    }
+    db->sb_label = gen_new_label();
+    db->sb_dest = dest;
+    tcg_gen_br(db->sb_label);
+    db->sb_br = tcg_last_op();
+    return true;
+}
+
+/* Move on to the next block after an instruction branched to it */
+static void translator_superblock_next(DisasContextBase *db)
+{
+    if (tcg_last_op() == db->sb_br) {
+        /* Nothing else was emitted, so we can just fall through */
+        tcg_op_remove(tcg_ctx, db->sb_br);
+    } else {
+        gen_set_label(db->sb_label);
+    }
+    db->sb_label = NULL;
+    db->sb_index++;
+    db->pc_next = db->sb_dest;
+    /*
+     * If the target wants to end the TB anyway, DISAS_TOO_MANY makes
+     * tb_stop emit a jump to pc_next, which is now the next block.
+     */
+    db->is_jmp = db->is_jmp == DISAS_NORETURN ? DISAS_NEXT : DISAS_TOO_MANY;
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb)
 {
@@ -41,6 +92,8 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
     db->singlestep_enabled = cpu->singlestep_enabled;
+    db->sb_index = 0;
+    db->sb_label = NULL;
 
     /* Instruction counting */
     db->max_insns = tb_cflags(db->tb) & CF_COUNT_MASK;
@@ -103,6 +156,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             ops->translate_insn(db, cpu);
         }
 
+        if (unlikely(db->sb_label)) {
+            translator_superblock_next(db);
+        }
+
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
             break;
@@ -116,6 +173,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
         }
     }
 
+    /* No more continuations; tb_stop may use goto_tb.  */
+    db->sb_index = tcg_ctx->sb_path_len;
+
     /* Emit code to exit the TB, as indicated by db->is_jmp.  */
     ops->tb_stop(db, cpu);
     gen_tb_end(db->tb, db->num_insns);
@@ -135,3 +195,244 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     }
 #endif
 }
+
+void translator_add_successor(DisasContextBase *db, target_ulong pc)
+{
+    TCGContext *s = tcg_ctx;
+    int i;
+
+    if (pc == db->pc_first) {
+        return;
+    }
+    for (i = 0; i < s->nb_tb_successors; i++) {
+        if (s->tb_successors[i] == pc) {
+            return;
+        }
+    }
+    if (i < TCG_MAX_TB_SUCCESSORS) {
+        s->tb_successors[s->nb_tb_successors++] = pc;
+    }
+}
+
+/*
+ * Indirect branches
+ *
+ * helper_lookup_tb_ptr has to recompute the CPU state and hash it into
+ * tb_jmp_cache on every indirect branch.  When the target can tell us
+ * the pc and TB flags that the destination will be looked up with, we
+ * can instead compare them inline against a candidate TB and only call
+ * the helper if it does not match.
+ *
+ * In user-mode emulation the candidate comes from a cache private to the
+ * branch site, or for returns from a per-vCPU return-address stack that
+ * is pushed by calls.  In system emulation, a TB is only valid for the
+ * virtual->physical mapping of the vCPU that looked it up, so a cache
+ * shared by all vCPUs would have to be revalidated against the vCPU's
+ * tb_jmp_cache anyway; there we probe tb_jmp_cache inline instead.
+ */
+
+/* Never matches, since CF_INVALID is never part of curr_cflags() */
+static TranslationBlock invalid_tb = {
+    .cflags = CF_INVALID,
+};
+
+static bool use_inline_lookup(DisasContextBase *db)
+{
+    return TCG_TARGET_HAS_goto_ptr &&
+           !qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN | CPU_LOG_EXEC) &&
+           !(tb_cflags(db->tb) & CF_NOCACHE);
+}
+
+/*
+ * Jump to @tb if it is the TB for @pc, @flags and @cs_base; otherwise
+ * fall through to @miss.  @tb may be NULL.
+ */
+static void gen_goto_tb_if_match(TCGv_ptr tb, TCGv pc, TCGv_i32 flags,
+                                 target_ulong cs_base, TCGLabel *miss)
+{
+    TCGv_ptr t = tcg_temp_local_new_ptr();
+    TCGv_ptr null = tcg_const_ptr(NULL);
+    TCGv_ptr invalid = tcg_const_ptr(&invalid_tb);
+    TCGv x = tcg_temp_new();
+    TCGv y = tcg_temp_new();
+    TCGv_i32 f = tcg_temp_new_i32();
+    TCGv_i32 c = tcg_temp_new_i32();
+
+    tcg_gen_movcond_ptr(TCG_COND_EQ, t, tb, null, invalid, tb);
+    tcg_temp_free_ptr(null);
+    tcg_temp_free_ptr(invalid);
+
+    /*
+     * Do all the comparisons with a single branch, since @pc and @flags
+     * do not survive it.  Like tb_lookup__cpu_state, but without the
+     * trace_vcpu_dstate check: like direct jumps, cached destinations
+     * may keep running code generated for the previous dstate.
+     */
+    tcg_gen_ld_tl(x, t, offsetof(TranslationBlock, pc));
+    tcg_gen_xor_tl(x, x, pc);
+    tcg_gen_ld_tl(y, t, offsetof(TranslationBlock, cs_base));
+    tcg_gen_xori_tl(y, y, cs_base);
+    tcg_gen_or_tl(x, x, y);
+    tcg_gen_ld_i32(f, t, offsetof(TranslationBlock, flags));
+    tcg_gen_xor_i32(f, f, flags);
+    tcg_gen_ld_i32(c, t, offsetof(TranslationBlock, cflags));
+    tcg_gen_andi_i32(c, c, CF_HASH_MASK | CF_INVALID);
+    tcg_gen_xori_i32(c, c, curr_cflags());
+    tcg_gen_or_i32(f, f, c);
+    tcg_gen_extu_i32_tl(y, f);
+    tcg_gen_or_tl(x, x, y);
+    tcg_gen_brcondi_tl(TCG_COND_NE, x, 0, miss);
+    tcg_temp_free(x);
+    tcg_temp_free(y);
+    tcg_temp_free_i32(f);
+    tcg_temp_free_i32(c);
+
+    tcg_gen_ld_ptr(t, t, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(t));
+    tcg_temp_free_ptr(t);
+}
+
+#ifdef CONFIG_USER_ONLY
+/* Popped from an empty return-address stack slot */
+static TBBranchCache empty_branch_cache;
+
+/* Load into @p the address of entry @top of the return-address stack */
+static void gen_ras_entry(TCGv_ptr p, TCGv_i32 top)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_shli_i32(t, top, ctz32(sizeof(void *)));
+    tcg_gen_ext_i32_ptr(p, t);
+    tcg_gen_add_ptr(p, p, cpu_env);
+    tcg_temp_free_i32(t);
+}
+
+static void gen_ras_pop(TCGv_ptr bc)
+{
+    TCGv_i32 top = tcg_temp_new_i32();
+    TCGv_ptr p = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(top, cpu_env, -ENV_OFFSET + offsetof(CPUState, tb_ras_top));
+    gen_ras_entry(p, top);
+    tcg_gen_ld_ptr(bc, p, -ENV_OFFSET + offsetof(CPUState, tb_ras));
+    tcg_gen_subi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, -ENV_OFFSET + offsetof(CPUState, tb_ras_top));
+    tcg_temp_free_ptr(p);
+    tcg_temp_free_i32(top);
+}
+
+void translator_push_return(DisasContextBase *db, target_ulong ret_pc)
+{
+    TBBranchCache *bc;
+    TCGv_i32 top;
+    TCGv_ptr p, v;
+
+    if (!use_inline_lookup(db)) {
+        return;
+    }
+
+    bc = tb_branch_cache_new();
+    bc->ret_pc = ret_pc;
+    bc->is_call = true;
+
+    top = tcg_temp_new_i32();
+    p = tcg_temp_new_ptr();
+    v = tcg_const_ptr(bc);
+    tcg_gen_ld_i32(top, cpu_env, -ENV_OFFSET + offsetof(CPUState, tb_ras_top));
+    tcg_gen_addi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, -ENV_OFFSET + offsetof(CPUState, tb_ras_top));
+    gen_ras_entry(p, top);
+    tcg_gen_st_ptr(v, p, -ENV_OFFSET + offsetof(CPUState, tb_ras));
+    tcg_temp_free_ptr(v);
+    tcg_temp_free_ptr(p);
+    tcg_temp_free_i32(top);
+}
+
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv pc,
+                                    TCGv_i32 flags, target_ulong cs_base,
+                                    bool is_return)
+{
+    TCGLabel *miss;
+    TCGv_ptr bc, t, null, empty;
+
+    if (!use_inline_lookup(db)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    miss = gen_new_label();
+    t = tcg_temp_new_ptr();
+    if (is_return) {
+        bc = tcg_temp_local_new_ptr();
+        gen_ras_pop(bc);
+        null = tcg_const_ptr(NULL);
+        empty = tcg_const_ptr(&empty_branch_cache);
+        tcg_gen_movcond_ptr(TCG_COND_EQ, t, bc, null, empty, bc);
+        tcg_gen_ld_ptr(t, t, offsetof(TBBranchCache, tb));
+        tcg_temp_free_ptr(empty);
+        tcg_temp_free_ptr(null);
+    } else {
+        TBBranchCache *cache = tb_branch_cache_new();
+
+        bc = tcg_const_local_ptr(cache);
+        tcg_gen_ld_ptr(t, bc, offsetof(TBBranchCache, tb));
+    }
+    gen_goto_tb_if_match(t, pc, flags, cs_base, miss);
+    tcg_temp_free_ptr(t);
+
+    gen_set_label(miss);
+    t = tcg_temp_new_ptr();
+    gen_helper_lookup_tb_ptr_cached(t, cpu_env, bc);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(t));
+    tcg_temp_free_ptr(t);
+    tcg_temp_free_ptr(bc);
+}
+#else
+void translator_push_return(DisasContextBase *db, target_ulong ret_pc)
+{
+}
+
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv pc,
+                                    TCGv_i32 flags, target_ulong cs_base,
+                                    bool is_return)
+{
+    TCGLabel *miss;
+    TCGv h, tmp;
+    TCGv_i32 h32;
+    TCGv_ptr t;
+
+    if (!use_inline_lookup(db)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    /* t = cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)] */
+    h = tcg_temp_new();
+    tmp = tcg_temp_new();
+    tcg_gen_shri_tl(tmp, pc, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_xor_tl(tmp, tmp, pc);
+    tcg_gen_shri_tl(h, tmp, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_andi_tl(h, h, TB_JMP_PAGE_MASK);
+    tcg_gen_andi_tl(tmp, tmp, TB_JMP_ADDR_MASK);
+    tcg_gen_or_tl(h, h, tmp);
+    h32 = tcg_temp_new_i32();
+    tcg_gen_trunc_tl_i32(h32, h);
+    tcg_gen_shli_i32(h32, h32, ctz32(sizeof(void *)));
+    t = tcg_temp_new_ptr();
+    tcg_gen_ext_i32_ptr(t, h32);
+    tcg_gen_add_ptr(t, t, cpu_env);
+    tcg_gen_ld_ptr(t, t, -ENV_OFFSET + offsetof(CPUState, tb_jmp_cache));
+    tcg_temp_free_i32(h32);
+    tcg_temp_free(tmp);
+    tcg_temp_free(h);
+
+    miss = gen_new_label();
+    gen_goto_tb_if_match(t, pc, flags, cs_base, miss);
+    tcg_temp_free_ptr(t);
+
+    gen_set_label(miss);
+    tcg_gen_lookup_and_goto_ptr();
+}
+#endif
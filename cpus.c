@@ -153,6 +153,50 @@ typedef struct TimersState {
 static TimersState timers_state;
 bool mttcg_enabled;
 
+/*
+ * Multi-threaded TCG with icount
+ *
+ * vCPUs run in parallel for a quantum of at most tcg_quantum.size
+ * instructions, which like the round-robin thread's budget also ends at
+ * the next QEMU_CLOCK_VIRTUAL deadline.  Virtual time only moves forward
+ * at the end of a quantum, by the length of the quantum; until then, each
+ * vCPU sees the time at the start of the quantum plus the instructions it
+ * has executed itself.
+ *
+ * What cannot run in parallel deterministically waits for the end of the
+ * quantum: atomic operations, which are translated to leave the TB with
+ * EXCP_ATOMIC, and I/O, which leaves the TB to be retranslated with
+ * CF_LAST_IO.  The latter covers MMIO, as usual under icount, but also
+ * every instruction that calls gen_io_start(), such as port I/O and
+ * system register or MSR accesses.  A vCPU that hits either stops there.
+ * Once all vCPUs have stopped, those with a deferred instruction take
+ * turns in cpu_index order, each in its own thread, and run the rest of
+ * their quantum serially; then the timers run and the next quantum
+ * starts.  Device accesses, and the interrupts and IPIs they raise, thus
+ * happen while the other vCPUs wait, in an order that only depends on
+ * the guest.  Events coming from outside the guest, such as network
+ * packets or the monitor, are still timed by the host.
+ *
+ * Plain loads and stores to memory shared by vCPUs are not ordered, so
+ * guests that race on them can still diverge from one run to the next.
+ *
+ * All vCPUs share one halt_cond, on which they wait for the end of the
+ * quantum with the BQL.  Everything here is protected by the BQL.
+ */
+#define TCG_QUANTUM_DEFAULT 10000
+
+static struct {
+    /* Instructions per quantum, 0 unless icount and MTTCG are enabled */
+    int64_t size;
+    /* Length of the current quantum */
+    int64_t budget;
+    uint64_t epoch;
+    /* vCPUs done with the current quantum */
+    unsigned int arrived;
+    /* vCPU running the serial part of its quantum, if any */
+    CPUState *turn;
+} tcg_quantum;
+
 /*
  * We default to false if we know other options have been enabled
  * which are currently incompatible with MTTCG. Otherwise when each
@@ -202,8 +246,10 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
         if (strcmp(t, "multi") == 0) {
             if (TCG_OVERSIZED_GUEST) {
                 error_setg(errp, "No MTTCG when guest word size > hosts");
-            } else if (use_icount) {
-                error_setg(errp, "No MTTCG when icount is enabled");
+            } else if (use_icount == 2) {
+                error_setg(errp, "No MTTCG with icount shift=auto");
+            } else if (replay_mode != REPLAY_MODE_NONE) {
+                error_setg(errp, "No MTTCG with record/replay");
             } else {
 #ifndef TARGET_SUPPORTS_MTTCG
                 error_report("Guest not yet converted to MTTCG - "
@@ -215,6 +261,15 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
                     error_printf("This may cause strange/hard to debug errors\n");
                 }
                 mttcg_enabled = true;
+                if (use_icount) {
+                    tcg_quantum.size = qemu_opt_get_number(opts, "quantum",
+                                                           TCG_QUANTUM_DEFAULT);
+                    tcg_quantum.size = MAX(tcg_quantum.size, 1);
+                    tcg_quantum.budget = tcg_quantum.size;
+                    tcg_quantum.epoch = 1;
+                    serial_atomics = true;
+                    serial_io = true;
+                }
             }
         } else if (strcmp(t, "single") == 0) {
             mttcg_enabled = false;
@@ -224,6 +279,9 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    tb_superblock_threshold = qemu_opt_get_number(opts, "superblock-threshold",
+                                                  0);
 }
 
 /* The current number of executed instructions is based on what we
@@ -245,6 +303,12 @@ void cpu_update_icount(CPUState *cpu)
     int64_t executed = cpu_get_icount_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (tcg_quantum.size) {
+        /* shared time moves forward at the end of the quantum */
+        cpu->quantum_left -= executed;
+        return;
+    }
+
 #ifdef CONFIG_ATOMIC64
     atomic_set__nocheck(&timers_state.qemu_icount,
                         atomic_read__nocheck(&timers_state.qemu_icount) +
@@ -257,6 +321,7 @@ void cpu_update_icount(CPUState *cpu)
 int64_t cpu_get_icount_raw(void)
 {
     CPUState *cpu = current_cpu;
+    int64_t icount;
 
     if (cpu && cpu->running) {
         if (!cpu->can_do_io) {
@@ -267,10 +332,14 @@ int64_t cpu_get_icount_raw(void)
         cpu_update_icount(cpu);
     }
 #ifdef CONFIG_ATOMIC64
-    return atomic_read__nocheck(&timers_state.qemu_icount);
+    icount = atomic_read__nocheck(&timers_state.qemu_icount);
 #else /* FIXME: we need 64bit atomics to do this safely */
-    return timers_state.qemu_icount;
+    icount = timers_state.qemu_icount;
 #endif
+    if (tcg_quantum.size && cpu && cpu->quantum_epoch == tcg_quantum.epoch) {
+        icount += tcg_quantum.budget - cpu->quantum_left;
+    }
+    return icount;
 }
 
 /* Return the virtual CPU time, based on the instruction counter.  */
@@ -712,17 +781,21 @@ static const VMStateDescription vmstate_timers = {
 
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
-    double pct;
-    double throttle_ratio;
+    double pct, max_pct;
     long sleeptime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    if (!cpu_throttle_get_vcpu_percentage(cpu)) {
+        atomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
-    throttle_ratio = pct / (1 - pct);
-    sleeptime_ns = (long)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS);
+    /*
+     * The timer fires every CPU_THROTTLE_TIMESLICE_NS / (1 - max_pct);
+     * sleep for our own percentage of that.
+     */
+    pct = (double)cpu_throttle_get_vcpu_percentage(cpu) / 100;
+    max_pct = (double)cpu_throttle_get_percentage() / 100;
+    sleeptime_ns = (long)(pct * CPU_THROTTLE_TIMESLICE_NS / (1 - max_pct));
 
     qemu_mutex_unlock_iothread();
     g_usleep(sleeptime_ns / 1000); /* Convert ns to us for usleep call */
@@ -740,7 +813,8 @@ static void cpu_throttle_timer_tick(void *opaque)
         return;
     }
     CPU_FOREACH(cpu) {
-        if (!atomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
+        if (cpu_throttle_get_vcpu_percentage(cpu) &&
+            !atomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
                              RUN_ON_CPU_NULL);
         }
@@ -753,19 +827,52 @@ static void cpu_throttle_timer_tick(void *opaque)
 
 void cpu_throttle_set(int new_throttle_pct)
 {
+    CPUState *cpu;
+
     /* Ensure throttle percentage is within valid range */
     new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
     new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
 
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->throttle_percentage, new_throttle_pct);
+    }
     atomic_set(&throttle_percentage, new_throttle_pct);
 
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
                                        CPU_THROTTLE_TIMESLICE_NS);
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    bool was_active = cpu_throttle_active();
+    int max_pct = 0;
+    CPUState *other;
+
+    if (new_throttle_pct) {
+        new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+        new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
+    }
+    atomic_set(&cpu->throttle_percentage, new_throttle_pct);
+
+    CPU_FOREACH(other) {
+        max_pct = MAX(max_pct, cpu_throttle_get_vcpu_percentage(other));
+    }
+    atomic_set(&throttle_percentage, max_pct);
+
+    if (max_pct && !was_active) {
+        timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                                           CPU_THROTTLE_TIMESLICE_NS);
+    }
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     atomic_set(&throttle_percentage, 0);
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->throttle_percentage, 0);
+    }
 }
 
 bool cpu_throttle_active(void)
@@ -778,6 +885,11 @@ int cpu_throttle_get_percentage(void)
     return atomic_read(&throttle_percentage);
 }
 
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    return atomic_read(&cpu->throttle_percentage);
+}
+
 void cpu_ticks_init(void)
 {
     seqlock_init(&timers_state.vm_clock_seqlock);
@@ -855,18 +967,82 @@ void configure_icount(QemuOpts *opts, Error **errp)
  * timer event with force a cpu->exit so the next vCPU can get
  * scheduled.
  *
+ * The timer fires every quantum, and a vCPU runs for up to rr_weight
+ * quanta before the next vCPU gets scheduled.  vCPUs that run a whole
+ * slice get longer slices, up to TCG_KICK_PERIOD; vCPUs that are found
+ * polling, at the same PC with the same register contents as at the end
+ * of the previous quantum, yield right away and get the shortest slice.
+ * Only exits caused by the timer end a quantum, and only guest state is
+ * looked at, so that scheduling stays deterministic under icount and
+ * record/replay.
+ *
  * The timer is removed if all vCPUs are idle and restarted again once
  * idleness is complete.
  */
 
 static QEMUTimer *tcg_kick_vcpu_timer;
 static CPUState *tcg_current_rr_cpu;
+/* Set by the kick timer, cleared once the quantum is accounted to a vCPU */
+static bool tcg_rr_quantum_expired;
 
 #define TCG_KICK_PERIOD (NANOSECONDS_PER_SECOND / 10)
+#define TCG_RR_MAX_WEIGHT 16
+#define TCG_KICK_QUANTUM (TCG_KICK_PERIOD / TCG_RR_MAX_WEIGHT)
 
 static inline int64_t qemu_tcg_next_kick(void)
 {
-    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_PERIOD;
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_QUANTUM;
+}
+
+/* Hash the core registers of @cpu as seen by the gdbstub, PC included */
+static uint64_t tcg_rr_state_hash(CPUState *cpu)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    uint64_t hash = 14695981039346656037ULL;
+    uint8_t buf[256];
+    int reg, len, i;
+
+    for (reg = 0; reg < cc->gdb_num_core_regs; reg++) {
+        len = cc->gdb_read_register(cpu, buf, reg);
+        for (i = 0; i < len; i++) {
+            hash = (hash ^ buf[i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/* Start the slice of @cpu, which has just been scheduled */
+static void tcg_rr_start_slice(CPUState *cpu)
+{
+    if (cpu->rr_weight == 0) {
+        cpu->rr_weight = TCG_RR_MAX_WEIGHT;
+    }
+    cpu->rr_quanta = cpu->rr_weight;
+    atomic_set(&tcg_rr_quantum_expired, false);
+}
+
+/*
+ * Called when @cpu was kicked at the end of a quantum; return true if it
+ * should keep running.  Targets without gdbstub registers are never
+ * considered to be polling.
+ */
+static bool tcg_rr_end_quantum(CPUState *cpu)
+{
+    if (CPU_GET_CLASS(cpu)->gdb_num_core_regs) {
+        uint64_t hash = tcg_rr_state_hash(cpu);
+
+        if (hash == cpu->rr_state_hash) {
+            /* no progress since the last quantum, so let others run */
+            cpu->rr_weight = 1;
+            return false;
+        }
+        cpu->rr_state_hash = hash;
+    }
+    if (--cpu->rr_quanta > 0) {
+        return true;
+    }
+    cpu->rr_weight = MIN(cpu->rr_weight * 2, TCG_RR_MAX_WEIGHT);
+    return false;
 }
 
 /* Kick the currently round-robin scheduled vCPU */
@@ -913,6 +1089,7 @@ void qemu_timer_notify_cb(void *opaque, QEMUClockType type)
 static void kick_tcg_thread(void *opaque)
 {
     timer_mod(tcg_kick_vcpu_timer, qemu_tcg_next_kick());
+    atomic_mb_set(&tcg_rr_quantum_expired, true);
     qemu_cpu_kick_rr_cpu();
 }
 
@@ -1397,6 +1574,7 @@ static void deal_with_unplugged_cpus(void)
 static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 {
     CPUState *cpu = arg;
+    CPUState *rr_slice_cpu = NULL;
 
     assert(tcg_enabled());
     rcu_register_thread();
@@ -1447,6 +1625,10 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
         }
 
         while (cpu && !cpu->queued_work_first && !cpu->exit_request) {
+            if (cpu != rr_slice_cpu) {
+                rr_slice_cpu = cpu;
+                tcg_rr_start_slice(cpu);
+            }
 
             atomic_mb_set(&tcg_current_rr_cpu, cpu);
             current_cpu = cpu;
@@ -1473,6 +1655,11 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
                     cpu_exec_step_atomic(cpu);
                     qemu_mutex_lock_iothread();
                     break;
+                } else if (r == EXCP_INTERRUPT && tcg_kick_vcpu_timer &&
+                           atomic_xchg(&tcg_rr_quantum_expired, false) &&
+                           tcg_rr_end_quantum(cpu)) {
+                    /* run the timers, then carry on with the same vCPU */
+                    break;
                 }
             } else if (cpu->stop) {
                 if (cpu->unplug) {
@@ -1481,6 +1668,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
                 break;
             }
 
+            rr_slice_cpu = NULL;
             cpu = CPU_NEXT(cpu);
         } /* while (cpu && !cpu->exit_request).. */
 
@@ -1693,6 +1881,208 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+/* Run @cpu for at most @budget instructions; called without the BQL */
+static int tcg_quantum_cpu_exec(CPUState *cpu, int64_t budget)
+{
+    int insns_left = MIN(0xffff, budget);
+    int r;
+
+    cpu->icount_budget = budget;
+    cpu->icount_decr.u16.low = insns_left;
+    cpu->icount_extra = budget - insns_left;
+
+    r = tcg_cpu_exec(cpu);
+
+    cpu_update_icount(cpu);
+    cpu->icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+    return r;
+}
+
+static bool tcg_quantum_io_pending(CPUState *cpu)
+{
+    return cpu->cflags_next_tb != -1 && (cpu->cflags_next_tb & CF_LAST_IO);
+}
+
+/*
+ * Run the rest of the quantum of @cpu, which stopped at an instruction
+ * that cannot run in parallel, now that it is its turn.  The other vCPUs
+ * are waiting, so the TBs are translated without CF_PARALLEL: atomics
+ * and I/O run inline, and a vCPU leaves the parallel phase at most once
+ * per quantum however many of them it executes.
+ */
+static void tcg_quantum_run_deferred(CPUState *cpu)
+{
+    int r = 0;
+
+    qemu_mutex_unlock_iothread();
+    parallel_cpus = false;
+    if (cpu->cflags_next_tb != -1) {
+        cpu->cflags_next_tb &= ~CF_PARALLEL;
+    }
+    /*
+     * Kicks only make the loop go around again; icount charges exactly
+     * the instructions that ran, wherever the TBs were left.
+     */
+    while (cpu->quantum_left > 0 && cpu_can_run(cpu)) {
+        r = tcg_quantum_cpu_exec(cpu, cpu->quantum_left);
+        if (r == EXCP_HALTED) {
+            /* idle until the end of the quantum */
+            cpu->quantum_left = 0;
+        } else if (r == EXCP_DEBUG) {
+            break;
+        }
+    }
+    parallel_cpus = true;
+    qemu_mutex_lock_iothread();
+    cpu->quantum_deferred = false;
+    if (r == EXCP_DEBUG) {
+        cpu_handle_guest_debug(cpu);
+    }
+}
+
+static void tcg_quantum_end(void)
+{
+    int64_t deadline;
+
+#ifdef CONFIG_ATOMIC64
+    atomic_set__nocheck(&timers_state.qemu_icount,
+                        timers_state.qemu_icount + tcg_quantum.budget);
+#else
+    timers_state.qemu_icount += tcg_quantum.budget;
+#endif
+    tcg_quantum.epoch++;
+    tcg_quantum.arrived = 0;
+
+    qemu_account_warp_timer();
+    handle_icount_deadline();
+
+    deadline = tcg_get_icount_limit();
+    tcg_quantum.budget = MAX(MIN(tcg_quantum.size, deadline), 1);
+}
+
+/* Hand the turn to the next vCPU after @prev with a deferred instruction */
+static void tcg_quantum_next_turn(CPUState *prev)
+{
+    CPUState *cpu = prev ? CPU_NEXT(prev) : first_cpu;
+
+    while (cpu && !(cpu->created && cpu->quantum_deferred)) {
+        cpu = CPU_NEXT(cpu);
+    }
+    tcg_quantum.turn = cpu;
+    if (!cpu) {
+        tcg_quantum_end();
+    }
+    qemu_cond_broadcast(first_cpu->halt_cond);
+}
+
+static unsigned int tcg_quantum_nr_cpus(void)
+{
+    unsigned int n = 0;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        n += cpu->created;
+    }
+    return n;
+}
+
+/* Called by @cpu once it is done with the current quantum */
+static void tcg_quantum_wait(CPUState *cpu)
+{
+    uint64_t epoch = tcg_quantum.epoch;
+
+    tcg_quantum.arrived++;
+    while (tcg_quantum.epoch == epoch) {
+        if (tcg_quantum.turn == cpu && cpu_can_run(cpu)) {
+            tcg_quantum_run_deferred(cpu);
+            tcg_quantum_next_turn(cpu);
+        } else if (!tcg_quantum.turn &&
+                   tcg_quantum.arrived >= tcg_quantum_nr_cpus() &&
+                   runstate_is_running() && !all_cpu_threads_idle()) {
+            /* everybody is here; when all are idle, let time warp */
+            tcg_quantum_next_turn(NULL);
+        } else {
+            qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+            qemu_wait_io_event_common(cpu);
+        }
+    }
+}
+
+static void *qemu_tcg_quantum_cpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+
+    assert(tcg_enabled());
+    g_assert(use_icount);
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+
+    cpu->thread_id = qemu_get_thread_id();
+    cpu->created = true;
+    cpu->can_do_io = 1;
+    current_cpu = cpu;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    /* process any pending work */
+    cpu->exit_request = 1;
+
+    do {
+        if (cpu->quantum_epoch != tcg_quantum.epoch) {
+            cpu->quantum_epoch = tcg_quantum.epoch;
+            cpu->quantum_left = tcg_quantum.budget;
+        }
+        if (!cpu_can_run(cpu)) {
+            atomic_mb_set(&cpu->exit_request, 0);
+            qemu_wait_io_event(cpu);
+            continue;
+        }
+        if (cpu->quantum_left > 0 && !cpu->quantum_deferred) {
+            int r;
+
+            qemu_mutex_unlock_iothread();
+            r = tcg_quantum_cpu_exec(cpu, cpu->quantum_left);
+            qemu_mutex_lock_iothread();
+            switch (r) {
+            case EXCP_DEBUG:
+                cpu_handle_guest_debug(cpu);
+                break;
+            case EXCP_HALTED:
+                /* idle until the end of the quantum */
+                cpu->quantum_left = 0;
+                break;
+            case EXCP_ATOMIC:
+                cpu->quantum_deferred = true;
+                break;
+            default:
+                cpu->quantum_deferred = tcg_quantum_io_pending(cpu);
+                break;
+            }
+        }
+        atomic_mb_set(&cpu->exit_request, 0);
+        if (cpu_can_run(cpu) &&
+            (cpu->quantum_left <= 0 || cpu->quantum_deferred)) {
+            tcg_quantum_wait(cpu);
+        } else {
+            qemu_wait_io_event_common(cpu);
+        }
+    } while (!cpu->unplug || cpu_can_run(cpu));
+
+    qemu_tcg_destroy_vcpu(cpu);
+    cpu->created = false;
+    qemu_cond_signal(&qemu_cpu_cond);
+    /* the quantum may be waiting for this vCPU */
+    qemu_cond_broadcast(cpu->halt_cond);
+    qemu_mutex_unlock_iothread();
+    rcu_unregister_thread();
+    return NULL;
+}
+
 static void qemu_cpu_kick_thread(CPUState *cpu)
 {
 #ifndef _WIN32
@@ -1871,8 +2261,12 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
 
     if (qemu_tcg_mttcg_enabled() || !single_tcg_cpu_thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
-        cpu->halt_cond = g_malloc0(sizeof(QemuCond));
-        qemu_cond_init(cpu->halt_cond);
+        if (tcg_quantum.size && single_tcg_halt_cond) {
+            cpu->halt_cond = single_tcg_halt_cond;
+        } else {
+            cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+            qemu_cond_init(cpu->halt_cond);
+        }
 
         if (qemu_tcg_mttcg_enabled()) {
             /* create a thread per vCPU with TCG (MTTCG) */
@@ -1880,9 +2274,17 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
             snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
                  cpu->cpu_index);
 
-            qemu_thread_create(cpu->thread, thread_name, qemu_tcg_cpu_thread_fn,
-                               cpu, QEMU_THREAD_JOINABLE);
-
+            if (tcg_quantum.size) {
+                /* the vCPU threads wait for each other on one condition */
+                single_tcg_halt_cond = cpu->halt_cond;
+                qemu_thread_create(cpu->thread, thread_name,
+                                   qemu_tcg_quantum_cpu_thread_fn,
+                                   cpu, QEMU_THREAD_JOINABLE);
+            } else {
+                qemu_thread_create(cpu->thread, thread_name,
+                                   qemu_tcg_cpu_thread_fn,
+                                   cpu, QEMU_THREAD_JOINABLE);
+            }
         } else {
             /* share a single thread for all cpus with TCG */
             snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "ALL CPUs/TCG");
@@ -2290,6 +2692,24 @@ CpuInfoFastList *qmp_query_cpus_fast(Error **errp)
     return head;
 }
 
+VcpuDirtyPagesList *qmp_query_vcpu_dirty_pages(Error **errp)
+{
+    VcpuDirtyPagesList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyPagesList *info = g_malloc0(sizeof(*info));
+
+        info->value = g_malloc0(sizeof(*info->value));
+        info->value->cpu_index = cpu->cpu_index;
+        info->value->dirty_pages = stat64_get(&cpu->dirty_pages);
+        *tail = info;
+        tail = &info->next;
+    }
+
+    return head;
+}
+
 void qmp_memsave(int64_t addr, int64_t size, const char *filename,
                  bool has_cpu, int64_t cpu_index, Error **errp)
 {
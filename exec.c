@@ -123,6 +123,9 @@ __thread CPUState *current_cpu;
    2 = Adaptive rate instruction counting.  */
 int use_icount;
 
+/* See tb_gen_superblock() */
+unsigned int tb_superblock_threshold;
+
 uintptr_t qemu_host_page_size;
 intptr_t qemu_host_page_mask;
 
@@ -191,6 +194,8 @@ typedef struct PhysPageMap {
 
 struct AddressSpaceDispatch {
     MemoryRegionSection *mru_section;
+    /* Unique among all dispatches ever created; tags PhysSectionCache */
+    uint64_t gen;
     /* This is a multi-level map on the physical address space.
      * The bottom level has pointers to MemoryRegionSections.
      */
@@ -402,18 +407,64 @@ static MemoryRegionSection *phys_page_find(AddressSpaceDispatch *d, hwaddr addr)
     }
 }
 
+/*
+ * vCPUs that exit for MMIO keep hitting the same few pages, and would
+ * otherwise fight over d->mru_section.  Instead each vCPU remembers its
+ * last page-level lookups in a small direct-mapped cache, which only its
+ * own thread touches.  Entries are tagged with the generation of the
+ * dispatch they were looked up in; a new FlatView gets a new dispatch and
+ * thus a new generation, so entries for older views simply stop matching.
+ * Dispatches that are reused across commits keep their entries valid.
+ */
+#define PHYS_SECTION_CACHE_BITS 4
+#define PHYS_SECTION_CACHE_SIZE (1 << PHYS_SECTION_CACHE_BITS)
+
+typedef struct PhysSectionCacheEntry {
+    uint64_t gen;
+    hwaddr page;
+    MemoryRegionSection *section;
+} PhysSectionCacheEntry;
+
+struct PhysSectionCache {
+    PhysSectionCacheEntry entries[PHYS_SECTION_CACHE_SIZE];
+};
+
+/* Called from RCU critical section, on the thread of @cpu */
+static MemoryRegionSection *phys_section_cache_find(CPUState *cpu,
+                                                    AddressSpaceDispatch *d,
+                                                    hwaddr addr)
+{
+    hwaddr page = addr & TARGET_PAGE_MASK;
+    PhysSectionCacheEntry *e;
+
+    e = &cpu->phys_section_cache->entries[(addr >> TARGET_PAGE_BITS) &
+                                          (PHYS_SECTION_CACHE_SIZE - 1)];
+    if (e->gen != d->gen || e->page != page) {
+        e->section = phys_page_find(d, addr);
+        e->page = page;
+        e->gen = d->gen;
+    }
+    return e->section;
+}
+
 /* Called from RCU critical section */
 static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
                                                         hwaddr addr,
                                                         bool resolve_subpage)
 {
-    MemoryRegionSection *section = atomic_read(&d->mru_section);
+    MemoryRegionSection *section;
     subpage_t *subpage;
 
-    if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
-        !section_covers_addr(section, addr)) {
-        section = phys_page_find(d, addr);
-        atomic_set(&d->mru_section, section);
+    if (current_cpu && current_cpu->phys_section_cache) {
+        section = phys_section_cache_find(current_cpu, d, addr);
+    } else {
+        section = atomic_read(&d->mru_section);
+        if (!section ||
+            section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
+            !section_covers_addr(section, addr)) {
+            section = phys_page_find(d, addr);
+            atomic_set(&d->mru_section, section);
+        }
     }
     if (resolve_subpage && section->mr->subpage) {
         subpage = container_of(section->mr, subpage_t, iomem);
@@ -945,7 +996,10 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     }
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+    g_free(cpu->phys_section_cache);
+    cpu->phys_section_cache = NULL;
 #endif
+    tlb_destroy(cpu);
 }
 
 Property cpu_common_props[] = {
@@ -985,6 +1039,7 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
         cc->tcg_initialize();
     }
+    tlb_init(cpu);
 
 #ifndef CONFIG_USER_ONLY
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
@@ -995,6 +1050,7 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
     }
 
     cpu->iommu_notifiers = g_array_new(false, true, sizeof(TCGIOMMUNotifier));
+    cpu->phys_section_cache = g_new0(struct PhysSectionCache, 1);
 #endif
 }
 
@@ -2686,6 +2742,13 @@ void memory_notdirty_write_complete(NotDirtyInfo *ndi)
         ndi->pages = NULL;
     }
 
+    /* Account the page to the vCPU that dirtied it, during migration */
+    if (ndi->cpu && atomic_read(&global_dirty_log) &&
+        !cpu_physical_memory_get_dirty_flag(ndi->ram_addr,
+                                            DIRTY_MEMORY_MIGRATION)) {
+        stat64_add(&ndi->cpu->dirty_pages, 1);
+    }
+
     /* Set both VGA and migration bits for simplicity and to remove
      * the notdirty callback faster.
      */
@@ -3043,11 +3106,16 @@ static void io_mem_init(void)
                           NULL, UINT64_MAX);
 }
 
+/* Called with the BQL held */
 AddressSpaceDispatch *address_space_dispatch_new(FlatView *fv)
 {
+    static uint64_t last_gen;
     AddressSpaceDispatch *d = g_new0(AddressSpaceDispatch, 1);
     uint16_t n;
 
+    /* 0 is never used, so that empty cache entries never match */
+    d->gen = ++last_gen;
+
     n = dummy_section(&d->map, fv, &io_mem_unassigned);
     assert(n == PHYS_SECTION_UNASSIGNED);
     n = dummy_section(&d->map, fv, &io_mem_notdirty);
@@ -297,6 +297,24 @@ STEXI
 @item info opcount
 @findex info opcount
 Show dynamic compiler opcode counters
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "count:i?",
+        .params     = "[count]",
+        .help       = "show the most executed translation blocks",
+        .cmd        = hmp_info_tb_stats,
+    },
+#endif
+
+STEXI
+@item info tb-stats [@var{count}]
+@findex info tb-stats
+Show execution and translation statistics of the @var{count} (default 10)
+most executed translation blocks, along with their disassembly.
+Statistics are collected only after @code{tb_stats on}.
 ETEXI
 
     {
@@ -408,6 +408,24 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb_stats",
+        .args_type  = "option:s",
+        .params     = "on|off|reset",
+        .help       = "start, stop or reset collection of TB statistics",
+        .cmd        = hmp_tb_stats,
+    },
+#endif
+
+STEXI
+@item tb_stats on|off|reset
+@findex tb_stats
+Start or stop collecting per translation block execution and translation
+statistics, or reset the statistics collected so far.  Starting or stopping
+collection flushes the translation cache.  See @code{info tb-stats}.
 ETEXI
 
     {
@@ -30,6 +30,8 @@
 #include "ui/console.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/seqlock.h"
 #include "qemu/timer.h"
 #include "hw/timer/hpet.h"
 #include "hw/sysbus.h"
@@ -69,6 +71,12 @@ typedef struct HPETState {
     /*< public >*/
 
     MemoryRegion iomem;
+    /*
+     * The main counter is read without the BQL, so changes to config,
+     * hpet_offset and hpet_counter while vCPUs run are done inside this
+     * seqlock.  Writers are serialized by the BQL.
+     */
+    QemuSeqLock counter_lock;
     uint64_t hpet_offset;
     bool hpet_offset_saved;
     qemu_irq irqs[HPET_NUM_IRQ_ROUTES];
@@ -414,6 +422,23 @@ static void hpet_del_timer(HPETTimer *t)
     update_irq(t, 0);
 }
 
+/* Called with or without the BQL held */
+static uint64_t hpet_read_counter(HPETState *s)
+{
+    uint64_t cur_tick;
+    unsigned start;
+
+    do {
+        start = seqlock_read_begin(&s->counter_lock);
+        if (hpet_enabled(s)) {
+            cur_tick = hpet_get_ticks(s);
+        } else {
+            cur_tick = s->hpet_counter;
+        }
+    } while (seqlock_read_retry(&s->counter_lock, start));
+    return cur_tick;
+}
+
 #ifdef HPET_DEBUG
 static uint32_t hpet_ram_readb(void *opaque, hwaddr addr)
 {
@@ -475,19 +500,11 @@ static uint64_t hpet_ram_read(void *opaque, hwaddr addr,
             DPRINTF("qemu: invalid HPET_CFG + 4 hpet_ram_readl\n");
             return 0;
         case HPET_COUNTER:
-            if (hpet_enabled(s)) {
-                cur_tick = hpet_get_ticks(s);
-            } else {
-                cur_tick = s->hpet_counter;
-            }
+            cur_tick = hpet_read_counter(s);
             DPRINTF("qemu: reading counter  = %" PRIx64 "\n", cur_tick);
             return cur_tick;
         case HPET_COUNTER + 4:
-            if (hpet_enabled(s)) {
-                cur_tick = hpet_get_ticks(s);
-            } else {
-                cur_tick = s->hpet_counter;
-            }
+            cur_tick = hpet_read_counter(s);
             DPRINTF("qemu: reading counter + 4  = %" PRIx64 "\n", cur_tick);
             return cur_tick >> 32;
         case HPET_STATUS:
@@ -603,6 +620,7 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
             return;
         case HPET_CFG:
             val = hpet_fixup_reg(new_val, old_val, HPET_CFG_WRITE_MASK);
+            seqlock_write_begin(&s->counter_lock);
             s->config = (s->config & 0xffffffff00000000ULL) | val;
             if (activating_bit(old_val, new_val, HPET_CFG_ENABLE)) {
                 /* Enable main counter and interrupt generation. */
@@ -620,6 +638,7 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
                     hpet_del_timer(&s->timer[i]);
                 }
             }
+            seqlock_write_end(&s->counter_lock);
             /* i8254 and RTC output pins are disabled
              * when HPET is in legacy mode */
             if (activating_bit(old_val, new_val, HPET_CFG_LEGACY)) {
@@ -647,8 +666,10 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
             if (hpet_enabled(s)) {
                 DPRINTF("qemu: Writing counter while HPET enabled!\n");
             }
+            seqlock_write_begin(&s->counter_lock);
             s->hpet_counter =
                 (s->hpet_counter & 0xffffffff00000000ULL) | value;
+            seqlock_write_end(&s->counter_lock);
             DPRINTF("qemu: HPET counter written. ctr = %#x -> %" PRIx64 "\n",
                     value, s->hpet_counter);
             break;
@@ -656,8 +677,10 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
             if (hpet_enabled(s)) {
                 DPRINTF("qemu: Writing counter while HPET enabled!\n");
             }
+            seqlock_write_begin(&s->counter_lock);
             s->hpet_counter =
                 (s->hpet_counter & 0xffffffffULL) | (((uint64_t)value) << 32);
+            seqlock_write_end(&s->counter_lock);
             DPRINTF("qemu: HPET counter + 4 written. ctr = %#x -> %" PRIx64 "\n",
                     value, s->hpet_counter);
             break;
@@ -668,14 +691,57 @@ static void hpet_ram_write(void *opaque, hwaddr addr,
     }
 }
 
+/*
+ * Guests that use the HPET as their clocksource read the main counter all
+ * the time, so do that without the BQL; everything else takes it.
+ */
+static uint64_t hpet_mmio_read(void *opaque, hwaddr addr, unsigned size)
+{
+    HPETState *s = opaque;
+    bool release_lock = false;
+    uint64_t ret;
+
+    if (addr == HPET_COUNTER) {
+        return hpet_read_counter(s);
+    } else if (addr == HPET_COUNTER + 4) {
+        return hpet_read_counter(s) >> 32;
+    }
+
+    if (!qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        release_lock = true;
+    }
+    ret = hpet_ram_read(opaque, addr, size);
+    if (release_lock) {
+        qemu_mutex_unlock_iothread();
+    }
+    return ret;
+}
+
+static void hpet_mmio_write(void *opaque, hwaddr addr, uint64_t value,
+                            unsigned size)
+{
+    bool release_lock = false;
+
+    if (!qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        release_lock = true;
+    }
+    hpet_ram_write(opaque, addr, value, size);
+    if (release_lock) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
 static const MemoryRegionOps hpet_ram_ops = {
-    .read = hpet_ram_read,
-    .write = hpet_ram_write,
+    .read = hpet_mmio_read,
+    .write = hpet_mmio_write,
     .valid = {
         .min_access_size = 4,
         .max_access_size = 4,
     },
     .endianness = DEVICE_NATIVE_ENDIAN,
+    .lockless = true,
 };
 
 static void hpet_reset(DeviceState *d)
@@ -731,6 +797,8 @@ static void hpet_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     HPETState *s = HPET(obj);
 
+    seqlock_init(&s->counter_lock);
+
     /* HPET Area */
     memory_region_init_io(&s->iomem, obj, &hpet_ram_ops, s, "hpet", HPET_LEN);
     sysbus_init_mmio(sbd, &s->iomem);
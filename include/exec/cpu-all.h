@@ -260,6 +260,7 @@ int walk_memory_regions(void *, walk_memory_regions_fn);
 int page_get_flags(target_ulong address);
 void page_set_flags(target_ulong start, target_ulong end, int flags);
 int page_check_range(target_ulong start, target_ulong len, int flags);
+unsigned int page_protect_count(void);
 #endif
 
 CPUArchState *cpu_copy(CPUArchState *env);
@@ -25,6 +25,7 @@
 
 #include "qemu/host-utils.h"
 #include "qemu/queue.h"
+#include "qemu/thread.h"
 #ifdef CONFIG_TCG
 #include "tcg-target.h"
 #endif
@@ -66,37 +67,27 @@ typedef uint64_t target_ulong;
 #define CPU_TLB_ENTRY_BITS 5
 #endif
 
-/* TCG_TARGET_TLB_DISPLACEMENT_BITS is used in CPU_TLB_BITS to ensure that
- * the TLB is not unnecessarily small, but still small enough for the
- * TLB lookup instruction sequence used by the TCG target.
- *
- * TCG will have to generate an operand as large as the distance between
- * env and the tlb_table[NB_MMU_MODES - 1][0].addend.  For simplicity,
- * the TCG targets just round everything up to the next power of two, and
- * count bits.  This works because: 1) the size of each TLB is a largish
- * power of two, 2) and because the limit of the displacement is really close
- * to a power of two, 3) the offset of tlb_table[0][0] inside env is smaller
- * than the size of a TLB.
- *
- * For example, the maximum displacement 0xFFF0 on PPC and MIPS, but TCG
- * just says "the displacement is 16 bits".  TCG_TARGET_TLB_DISPLACEMENT_BITS
- * then ensures that tlb_table at least 0x8000 bytes large ("not unnecessarily
- * small": 2^15).  The operand then will come up smaller than 0xFFF0 without
- * any particular care, because the TLB for a single MMU mode is larger than
- * 0x10000-0xFFF0=16 bytes.  In the end, the maximum value of the operand
- * could be something like 0xC000 (the offset of the last TLB table) plus
- * 0x18 (the offset of the addend field in each TLB entry) plus the offset
- * of tlb_table inside env (which is non-trivial but not huge).
+/* The TLB of each MMU mode is sized dynamically at flush time, between
+ * 2^CPU_TLB_DYN_MIN_BITS and 2^CPU_TLB_DYN_MAX_BITS entries, starting
+ * out at 2^CPU_TLB_DYN_DEFAULT_BITS.  Generated code never hardcodes
+ * the size: it loads tlb_mask[mmu_idx] and tlb_table[mmu_idx] from env
+ * and computes the index into the table from those.
  */
-#define CPU_TLB_BITS                                             \
-    MIN(8,                                                       \
-        TCG_TARGET_TLB_DISPLACEMENT_BITS - CPU_TLB_ENTRY_BITS -  \
-        (NB_MMU_MODES <= 1 ? 0 :                                 \
-         NB_MMU_MODES <= 2 ? 1 :                                 \
-         NB_MMU_MODES <= 4 ? 2 :                                 \
-         NB_MMU_MODES <= 8 ? 3 : 4))
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
 
-#define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
+#if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+#else
+/* With TARGET_PAGE_BITS == 12, 2^22 entries cover 16GiB of address
+ * space, which is in the same ballpark as the second-level TLB of a
+ * current x86_64 host.  There is no point in sizing the TLB past the
+ * guest's own address space though.
+ */
+#define CPU_TLB_DYN_MAX_BITS \
+    MIN(22, TARGET_VIRT_ADDR_SPACE_BITS - TARGET_PAGE_BITS)
+#endif
 
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
@@ -140,12 +131,28 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+typedef struct CPUTLBDesc {
+    /* Usage of the TLB over the current window, used to decide at
+     * flush time whether the TLB should grow or shrink.
+     */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    /* Number of valid entries currently in tlb_table */
+    size_t n_used_entries;
+} CPUTLBDesc;
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    /* tlb_mask[i] contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */    \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
-    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    /* Protects the tlb_table/iotlb pointers and tlb_mask against      \
+     * cross-vCPU walkers (tlb_reset_dirty) while the TLB is resized */ \
+    QemuSpin tlb_lock;                                                  \
     size_t tlb_flush_count;                                             \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
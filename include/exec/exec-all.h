@@ -23,6 +23,7 @@
 #include "qemu-common.h"
 #include "exec/tb-context.h"
 #include "sysemu/cpus.h"
+#include "qemu/interval-tree.h"
 
 /* allow to see translation results - the slowdown should be negligible, so we leave it */
 #define DEBUG_DISAS
@@ -67,6 +68,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
+TranslationBlock *tb_gen_superblock(CPUState *cpu, TranslationBlock *tb);
 
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
@@ -99,6 +101,16 @@ void cpu_address_space_init(CPUState *cpu, int asidx,
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 /* cputlb.c */
+/**
+ * tlb_init - initialize a CPU's TLB
+ * @cpu: CPU whose TLB should be initialized
+ */
+void tlb_init(CPUState *cpu);
+/**
+ * tlb_destroy - destroy a CPU's TLB
+ * @cpu: CPU whose TLB should be destroyed
+ */
+void tlb_destroy(CPUState *cpu);
 /**
  * tlb_flush_page:
  * @cpu: CPU whose TLB should be flushed
@@ -258,6 +270,12 @@ void tlb_set_page(CPUState *cpu, target_ulong vaddr,
 void probe_write(CPUArchState *env, target_ulong addr, int size, int mmu_idx,
                  uintptr_t retaddr);
 #else
+static inline void tlb_init(CPUState *cpu)
+{
+}
+static inline void tlb_destroy(CPUState *cpu)
+{
+}
 static inline void tlb_flush_page(CPUState *cpu, target_ulong addr)
 {
 }
@@ -341,8 +359,10 @@ struct TranslationBlock {
 #define CF_LAST_IO     0x00008000 /* Last insn may be an IO access.  */
 #define CF_NOCACHE     0x00010000 /* To be freed after execution */
 #define CF_USE_ICOUNT  0x00020000
-#define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
+#define CF_INVALID     0x00040000 /* TB is stale */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_SPECULATIVE 0x00100000 /* Translated ahead of time */
+#define CF_TRACE       0x00200000 /* Superblock, see tb_gen_superblock() */
 /* cflags' mask for hashing/comparison */
 #define CF_HASH_MASK   \
     (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL)
@@ -350,14 +370,23 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /*
+     * Number of executions, only counted when superblocks are enabled.
+     * Updated by the generated code without atomics.
+     */
+    uint32_t exec_count;
+
+    /* Execution statistics, NULL unless tb_stats_enabled was set */
+    struct TBStatistics *tb_stats;
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
     struct TranslationBlock *orig_tb;
-    /* first and second physical page containing code. The lower bit
-       of the pointer tells the index in page_next[].
-       The list is protected by the TB's page('s) lock(s) */
-    uintptr_t page_next[2];
+    /* first and second physical page containing code, and the byte range
+       of the code in each of them, linked into the code_ranges[] index of
+       the page.  The index is protected by the TB's page('s) lock(s) */
+    IntervalTreeNode page_range[2];
     tb_page_addr_t page_addr[2];
 
     /* jmp_lock placed here to fill a 4-byte hole. Its documentation is below */
@@ -381,22 +410,46 @@ struct TranslationBlock {
      * significant bit (LSB) of the pointers in these lists is used to encode
      * which of the two list entries is to be used in the pointed TB.
      *
-     * List traversals are protected by jmp_lock. The destination TB of each
-     * outgoing jump is kept in jmp_dest[] so that the appropriate jmp_lock
-     * can be acquired from any origin TB.
+     * Jumps are added to the list without locking, see exec/tb-jmp-list.h.
+     * jmp_lock serializes the removal of entries with the closing of the
+     * list, which happens when the TB is invalidated and its incoming jumps
+     * are reset.  The destination TB of each outgoing jump is kept in
+     * jmp_dest[], which is claimed with a cmpxchg before the jump is chained.
      *
      * jmp_dest[] are tagged pointers as well. The LSB is set when the TB is
      * being invalidated, so that no further outgoing jumps from it can be set.
-     *
-     * jmp_lock also protects the CF_INVALID cflag; a jump must not be chained
-     * to a destination TB that has CF_INVALID set.
+     * The entries of an invalidated TB stay in the lists of its destinations
+     * until tb_jmp_list_purge removes them, before its memory is reused.
      */
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+#ifdef CONFIG_USER_ONLY
+    /* Branch caches used by the code of this TB, see TBBranchCache */
+    struct TBBranchCache *branch_caches;
+#endif
 };
 
 extern bool parallel_cpus;
+/*
+ * Translate atomic operations of parallel TBs to leave the TB with
+ * EXCP_ATOMIC, so that they run while the other vCPUs wait; used by
+ * deterministic multi-threaded icount.
+ */
+extern bool serial_atomics;
+/*
+ * Likewise, make instructions that call gen_io_start() in parallel TBs
+ * leave the TB as MMIO does under icount, so that they are retranslated
+ * with CF_LAST_IO and run while the other vCPUs wait.
+ */
+extern bool serial_io;
+
+/*
+ * Number of executions after which a TB is retranslated as a superblock
+ * together with its hot successors; 0 disables superblocks.
+ */
+extern unsigned int tb_superblock_threshold;
 
 /* Hide the atomic_read to make code a little easier on the eyes */
 static inline uint32_t tb_cflags(const TranslationBlock *tb)
@@ -411,6 +464,36 @@ static inline uint32_t curr_cflags(void)
          | (use_icount ? CF_USE_ICOUNT : 0);
 }
 
+/* Whether the code of @tb counts its executions in tb->exec_count */
+static inline bool tb_superblock_counted(const TranslationBlock *tb)
+{
+    return tb_superblock_threshold &&
+        !(tb_cflags(tb) & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE |
+                           CF_USE_ICOUNT | CF_TRACE));
+}
+
+/*
+ * Destination cache of an indirect branch site, or return address of a
+ * call site for the return-address stack; see translator_lookup_and_goto_ptr.
+ * Only used in user-mode emulation.  Caches are allocated with mmap_lock
+ * held while translating a TB, and are freed after an RCU grace period
+ * once the TB is invalidated, or by tb_flush.
+ */
+typedef struct TBBranchCache TBBranchCache;
+struct TBBranchCache {
+    /* Last destination TB, or NULL.  Set with atomic_set.  */
+    TranslationBlock *tb;
+    /* For call sites, the return address; @tb is only set to a TB for it */
+    target_ulong ret_pc;
+    bool is_call;
+    /* Next cache of the same TB */
+    TBBranchCache *next;
+};
+
+#if defined(CONFIG_USER_ONLY)
+TBBranchCache *tb_branch_cache_new(void);
+#endif
+
 /* TranslationBlock invalidate API */
 #if defined(CONFIG_USER_ONLY)
 void tb_invalidate_phys_addr(target_ulong addr);
@@ -2,11 +2,52 @@
 #define GEN_ICOUNT_H
 
 #include "qemu/timer.h"
+#include "exec/tb-stats.h"
 
 /* Helpers for instruction counting code generation.  */
 
 static TCGOp *icount_start_insn;
 
+static inline void gen_tb_exec_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tb->tb_stats->exec_count);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    /* Not atomic: losing a few increments under MTTCG is acceptable */
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+/*
+ * Count the executions of @tb, and once they reach the superblock
+ * threshold go back to the main loop, which will then retranslate it.
+ */
+static inline void gen_tb_superblock_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *cold = gen_new_label();
+
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, tb_superblock_threshold, cold);
+
+    /* Like cpu_exit(), so that cpu_loop_exec_tb sees a TB_EXIT_REQUESTED */
+    tcg_gen_movi_i32(count, -1);
+    tcg_gen_st16_i32(count, cpu_env,
+                     -ENV_OFFSET + offsetof(CPUState, icount_decr.u16.high));
+    tcg_gen_br(tcg_ctx->exitreq_label);
+
+    gen_set_label(cold);
+    tcg_temp_free_i32(count);
+}
+
 static inline void gen_tb_start(TranslationBlock *tb)
 {
     TCGv_i32 count, imm;
@@ -41,6 +82,13 @@ static inline void gen_tb_start(TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    if (tb->tb_stats) {
+        gen_tb_exec_count(tb);
+    }
+    if (tb_superblock_counted(tb)) {
+        gen_tb_superblock_count(tb);
+    }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
@@ -57,7 +105,12 @@ static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
 
 static inline void gen_io_start(void)
 {
-    TCGv_i32 tmp = tcg_const_i32(1);
+    TCGv_i32 tmp;
+
+    if (serial_io && (tcg_ctx->tb_cflags & CF_PARALLEL)) {
+        gen_helper_defer_io(cpu_env);
+    }
+    tmp = tcg_const_i32(1);
     tcg_gen_st_i32(tmp, cpu_env, -ENV_OFFSET + offsetof(CPUState, can_do_io));
     tcg_temp_free_i32(tmp);
 }
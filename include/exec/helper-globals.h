@@ -0,0 +1,38 @@
+/* Helper file for declaring TCG helper functions.
+   This one defines the global read/write sets private to tcg.c.  */
+
+#ifndef HELPER_GLOBALS_H
+#define HELPER_GLOBALS_H
+
+#include "exec/helper-head.h"
+
+#define DEF_HELPER_FLAGS_0(NAME, FLAGS, ret)
+#define DEF_HELPER_FLAGS_1(NAME, FLAGS, ret, t1)
+#define DEF_HELPER_FLAGS_2(NAME, FLAGS, ret, t1, t2)
+#define DEF_HELPER_FLAGS_3(NAME, FLAGS, ret, t1, t2, t3)
+#define DEF_HELPER_FLAGS_4(NAME, FLAGS, ret, t1, t2, t3, t4)
+#define DEF_HELPER_FLAGS_5(NAME, FLAGS, ret, t1, t2, t3, t4, t5)
+#define DEF_HELPER_FLAGS_6(NAME, FLAGS, ret, t1, t2, t3, t4, t5, t6)
+
+/* Each set is terminated by an empty range.  */
+#undef DEF_HELPER_GLOBALS
+#define DEF_HELPER_GLOBALS(NAME, READS, WRITES) \
+  { .func = HELPER(NAME), \
+    .reads = (const TCGHelperGlobalRange[]) { READS { 0, 0 } }, \
+    .writes = (const TCGHelperGlobalRange[]) { WRITES { 0, 0 } } },
+
+#include "helper.h"
+#include "trace/generated-helpers.h"
+#include "tcg-runtime.h"
+
+#undef DEF_HELPER_FLAGS_0
+#undef DEF_HELPER_FLAGS_1
+#undef DEF_HELPER_FLAGS_2
+#undef DEF_HELPER_FLAGS_3
+#undef DEF_HELPER_FLAGS_4
+#undef DEF_HELPER_FLAGS_5
+#undef DEF_HELPER_FLAGS_6
+#undef DEF_HELPER_GLOBALS
+#define DEF_HELPER_GLOBALS(name, reads, writes)
+
+#endif /* HELPER_GLOBALS_H */
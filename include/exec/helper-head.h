@@ -133,4 +133,18 @@
 
 /* MAX_OPC_PARAM_IARGS must be set to n if last entry is DEF_HELPER_FLAGS_n. */
 
+/* DEF_HELPER_GLOBALS(name, reads, writes) declares which TCG globals a
+   helper may read and write, so that the register allocator need only
+   sync those around the call; any global backed by env outside these
+   sets is left in its host register.  Each set is a sequence of
+   dh_env(field) and dh_env_range(first, last) items, or empty.  A helper
+   that can raise an exception reads every global, and must not use this.
+   It is only expanded by tcg.c, through exec/helper-globals.h.  */
+#define dh_env_range(first, last) \
+    { offsetof(CPUArchState, first), \
+      offsetof(CPUArchState, last) + sizeof(((CPUArchState *)0)->last) },
+#define dh_env(field) dh_env_range(field, field)
+
+#define DEF_HELPER_GLOBALS(name, reads, writes)
+
 #endif /* EXEC_HELPER_HEAD_H */
@@ -188,6 +188,11 @@ struct MemoryRegionOps {
         bool unaligned;
     } impl;
 
+    /* If true, the callbacks may be called without the BQL held, and must
+     * do their own locking; see memory_region_clear_global_locking().
+     */
+    bool lockless;
+
     /* If .read and .write are not present, old_mmio may be used for
      * backwards compatibility with old mmio registration
      */
@@ -404,6 +409,18 @@ struct MemoryListener {
     void (*log_stop)(MemoryListener *listener, MemoryRegionSection *section,
                      int old, int new);
     void (*log_sync)(MemoryListener *listener, MemoryRegionSection *section);
+    /*
+     * Alternative to log_sync for listeners that cannot sync a single
+     * section, e.g. because their dirty log is a ring of recently written
+     * pages: collects all dirty pages of the address space at once.
+     */
+    void (*log_sync_global)(MemoryListener *listener);
+    /*
+     * Called after the dirty pages of @section that were fetched by
+     * log_sync have been consumed, so that the accelerator can start
+     * tracking writes to them again; see memory_region_clear_dirty_bitmap().
+     */
+    void (*log_clear)(MemoryListener *listener, MemoryRegionSection *section);
     void (*log_global_start)(MemoryListener *listener);
     void (*log_global_stop)(MemoryListener *listener);
     void (*eventfd_add)(MemoryListener *listener, MemoryRegionSection *section,
@@ -1257,6 +1274,22 @@ bool memory_region_get_dirty(MemoryRegion *mr, hwaddr addr,
 void memory_region_set_dirty(MemoryRegion *mr, hwaddr addr,
                              hwaddr size);
 
+/**
+ * memory_region_clear_dirty_bitmap: clear the dirty log of the accelerator
+ *
+ * Accelerators such as KVM can keep reporting pages as dirty after their
+ * dirty log has been synced, until it is cleared.  Clearing it write
+ * protects the pages again, which is expensive for large ranges, so users
+ * of the dirty bitmap should clear each range just before they consume
+ * its dirty pages, e.g. before migration sends them.
+ *
+ * @mr: the memory region to clear the dirty log of.
+ * @start: the address (relative to the start of the region) to clear from.
+ * @len: the length of the range to clear.
+ */
+void memory_region_clear_dirty_bitmap(MemoryRegion *mr, hwaddr start,
+                                      hwaddr len);
+
 /**
  * memory_region_snapshot_and_clear_dirty: Get a snapshot of the dirty
  *                                         bitmap and clear it.
@@ -1411,7 +1444,8 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr);
  * By clearing this property, accesses to the memory region will be processed
  * outside of QEMU's global lock (unless the lock is held on when issuing the
  * access request). In this case, the device model implementing the access
- * handlers is responsible for synchronization of concurrency.
+ * handlers is responsible for synchronization of concurrency.  Regions whose
+ * #MemoryRegionOps set @lockless start out with the property cleared.
  *
  * @mr: the memory region to be updated.
  */
@@ -1664,6 +1698,12 @@ void memory_global_dirty_log_start(void);
  */
 void memory_global_dirty_log_stop(void);
 
+/*
+ * True while dirty logging is enabled for all regions, i.e. between
+ * memory_global_dirty_log_start() and memory_global_dirty_log_stop().
+ */
+extern bool global_dirty_log;
+
 void mtree_info(fprintf_function mon_printf, void *f, bool flatview,
                 bool dispatch_tree, bool owner);
 
@@ -49,8 +49,43 @@ struct RAMBlock {
     unsigned long *unsentmap;
     /* bitmap of already received pages in postcopy */
     unsigned long *receivedmap;
+    /*
+     * bitmap of the chunks of bmap whose dirty log must be cleared in the
+     * accelerator before their pages are sent; each bit covers
+     * (1 << clear_bmap_shift) target pages.  Only used during migration.
+     */
+    unsigned long *clear_bmap;
+    uint8_t clear_bmap_shift;
+    /* pages found dirty by migration in the current period, and per second */
+    uint64_t dirty_pages_period;
+    uint64_t dirty_pages_rate;
 };
 
+/* Number of clear_bmap bits needed for @pages target pages */
+static inline unsigned long clear_bmap_size(uint64_t pages, uint8_t shift)
+{
+    return DIV_ROUND_UP(pages, 1UL << shift);
+}
+
+/* Mark the chunks covering @npages target pages from @start for clearing */
+static inline void clear_bmap_set(RAMBlock *rb, uint64_t start,
+                                  uint64_t npages)
+{
+    uint8_t shift = rb->clear_bmap_shift;
+    uint64_t first = start >> shift;
+    uint64_t last = (start + npages - 1) >> shift;
+
+    bitmap_set_atomic(rb->clear_bmap, first, last - first + 1);
+}
+
+/* Returns true if the chunk of @page had to be cleared */
+static inline bool clear_bmap_test_and_clear(RAMBlock *rb, uint64_t page)
+{
+    uint8_t shift = rb->clear_bmap_shift;
+
+    return bitmap_test_and_clear_atomic(rb->clear_bmap, page >> shift, 1);
+}
+
 static inline bool offset_in_ramblock(RAMBlock *b, ram_addr_t offset)
 {
     return (b && b->host && offset < b->used_length) ? true : false;
@@ -393,6 +428,15 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
     uint64_t num_dirty = 0;
     unsigned long *dest = rb->bmap;
 
+    /*
+     * The accelerator's dirty log is cleared chunk by chunk as migration
+     * sends the pages, rather than for the whole range here.
+     */
+    if (rb->clear_bmap && length) {
+        clear_bmap_set(rb, start >> TARGET_PAGE_BITS,
+                       length >> TARGET_PAGE_BITS);
+    }
+
     /* start address and length is aligned at the start of a word? */
     if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
          (start + rb->offset) &&
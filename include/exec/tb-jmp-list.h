@@ -0,0 +1,116 @@
+/*
+ * Lists of the jumps chained to a translation block.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef EXEC_TB_JMP_LIST_H
+#define EXEC_TB_JMP_LIST_H
+
+#include "qemu/atomic.h"
+
+/*
+ * A jump list is a singly-linked list of tagged pointers: each entry
+ * points to the origin of a jump, and its least significant bit tells
+ * which of the origin's two jumps it is, i.e. which of its two "next"
+ * words links to the following entry.
+ *
+ * Chaining a jump is the hot path, and pushes entries onto the list with
+ * a compare-and-swap on its head, without taking any lock.  Removals of
+ * single entries and closing the list are serialized by the caller with
+ * a lock, which pushes need not take, since they only ever modify the
+ * head of the list and the link of the entry being pushed.
+ *
+ * A closed list is empty and accepts no more entries; the list of a TB
+ * is closed when the TB is invalidated, and the closing thread owns the
+ * entries that were in it.
+ */
+#define TB_JMP_LIST_CLOSED ((uintptr_t)2)
+
+/* Return the address of the "next" word of @entry */
+typedef uintptr_t *TBJmpListNextFunc(uintptr_t entry);
+
+/**
+ * tb_jmp_list_push - add an entry to a jump list
+ * @head: the head of the list
+ * @entry: the tagged pointer to add
+ * @next: the "next" word of @entry
+ *
+ * Can be called concurrently with any other jump list operation.
+ * Returns false if the list has been closed, in which case @entry has
+ * not been added.
+ */
+static inline bool tb_jmp_list_push(uintptr_t *head, uintptr_t entry,
+                                    uintptr_t *next)
+{
+    uintptr_t old = atomic_read(head);
+
+    for (;;) {
+        uintptr_t prev;
+
+        if (unlikely(old == TB_JMP_LIST_CLOSED)) {
+            return false;
+        }
+        atomic_set(next, old);
+        /* the cmpxchg orders the store to @next before the new head */
+        prev = atomic_cmpxchg(head, old, entry);
+        if (prev == old) {
+            return true;
+        }
+        old = prev;
+    }
+}
+
+/**
+ * tb_jmp_list_close - close a jump list and take its entries
+ * @head: the head of the list
+ *
+ * Returns the first entry of the list, or 0 if it was empty or already
+ * closed.  The entries now belong to the caller.  Call with the list's
+ * lock held.
+ */
+static inline uintptr_t tb_jmp_list_close(uintptr_t *head)
+{
+    uintptr_t first = atomic_xchg(head, TB_JMP_LIST_CLOSED);
+
+    return first == TB_JMP_LIST_CLOSED ? 0 : first;
+}
+
+/**
+ * tb_jmp_list_remove - remove an entry from a jump list
+ * @head: the head of the list
+ * @entry: the entry to remove
+ * @next_of: returns the "next" word of an entry
+ *
+ * Returns false if @entry was not in the list.  Call with the list's lock
+ * held; new entries may be pushed concurrently.
+ */
+static inline bool tb_jmp_list_remove(uintptr_t *head, uintptr_t entry,
+                                      TBJmpListNextFunc *next_of)
+{
+    uintptr_t *pprev;
+    uintptr_t e;
+
+    e = atomic_read(head);
+    if (e == TB_JMP_LIST_CLOSED) {
+        return false;
+    }
+    if (e == entry) {
+        e = atomic_cmpxchg(head, entry, atomic_read(next_of(entry)));
+        if (e == entry) {
+            return true;
+        }
+        /* entries were pushed in front of @entry; look for it below */
+    }
+    while (e) {
+        pprev = next_of(e);
+        e = atomic_read(pprev);
+        if (e == entry) {
+            atomic_set(pprev, atomic_read(next_of(entry)));
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif /* EXEC_TB_JMP_LIST_H */
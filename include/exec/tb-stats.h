@@ -0,0 +1,77 @@
+/*
+ * Per-TranslationBlock execution and translation statistics
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef EXEC_TB_STATS_H
+#define EXEC_TB_STATS_H
+
+#include "exec/exec-all.h"
+#include "qemu/thread.h"
+
+/*
+ * Statistics are kept per guest block rather than per TranslationBlock,
+ * so that they accumulate across retranslations of the same code (after
+ * a tb_flush, or after the TB was invalidated by a write to its page).
+ * A block is identified by the same fields used to look up TBs in
+ * tb_ctx.htable, minus the cflags.
+ */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+
+    /*
+     * Incremented by the generated code on each execution of the block,
+     * and by cpu_tb_exec whenever execution leaves the block for the
+     * main loop instead of chaining to the next TB.  These updates are
+     * not atomic; with MTTCG some increments may be lost, which is fine
+     * for profiling purposes.
+     */
+    uint64_t exec_count;
+    uint64_t exit_count;
+
+    /* Translation statistics, protected by lock */
+    QemuSpin lock;
+    uint64_t translations;
+    uint64_t translate_time_ns;
+    /* The following are for the most recent translation */
+    uint32_t guest_insns;
+    uint32_t tcg_ops;
+    uint32_t host_code_size;
+    uint32_t spills;
+} TBStatistics;
+
+extern bool tb_stats_enabled;
+
+void tb_stats_init(void);
+
+/**
+ * tb_stats_get:
+ *
+ * Return the statistics entry for the guest block identified by
+ * @phys_pc, @pc, @cs_base and @flags, creating it if needed.  The
+ * entry is valid until QEMU exits.
+ */
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags);
+
+/**
+ * tb_stats_enable:
+ *
+ * Start or stop collecting statistics.  Since the execution counter
+ * is part of the generated code, this flushes the TB cache so that
+ * every block is retranslated with (or without) it.
+ */
+void tb_stats_enable(bool enable);
+
+/**
+ * tb_stats_reset:
+ *
+ * Clear the counters of every block seen so far.
+ */
+void tb_stats_reset(void);
+
+#endif
@@ -60,6 +60,12 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @sb_index: For superblocks, index of the block being translated in
+ *            tcg_ctx->sb_path.
+ * @sb_label: For superblocks, label that the current instruction branches
+ *            to in order to continue with the next block, or NULL.
+ * @sb_br: The branch to @sb_label.
+ * @sb_dest: Address of the next block.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -71,6 +77,10 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    int sb_index;
+    TCGLabel *sb_label;
+    TCGOp *sb_br;
+    target_ulong sb_dest;
 } DisasContextBase;
 
 /**
@@ -141,4 +151,79 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_lookup_and_goto_ptr:
+ * @db: Disassembly context.
+ * @pc: Guest pc of the destination.
+ * @flags: TB flags of the destination.
+ * @cs_base: cs_base of the destination.
+ * @is_return: The branch is a function return.
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), but first check inline whether a
+ * cached TB matches @pc, @flags and @cs_base, i.e. the values that
+ * cpu_get_tb_cpu_state() will return once the branch is taken.  The
+ * target must guarantee this; if it cannot compute them, it should use
+ * tcg_gen_lookup_and_goto_ptr() instead.
+ *
+ * In user-mode emulation, the candidate TB of a return is predicted with
+ * the return-address stack (see translator_push_return()), while other
+ * branches remember their last destination.  In system emulation the
+ * candidate comes from the vCPU's tb_jmp_cache.
+ */
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv pc,
+                                    TCGv_i32 flags, target_ulong cs_base,
+                                    bool is_return);
+
+/**
+ * translator_push_return:
+ * @db: Disassembly context.
+ * @ret_pc: Guest pc the call will return to.
+ *
+ * Emit code to push @ret_pc on the return-address stack of the vCPU.
+ * To be called by the target when translating a function call.
+ */
+void translator_push_return(DisasContextBase *db, target_ulong ret_pc);
+
+/**
+ * translator_add_successor:
+ * @db: Disassembly context.
+ * @pc: Guest pc of a direct branch target of this TB.
+ *
+ * Record @pc as a likely successor of the TB being translated, to be
+ * entered with the same cs_base and flags.  In user-mode emulation the
+ * successors may then be translated ahead of time by the TB workers.
+ * To be called by the target when emitting a direct jump to the next TB.
+ */
+void translator_add_successor(DisasContextBase *db, target_ulong pc);
+
+/**
+ * translator_superblock_continue:
+ * @db: Disassembly context.
+ * @dest: Guest pc of a direct branch target.
+ *
+ * When translating a superblock (CF_TRACE), check whether @dest is the
+ * next block on the hot path.  If so, emit a branch to the code that
+ * will be generated for it and return true; the target must then treat
+ * the exit as done, as if it had emitted a goto_tb to @dest, and update
+ * any private copy of the pc to @dest.  The instruction must not emit
+ * code that falls through to the next instruction.
+ *
+ * Otherwise, return false and let the target emit the exit as usual.
+ */
+bool translator_superblock_continue(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_use_goto_tb:
+ * @db: Disassembly context.
+ *
+ * Return false if exits emitted now must not use goto_tb.  A TB only has
+ * two goto_tb slots, so in a superblock only the exits of the last block
+ * are chained; side exits of the blocks before it take the slow path.
+ */
+static inline bool translator_use_goto_tb(DisasContextBase *db)
+{
+    return !(tb_cflags(db->tb) & CF_TRACE) ||
+        db->sb_index + 1 >= tcg_ctx->sb_path_len;
+}
+
 #endif  /* EXEC__TRANSLATOR_H */
@@ -81,6 +81,8 @@ int qemu_openpty_raw(int *aslave, char *pty_name);
 
 extern bool tcg_allowed;
 void tcg_exec_init(unsigned long tb_size);
+void tb_cache_enable(const char *path, size_t max_size, const char *config);
+void tb_cache_save(void);
 #ifdef CONFIG_TCG
 #define tcg_enabled() (tcg_allowed)
 #else
@@ -0,0 +1,90 @@
+/*
+ * 128-bit atomic operations, where the host has them.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_ATOMIC128_H
+#define QEMU_ATOMIC128_H
+
+#include "qemu/atomic.h"
+#include "qemu/int128.h"
+
+/*
+ * HAVE_CMPXCHG128 tells whether atomic16_cmpxchg() can be used, and
+ * HAVE_ATOMIC128 whether atomic16_read() and atomic16_set() can.  When
+ * they are false, callers must stop the world with cpu_loop_exit_atomic()
+ * instead: emulating the operations with a lock would not exclude the
+ * plain and narrower atomic accesses that other vCPUs make to the same
+ * bytes.
+ *
+ * With CONFIG_ATOMIC128 the compiler does them inline.  x86_64 hosts
+ * built without -mcx16 lack CONFIG_ATOMIC128, although nearly all of them
+ * have CMPXCHG16B, so there it is detected at startup.  It cannot be used
+ * for loads though, since it faults on read-only pages.
+ */
+#if defined(CONFIG_ATOMIC128)
+#define HAVE_CMPXCHG128 1
+
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    return atomic_cmpxchg__nocheck(ptr, cmp, new);
+}
+
+#elif defined(__x86_64__) && defined(CONFIG_INT128) && defined(CONFIG_CPUID_H)
+extern bool have_cmpxchg16b;
+#define HAVE_CMPXCHG128 have_cmpxchg16b
+
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    uint64_t lo = int128_getlo(cmp), hi = int128_gethi(cmp);
+
+    asm volatile("lock cmpxchg16b %0"
+                 : "+m"(*ptr), "+a"(lo), "+d"(hi)
+                 : "b"(int128_getlo(new)), "c"(int128_gethi(new))
+                 : "memory", "cc");
+    return int128_make128(lo, hi);
+}
+
+#else
+#define HAVE_CMPXCHG128 0
+
+/* Never called, since HAVE_CMPXCHG128 is false */
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    g_assert_not_reached();
+}
+#endif
+
+#if defined(CONFIG_ATOMIC128)
+#define HAVE_ATOMIC128 1
+
+static inline Int128 atomic16_read(Int128 *ptr)
+{
+    Int128 val;
+
+    __atomic_load(ptr, &val, __ATOMIC_RELAXED);
+    return val;
+}
+
+static inline void atomic16_set(Int128 *ptr, Int128 val)
+{
+    __atomic_store(ptr, &val, __ATOMIC_RELAXED);
+}
+
+#else
+#define HAVE_ATOMIC128 0
+
+/* Never called, since HAVE_ATOMIC128 is false */
+static inline Int128 atomic16_read(Int128 *ptr)
+{
+    g_assert_not_reached();
+}
+
+static inline void atomic16_set(Int128 *ptr, Int128 val)
+{
+    g_assert_not_reached();
+}
+#endif
+
+#endif /* QEMU_ATOMIC128_H */
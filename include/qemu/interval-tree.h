@@ -0,0 +1,97 @@
+/*
+ * Intrusive interval tree.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_INTERVAL_TREE_H
+#define QEMU_INTERVAL_TREE_H
+
+/*
+ * An interval tree keeps a set of closed intervals [start, last] and
+ * answers "which intervals overlap [a, b]?" in O(log n + k) time.
+ *
+ * Nodes are embedded in the caller's structures, so that insertion and
+ * removal never allocate memory; use container_of() to get from a node
+ * to its enclosing structure.  Several nodes may cover the same range.
+ *
+ * The tree is a treap ordered by start address, whose nodes are also
+ * annotated with the largest @last of their subtree.  The heap priority
+ * of a node is derived from its address, which keeps the tree balanced
+ * in expectation without a source of random numbers.
+ *
+ * No locking is done here; callers must serialize all accesses to a
+ * tree, including lookups.
+ */
+
+typedef struct IntervalTreeNode IntervalTreeNode;
+
+struct IntervalTreeNode {
+    uint64_t start;
+    uint64_t last;
+    /* private: */
+    uint64_t subtree_last;
+    uint32_t priority;
+    IntervalTreeNode *left;
+    IntervalTreeNode *right;
+};
+
+typedef struct IntervalTreeRoot {
+    IntervalTreeNode *root;
+} IntervalTreeRoot;
+
+static inline void interval_tree_init(IntervalTreeRoot *root)
+{
+    root->root = NULL;
+}
+
+static inline bool interval_tree_is_empty(const IntervalTreeRoot *root)
+{
+    return root->root == NULL;
+}
+
+/**
+ * interval_tree_insert - add a node to the tree
+ * @node: node to insert; the caller must set @node->start and @node->last
+ * @root: the tree
+ *
+ * @node must not already be in a tree.
+ */
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_remove - remove a node from the tree
+ * @node: node to remove, which must be in @root
+ * @root: the tree
+ */
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_iter_first - find the first node overlapping a range
+ * @root: the tree
+ * @start: first address of the range
+ * @last: last address of the range (inclusive)
+ *
+ * Returns the overlapping node with the lowest start address, or NULL
+ * if no node in @root overlaps [@start, @last].
+ */
+IntervalTreeNode *interval_tree_iter_first(const IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last);
+
+/**
+ * interval_tree_iter_next - find the next node overlapping a range
+ * @root: the tree
+ * @node: a node previously returned for the same range
+ * @start: first address of the range
+ * @last: last address of the range (inclusive)
+ *
+ * Returns the overlapping node that follows @node in tree order, or NULL.
+ * @node may have been removed from @root since it was returned, which
+ * allows removing each node as it is visited; other changes to the tree
+ * between the calls are not allowed.
+ */
+IntervalTreeNode *interval_tree_iter_next(const IntervalTreeRoot *root,
+                                          const IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last);
+
+#endif /* QEMU_INTERVAL_TREE_H */
@@ -27,6 +27,7 @@
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 
 typedef int (*WriteCoreDumpFunction)(const void *buf, size_t size,
@@ -75,6 +76,7 @@ typedef void (*CPUUnassignedAccess)(CPUState *cpu, hwaddr addr,
                                     unsigned size);
 
 struct TranslationBlock;
+struct TBBranchCache;
 
 /**
  * CPUClass:
@@ -242,14 +244,20 @@ struct CPUWatchpoint {
     QTAILQ_ENTRY(CPUWatchpoint) entry;
 };
 
+struct PhysSectionCache;
+
 struct KVMState;
 struct kvm_run;
+struct kvm_dirty_gfn;
 
 struct hax_vcpu_state;
 
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+#define TB_RAS_BITS 4
+#define TB_RAS_SIZE (1 << TB_RAS_BITS)
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -306,6 +314,9 @@ struct qemu_work_item;
  * @as: Pointer to the first AddressSpace, for the convenience of targets which
  *      only have a single AddressSpace
  * @env_ptr: Pointer to subclass-specific CPUArchState field.
+ * @tb_ras: Return-address stack for the indirect branch cache, see
+ *          translator_lookup_and_goto_ptr().
+ * @tb_ras_top: Index of the most recent entry in @tb_ras.
  * @gdb_regs: Additional GDB registers.
  * @gdb_num_regs: Number of total registers accessible to GDB.
  * @gdb_num_g_regs: Number of registers in GDB 'g' packets.
@@ -353,6 +364,14 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    /* Round-robin TCG scheduling, only accessed by the TCG thread */
+    uint64_t rr_state_hash;
+    int rr_weight;
+    int rr_quanta;
+    /* Multi-threaded icount, protected by the BQL */
+    int64_t quantum_left;
+    uint64_t quantum_epoch;
+    bool quantum_deferred;
     sigjmp_buf jmp_env;
 
     QemuMutex work_mutex;
@@ -368,6 +387,10 @@ struct CPUState {
     /* Accessed in parallel; all accesses must be atomic */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
 
+    /* Only accessed by this vCPU, and by tb_flush in an exclusive section */
+    struct TBBranchCache *tb_ras[TB_RAS_SIZE];
+    uint32_t tb_ras_top;
+
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
     int gdb_num_g_regs;
@@ -396,6 +419,8 @@ struct CPUState {
     int kvm_fd;
     struct KVMState *kvm_state;
     struct kvm_run *kvm_run;
+    struct kvm_dirty_gfn *kvm_dirty_gfns;
+    uint32_t kvm_fetch_index;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -414,6 +439,14 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Percentage of time this vCPU sleeps, 0 if it is not throttled */
+    int throttle_percentage;
+
+    /* Pages dirtied by this vCPU, if the accelerator can tell */
+    Stat64 dirty_pages;
+    /* Pages dirtied per second, estimated by migration from dirty_pages */
+    uint64_t dirty_pages_rate;
+    uint64_t dirty_pages_sampled;
 
     bool ignore_memory_transaction_failures;
 
@@ -438,6 +471,9 @@ struct CPUState {
 
     /* track IOMMUs whose translations we've cached in the TCG TLB */
     GArray *iommu_notifiers;
+
+    /* recent physical page lookups of this vCPU, see exec.c */
+    struct PhysSectionCache *phys_section_cache;
 };
 
 QTAILQ_HEAD(CPUTailQ, CPUState);
@@ -821,10 +857,22 @@ CPUState *cpu_by_arch_id(int64_t id);
  */
 void cpu_throttle_set(int new_throttle_pct);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vCPU to throttle.
+ * @new_throttle_pct: Percent of sleep time, 1 to 99, or 0 to stop
+ * throttling @cpu.
+ *
+ * Like cpu_throttle_set, but only throttles @cpu; the other vcpus keep
+ * their throttle percentage.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
 /**
  * cpu_throttle_stop:
  *
- * Stops the vcpu throttling started by cpu_throttle_set.
+ * Stops the vcpu throttling started by cpu_throttle_set and
+ * cpu_throttle_set_vcpu.
  */
 void cpu_throttle_stop(void);
 
@@ -839,11 +887,21 @@ bool cpu_throttle_active(void);
  * cpu_throttle_get_percentage:
  *
  * Returns the vcpu throttle percentage. See cpu_throttle_set for details.
+ * If vcpus are throttled differently, this is the highest of their
+ * percentages.
  *
  * Returns: The throttle percentage in range 1 to 99.
  */
 int cpu_throttle_get_percentage(void);
 
+/**
+ * cpu_throttle_get_vcpu_percentage:
+ * @cpu: The vCPU to query.
+ *
+ * Returns: The throttle percentage of @cpu, or 0 if it is not throttled.
+ */
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu);
+
 #ifndef CONFIG_USER_ONLY
 
 typedef void (*CPUInterruptHandler)(CPUState *, int);
@@ -18,9 +18,13 @@ typedef struct KVMSlot
     hwaddr start_addr;
     ram_addr_t memory_size;
     void *ram;
+    /* ram_addr_t of the start of the slot, for the dirty ring */
+    ram_addr_t ram_start_offset;
     int slot;
     int flags;
     int old_flags;
+    /* Dirty bitmap of the last KVM_GET_DIRTY_LOG, little endian */
+    unsigned long *dirty_bmap;
 } KVMSlot;
 
 typedef struct KVMMemoryListener {
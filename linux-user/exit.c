@@ -31,5 +31,6 @@ void preexit_cleanup(CPUArchState *env, int code)
 #ifdef CONFIG_GCOV
         __gcov_dump();
 #endif
+        tb_cache_user_save();
         gdb_exit(env, code);
 }
@@ -37,6 +37,8 @@
 #include "trace/control.h"
 #include "target_elf.h"
 #include "cpu_loop-common.h"
+#include "perf.h"
+#include "tb-worker.h"
 
 char *exec_path;
 
@@ -44,6 +46,7 @@ int singlestep;
 static const char *filename;
 static const char *argv0;
 static int gdbstub_port;
+static unsigned int tb_workers;
 static envlist_t *envlist;
 static const char *cpu_model;
 static const char *cpu_type;
@@ -114,11 +117,13 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_worker_fork_start();
     cpu_list_lock();
 }
 
 void fork_end(int child)
 {
+    tb_worker_fork_end(child);
     mmap_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
@@ -366,6 +371,31 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_perfmap(const char *arg)
+{
+    perf_enable_perfmap();
+}
+
+static void handle_arg_jitdump(const char *arg)
+{
+    perf_enable_jitdump();
+}
+
+static void handle_arg_tb_workers(const char *arg)
+{
+    tb_workers = atoi(arg);
+}
+
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_user_enable(arg);
+}
+
+static void handle_arg_superblock(const char *arg)
+{
+    tb_superblock_threshold = atoi(arg);
+}
+
 static void handle_arg_strace(const char *arg)
 {
     do_strace = 1;
@@ -432,6 +462,17 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "Generate a /tmp/perf-${pid}.map file for perf"},
+    {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
+     "",           "Generate a jit-${pid}.dump file for perf"},
+    {"tb-workers", "QEMU_TB_WORKERS",  true,  handle_arg_tb_workers,
+     "num",        "translate likely successor blocks in 'num' threads"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "share the code to translate ahead of time through 'dir'"},
+    {"superblock-threshold", "QEMU_SUPERBLOCK_THRESHOLD", true,
+     handle_arg_superblock,
+     "num",        "form superblocks out of blocks run 'num' times"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_randseed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
@@ -805,6 +846,12 @@ int main(int argc, char **argv, char **envp)
        the real value of GUEST_BASE into account.  */
     tcg_prologue_init(tcg_ctx);
     tcg_region_init();
+    if (tb_cache_user_enabled()) {
+        /* translating ahead of time is what the cache is for */
+        tb_workers = MAX(tb_workers, 1);
+    }
+    tb_worker_init(tb_workers);
+    tb_cache_user_start(cpu);
 
     target_cpu_copy_regs(env, regs);
 
@@ -17,6 +17,7 @@
  *  along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 #include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
 
 #include "qemu.h"
 #include "qemu-common.h"
@@ -26,6 +27,29 @@
 static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
 static __thread int mmap_lock_count;
 
+/*
+ * Range locks over the guest address space.
+ *
+ * mmap_lock protects the page flags and the translated code, but the host
+ * system calls that change the mappings need not run under it: it is enough
+ * that no other thread changes an overlapping range in the meantime.  So
+ * target_mmap and friends take mmap_lock, lock the host pages they are going
+ * to change, drop mmap_lock around the expensive host calls, and retake it
+ * to update the page flags.  Operations on disjoint ranges run in parallel.
+ *
+ * The held ranges are kept in an interval tree protected by mmap_mutex.
+ * Ranges held by the current thread never conflict, so that a thread that
+ * already holds a range (or mmap_lock, e.g. the ELF loader) may call back
+ * into target_mmap; such nested calls keep mmap_lock for their duration.
+ */
+typedef struct MMapRange {
+    IntervalTreeNode node;
+    const void *owner;
+} MMapRange;
+
+static IntervalTreeRoot mmap_ranges;
+static pthread_cond_t mmap_ranges_cond = PTHREAD_COND_INITIALIZER;
+
 void mmap_lock(void)
 {
     if (mmap_lock_count++ == 0) {
@@ -45,26 +69,97 @@ bool have_mmap_lock(void)
     return mmap_lock_count > 0 ? true : false;
 }
 
+/* Return true if another thread holds a range overlapping [start, last] */
+static bool mmap_range_busy(abi_ulong start, abi_ulong last)
+{
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&mmap_ranges, start, last);
+         node;
+         node = interval_tree_iter_next(&mmap_ranges, node, start, last)) {
+        MMapRange *range = container_of(node, MMapRange, node);
+
+        if (range->owner != &mmap_lock_count) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Called with mmap_lock held; waits for conflicting ranges to be unlocked */
+static void mmap_range_lock(MMapRange *range, abi_ulong start, abi_ulong last)
+{
+    assert(have_mmap_lock());
+    while (mmap_range_busy(start, last)) {
+        /* only the outermost mmap_lock can be dropped while waiting */
+        assert(mmap_lock_count == 1);
+        pthread_cond_wait(&mmap_ranges_cond, &mmap_mutex);
+    }
+    range->node.start = start;
+    range->node.last = last;
+    range->owner = &mmap_lock_count;
+    interval_tree_insert(&range->node, &mmap_ranges);
+}
+
+/* Called with mmap_lock held; does nothing if @range is not locked */
+static void mmap_range_unlock(MMapRange *range)
+{
+    assert(have_mmap_lock());
+    if (range->owner) {
+        interval_tree_remove(&range->node, &mmap_ranges);
+        range->owner = NULL;
+        pthread_cond_broadcast(&mmap_ranges_cond);
+    }
+}
+
+/*
+ * Drop mmap_lock around a host system call, unless it is held by a caller
+ * further up the stack.  Because the page flags can change meanwhile, the
+ * caller must have locked the range that the system call affects.
+ */
+static bool mmap_lock_pause(void)
+{
+    if (mmap_lock_count != 1) {
+        return false;
+    }
+    mmap_unlock();
+    return true;
+}
+
+static void mmap_lock_resume(bool paused)
+{
+    if (paused) {
+        mmap_lock();
+    }
+}
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
     if (mmap_lock_count)
         abort();
     pthread_mutex_lock(&mmap_mutex);
+    /* the child would not see the threads that hold ranges unlock them */
+    while (!interval_tree_is_empty(&mmap_ranges)) {
+        pthread_cond_wait(&mmap_ranges_cond, &mmap_mutex);
+    }
 }
 
 void mmap_fork_end(int child)
 {
-    if (child)
+    if (child) {
         pthread_mutex_init(&mmap_mutex, NULL);
-    else
+        pthread_cond_init(&mmap_ranges_cond, NULL);
+    } else {
         pthread_mutex_unlock(&mmap_mutex);
+    }
 }
 
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
 int target_mprotect(abi_ulong start, abi_ulong len, int prot)
 {
     abi_ulong end, host_start, host_end, addr;
+    MMapRange range = { };
     int prot1, ret;
 
 #ifdef DEBUG_MMAP
@@ -89,6 +184,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
     mmap_lock();
     host_start = start & qemu_host_page_mask;
     host_end = HOST_PAGE_ALIGN(end);
+    mmap_range_lock(&range, host_start, host_end - 1);
     if (start > host_start) {
         /* handle host page containing start */
         prot1 = prot;
@@ -120,14 +216,24 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
 
     /* handle the pages in the middle */
     if (host_start < host_end) {
+        unsigned int protect_count = page_protect_count();
+        bool paused = mmap_lock_pause();
+
         ret = mprotect(g2h(host_start), host_end - host_start, prot);
+        mmap_lock_resume(paused);
         if (ret != 0)
             goto error;
+        if (page_protect_count() != protect_count) {
+            /* code pages may have been write-protected meanwhile */
+            mprotect(g2h(host_start), host_end - host_start, prot);
+        }
     }
     page_set_flags(start, start + len, prot | PAGE_VALID);
+    mmap_range_unlock(&range);
     mmap_unlock();
     return 0;
 error:
+    mmap_range_unlock(&range);
     mmap_unlock();
     return ret;
 }
@@ -231,7 +337,8 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
             continue;
         }
         prot = page_get_flags(addr);
-        if (prot) {
+        /* a range being mapped may not have its flags set yet */
+        if (prot || mmap_range_busy(addr, addr + qemu_host_page_size - 1)) {
             end_addr = addr;
         }
         if (addr && addr + size == end_addr) {
@@ -357,11 +464,51 @@ abi_ulong mmap_find_vma(abi_ulong start, abi_ulong size)
     }
 }
 
+/*
+ * Large anonymous mappings are aligned so that the host can back them with
+ * transparent huge pages, which saves page faults and TLB misses on guests
+ * that allocate a lot of memory.
+ */
+#define MMAP_HUGE_ALIGN QEMU_VMALLOC_ALIGN
+
+static bool mmap_want_huge_pages(abi_ulong len, int flags)
+{
+    return QEMU_MADV_HUGEPAGE != QEMU_MADV_INVALID &&
+           MMAP_HUGE_ALIGN > qemu_host_page_size &&
+           len >= MMAP_HUGE_ALIGN &&
+           (flags & MAP_ANONYMOUS) && (flags & MAP_TYPE) == MAP_PRIVATE;
+}
+
+/* Like mmap_find_vma, but the host address is aligned to MMAP_HUGE_ALIGN */
+static abi_ulong mmap_find_vma_huge(abi_ulong start, abi_ulong size)
+{
+    abi_ulong padded = size + MMAP_HUGE_ALIGN - qemu_host_page_size;
+    abi_ulong addr, aligned;
+
+    addr = mmap_find_vma(start, padded);
+    if (addr == (abi_ulong)-1) {
+        /* settle for a mapping without huge pages */
+        return mmap_find_vma(start, size);
+    }
+    aligned = h2g(ROUND_UP((uintptr_t)g2h(addr), MMAP_HUGE_ALIGN));
+    if (!reserved_va) {
+        /* give back the parts of the reservation that are not needed */
+        if (aligned > addr) {
+            munmap(g2h(addr), aligned - addr);
+        }
+        if (aligned + size < addr + padded) {
+            munmap(g2h(aligned + size), addr + padded - (aligned + size));
+        }
+    }
+    return aligned;
+}
+
 /* NOTE: all the constants are the HOST ones */
 abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
                      int flags, int fd, abi_ulong offset)
 {
     abi_ulong ret, end, real_start, real_end, retaddr, host_offset, host_len;
+    MMapRange range = { };
 
     mmap_lock();
 #ifdef DEBUG_MMAP
@@ -416,11 +563,16 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
     if (!(flags & MAP_FIXED)) {
         host_len = len + offset - host_offset;
         host_len = HOST_PAGE_ALIGN(host_len);
-        start = mmap_find_vma(real_start, host_len);
+        if (mmap_want_huge_pages(host_len, flags)) {
+            start = mmap_find_vma_huge(real_start, host_len);
+        } else {
+            start = mmap_find_vma(real_start, host_len);
+        }
         if (start == (abi_ulong)-1) {
             errno = ENOMEM;
             goto fail;
         }
+        mmap_range_lock(&range, start, start + host_len - 1);
     }
 
     /* When mapping files into a memory area larger than the file, accesses
@@ -453,6 +605,7 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
 
     if (!(flags & MAP_FIXED)) {
         unsigned long host_start;
+        bool paused;
         void *p;
 
         host_len = len + offset - host_offset;
@@ -461,19 +614,24 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
         /* Note: we prefer to control the mapping address. It is
            especially important if qemu_host_page_size >
            qemu_real_host_page_size */
+        paused = mmap_lock_pause();
         p = mmap(g2h(start), host_len, prot,
                  flags | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED && !(flags & MAP_ANONYMOUS)) {
+            if (mmap(g2h(start), len, prot,
+                     flags | MAP_FIXED, fd, host_offset) == MAP_FAILED) {
+                munmap(g2h(start), host_len);
+                p = MAP_FAILED;
+            }
+        } else if (p != MAP_FAILED && mmap_want_huge_pages(host_len, flags)) {
+            qemu_madvise(p, host_len, QEMU_MADV_HUGEPAGE);
+        }
+        mmap_lock_resume(paused);
         if (p == MAP_FAILED)
             goto fail;
         /* update start so that it points to the file position at 'offset' */
         host_start = (unsigned long)p;
         if (!(flags & MAP_ANONYMOUS)) {
-            p = mmap(g2h(start), len, prot,
-                     flags | MAP_FIXED, fd, host_offset);
-            if (p == MAP_FAILED) {
-                munmap(g2h(start), host_len);
-                goto fail;
-            }
             host_start += offset - host_offset;
         }
         start = h2g(host_start);
@@ -494,6 +652,7 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
             errno = ENOMEM;
             goto fail;
         }
+        mmap_range_lock(&range, real_start, real_end - 1);
 
         /* worst case: we cannot map the file because the offset is not
            aligned, so we read it */
@@ -549,16 +708,24 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
 
         /* map the middle (easier) */
         if (real_start < real_end) {
+            unsigned int protect_count = page_protect_count();
+            bool paused;
             void *p;
             unsigned long offset1;
             if (flags & MAP_ANONYMOUS)
                 offset1 = 0;
             else
                 offset1 = offset + real_start - start;
+            paused = mmap_lock_pause();
             p = mmap(g2h(real_start), real_end - real_start,
                      prot, flags, fd, offset1);
+            mmap_lock_resume(paused);
             if (p == MAP_FAILED)
                 goto fail;
+            if (page_protect_count() != protect_count) {
+                /* code pages may have been write-protected meanwhile */
+                mprotect(p, real_end - real_start, prot);
+            }
         }
     }
  the_end1:
@@ -569,10 +736,16 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
     page_dump(stdout);
     printf("\n");
 #endif
+    tb_cache_user_unmap(start, len);
+    if ((prot & PROT_EXEC) && !(flags & MAP_ANONYMOUS)) {
+        tb_cache_user_map(start, len, fd, offset);
+    }
     tb_invalidate_phys_range(start, start + len);
+    mmap_range_unlock(&range);
     mmap_unlock();
     return start;
 fail:
+    mmap_range_unlock(&range);
     mmap_unlock();
     return -1;
 }
@@ -621,6 +794,7 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
 int target_munmap(abi_ulong start, abi_ulong len)
 {
     abi_ulong end, real_start, real_end, addr;
+    MMapRange range = { };
     int prot, ret;
 
 #ifdef DEBUG_MMAP
@@ -639,6 +813,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
     end = start + len;
     real_start = start & qemu_host_page_mask;
     real_end = HOST_PAGE_ALIGN(end);
+    mmap_range_lock(&range, real_start, real_end - 1);
 
     if (start > real_start) {
         /* handle host page containing start */
@@ -667,17 +842,27 @@ int target_munmap(abi_ulong start, abi_ulong len)
     ret = 0;
     /* unmap what we can */
     if (real_start < real_end) {
+        unsigned int protect_count = page_protect_count();
+        bool paused = mmap_lock_pause();
+
         if (reserved_va) {
             mmap_reserve(real_start, real_end - real_start);
         } else {
             ret = munmap(g2h(real_start), real_end - real_start);
         }
+        mmap_lock_resume(paused);
+        if (reserved_va && page_protect_count() != protect_count) {
+            /* the reservation may have been made accessible meanwhile */
+            mmap_reserve(real_start, real_end - real_start);
+        }
     }
 
     if (ret == 0) {
         page_set_flags(start, start + len, 0);
+        tb_cache_user_unmap(start, len);
         tb_invalidate_phys_range(start, start + len);
     }
+    mmap_range_unlock(&range);
     mmap_unlock();
     return ret;
 }
@@ -686,6 +871,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
                        abi_ulong new_size, unsigned long flags,
                        abi_ulong new_addr)
 {
+    MMapRange range = { };
     int prot;
     void *host_addr;
 
@@ -697,6 +883,8 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
     }
 
     mmap_lock();
+    /* mremap is rare, so it simply waits for all other changes to finish */
+    mmap_range_lock(&range, 0, (abi_ulong)-1);
 
     if (flags & MREMAP_FIXED) {
         host_addr = mremap(g2h(old_addr), old_size, new_size,
@@ -756,9 +944,11 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         new_addr = h2g(host_addr);
         prot = page_get_flags(old_addr);
         page_set_flags(old_addr, old_addr + old_size, 0);
+        tb_cache_user_unmap(old_addr, old_size);
         page_set_flags(new_addr, new_addr + new_size, prot | PAGE_VALID);
     }
     tb_invalidate_phys_range(new_addr, new_addr + new_size);
+    mmap_range_unlock(&range);
     mmap_unlock();
     return new_addr;
 }
@@ -443,6 +443,15 @@ abi_ulong mmap_find_vma(abi_ulong, abi_ulong);
 void mmap_fork_start(void);
 void mmap_fork_end(int child);
 
+/* tb-cache.c */
+void tb_cache_user_enable(const char *dir);
+bool tb_cache_user_enabled(void);
+void tb_cache_user_start(CPUState *cpu);
+void tb_cache_user_map(abi_ulong start, abi_ulong len, int fd,
+                       abi_ulong offset);
+void tb_cache_user_unmap(abi_ulong start, abi_ulong len);
+void tb_cache_user_save(void);
+
 /* main.c */
 extern unsigned long guest_stack_size;
 
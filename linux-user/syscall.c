@@ -7013,6 +7013,203 @@ _syscall1(int, sys_setgid, gid_t, gid)
 _syscall3(int, sys_setresuid, uid_t, ruid, uid_t, euid, uid_t, suid)
 _syscall3(int, sys_setresgid, gid_t, rgid, gid_t, egid, gid_t, sgid)
 
+/*
+ * Syscall passthrough.
+ *
+ * When the guest and host ABIs agree on word size and endianness, the I/O
+ * syscalls below need no conversion other than g2h for the buffers they
+ * point to.  They are looked up in a table and issued to the host kernel
+ * directly, instead of going through the big switch in do_syscall, and
+ * small iovec arrays are converted on the stack instead of the heap.
+ * Guest buffers are still checked with access_ok, which also unprotects
+ * pages that hold translated code before the kernel writes to them.
+ *
+ * Anything unusual (fds with a data translator, invalid or large iovec
+ * arrays, bad buffers) falls back to do_syscall, which produces the error.
+ */
+#if TARGET_ABI_BITS == HOST_LONG_BITS && \
+    defined(TARGET_WORDS_BIGENDIAN) == defined(HOST_WORDS_BIGENDIAN)
+#define SYSCALL_PASSTHROUGH
+#endif
+
+#ifdef SYSCALL_PASSTHROUGH
+typedef enum {
+    SP_VAL,             /* passed as is */
+    SP_FD,              /* file descriptor */
+    SP_BUF_IN,          /* buffer read by the kernel, length in next arg */
+    SP_BUF_OUT,         /* buffer written by the kernel, length in next arg */
+    SP_IOV_IN,          /* iovec array read by the kernel, count in next arg */
+    SP_IOV_OUT,         /* iovec array written by the kernel, ditto */
+} SyscallPassthroughArg;
+
+typedef struct SyscallPassthrough {
+    int target_nr;
+    int host_nr;
+    int nargs;
+    SyscallPassthroughArg args[6];
+} SyscallPassthrough;
+
+static const SyscallPassthrough syscall_passthrough_list[] = {
+#if defined(TARGET_NR_read) && defined(__NR_read)
+    { TARGET_NR_read, __NR_read, 3, { SP_FD, SP_BUF_OUT, SP_VAL } },
+#endif
+#if defined(TARGET_NR_write) && defined(__NR_write)
+    { TARGET_NR_write, __NR_write, 3, { SP_FD, SP_BUF_IN, SP_VAL } },
+#endif
+    /*
+     * 32-bit ABIs split the offset across two registers, with padding on
+     * some (see regpairs_aligned), so leave them to do_syscall.
+     */
+#if TARGET_ABI_BITS == 64
+#if defined(TARGET_NR_pread64) && defined(__NR_pread64)
+    { TARGET_NR_pread64, __NR_pread64, 4,
+      { SP_FD, SP_BUF_OUT, SP_VAL, SP_VAL } },
+#endif
+#if defined(TARGET_NR_pwrite64) && defined(__NR_pwrite64)
+    { TARGET_NR_pwrite64, __NR_pwrite64, 4,
+      { SP_FD, SP_BUF_IN, SP_VAL, SP_VAL } },
+#endif
+#endif
+#if defined(TARGET_NR_readv) && defined(__NR_readv)
+    { TARGET_NR_readv, __NR_readv, 3, { SP_FD, SP_IOV_OUT, SP_VAL } },
+#endif
+#if defined(TARGET_NR_writev) && defined(__NR_writev)
+    { TARGET_NR_writev, __NR_writev, 3, { SP_FD, SP_IOV_IN, SP_VAL } },
+#endif
+#if defined(TARGET_NR_preadv) && defined(__NR_preadv)
+    { TARGET_NR_preadv, __NR_preadv, 5,
+      { SP_FD, SP_IOV_OUT, SP_VAL, SP_VAL, SP_VAL } },
+#endif
+#if defined(TARGET_NR_pwritev) && defined(__NR_pwritev)
+    { TARGET_NR_pwritev, __NR_pwritev, 5,
+      { SP_FD, SP_IOV_IN, SP_VAL, SP_VAL, SP_VAL } },
+#endif
+};
+
+/* larger iovec arrays go through lock_iovec */
+#define SYSCALL_PASSTHROUGH_IOV 8
+
+/* indexed by target syscall number */
+static const SyscallPassthrough **syscall_passthrough;
+static int syscall_passthrough_max;
+
+static void syscall_passthrough_init(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(syscall_passthrough_list); i++) {
+        syscall_passthrough_max = MAX(syscall_passthrough_max,
+                                      syscall_passthrough_list[i].target_nr + 1);
+    }
+    syscall_passthrough = g_new0(const SyscallPassthrough *,
+                                 syscall_passthrough_max);
+    for (i = 0; i < ARRAY_SIZE(syscall_passthrough_list); i++) {
+        const SyscallPassthrough *sp = &syscall_passthrough_list[i];
+
+        syscall_passthrough[sp->target_nr] = sp;
+    }
+}
+
+/*
+ * Fill @vec with the host version of the @count target_iovecs at
+ * @target_addr.  Return false if do_syscall should handle them instead.
+ */
+static bool syscall_passthrough_iovec(struct iovec *vec, int type,
+                                      abi_ulong target_addr, abi_long count)
+{
+    struct target_iovec *target_vec;
+    bool ok = true;
+    int i;
+
+    if (count < 0 || count > SYSCALL_PASSTHROUGH_IOV) {
+        return false;
+    }
+    target_vec = lock_user(VERIFY_READ, target_addr,
+                           count * sizeof(struct target_iovec), 1);
+    if (target_vec == NULL) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        abi_ulong base = tswapal(target_vec[i].iov_base);
+        abi_long len = tswapal(target_vec[i].iov_len);
+
+        if (len < 0 || (len && !access_ok(type, base, len))) {
+            ok = false;
+            break;
+        }
+        vec[i].iov_base = len ? g2h(base) : NULL;
+        vec[i].iov_len = len;
+    }
+    unlock_user(target_vec, target_addr, 0);
+    return ok;
+}
+
+/*
+ * Issue syscall @num directly to the host if it is in the passthrough
+ * table.  Return false if it must go through do_syscall.
+ */
+static bool do_syscall_passthrough(int num, abi_long *ret,
+                                   abi_long arg1, abi_long arg2,
+                                   abi_long arg3, abi_long arg4,
+                                   abi_long arg5, abi_long arg6)
+{
+    const abi_long args[6] = { arg1, arg2, arg3, arg4, arg5, arg6 };
+    const SyscallPassthrough *sp;
+    struct iovec vec[SYSCALL_PASSTHROUGH_IOV];
+    long host_args[6] = { };
+    int i;
+
+    if (num < 0 || num >= syscall_passthrough_max) {
+        return false;
+    }
+    sp = syscall_passthrough[num];
+    if (sp == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < sp->nargs; i++) {
+        abi_long arg = args[i];
+
+        switch (sp->args[i]) {
+        case SP_VAL:
+            host_args[i] = arg;
+            break;
+        case SP_FD:
+            if (fd_trans_target_to_host_data(arg) ||
+                fd_trans_host_to_target_data(arg)) {
+                return false;
+            }
+            host_args[i] = arg;
+            break;
+        case SP_BUF_IN:
+        case SP_BUF_OUT:
+            if (!access_ok(sp->args[i] == SP_BUF_IN ? VERIFY_READ : VERIFY_WRITE,
+                           arg, args[i + 1])) {
+                return false;
+            }
+            host_args[i] = (long)g2h(arg);
+            break;
+        case SP_IOV_IN:
+        case SP_IOV_OUT:
+            if (!syscall_passthrough_iovec(vec, sp->args[i] == SP_IOV_IN ?
+                                           VERIFY_READ : VERIFY_WRITE,
+                                           arg, args[i + 1])) {
+                return false;
+            }
+            host_args[i] = (long)vec;
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+
+    *ret = get_errno(safe_syscall(sp->host_nr, host_args[0], host_args[1],
+                                  host_args[2], host_args[3], host_args[4],
+                                  host_args[5]));
+    return true;
+}
+#endif /* SYSCALL_PASSTHROUGH */
+
 void syscall_init(void)
 {
     IOCTLEntry *ie;
@@ -7063,6 +7260,10 @@ void syscall_init(void)
 #endif
         ie++;
     }
+
+#ifdef SYSCALL_PASSTHROUGH
+    syscall_passthrough_init();
+#endif
 }
 
 #if TARGET_ABI_BITS == 32
@@ -8033,6 +8234,12 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
     if(do_strace)
         print_syscall(num, arg1, arg2, arg3, arg4, arg5, arg6);
 
+#ifdef SYSCALL_PASSTHROUGH
+    if (do_syscall_passthrough(num, &ret, arg1, arg2, arg3, arg4, arg5, arg6)) {
+        goto fail;
+    }
+#endif
+
     switch(num) {
     case TARGET_NR_exit:
         /* In old applications this may be used to implement _exit(2).
@@ -8298,6 +8505,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
              * before the execve completes and makes it the other
              * program's problem.
              */
+            tb_cache_user_save();
             ret = get_errno(safe_execve(p, argp, envp));
             unlock_user(p, arg1, 0);
 
@@ -0,0 +1,349 @@
+/*
+ * Translation cache shared between linux-user processes
+ *
+ * Build farms start many short-lived processes that run the same programs,
+ * and each of them translates the same code from scratch.  The generated
+ * code itself cannot be shared between processes: it is not position
+ * independent, and QEMU, code_gen_buffer and the guest libraries all end
+ * up at different addresses in each of them.  What can be shared is which
+ * code gets run.
+ *
+ * For every executable file mapping we record the TBs translated from it,
+ * as offsets from the start of the mapping plus the CPU state they were
+ * translated for, in a file of the cache directory.  The file is named
+ * after a hash of the identity of the mapped file, the file offset of the
+ * mapping and a sample of its contents.  When a later process maps the
+ * same code, the TB workers translate the recorded TBs ahead of time, so
+ * that the vCPU finds most of its code already translated.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu-version.h"
+#include "qemu.h"
+#include "exec/exec-all.h"
+#include "tcg.h"
+#include "tb-worker.h"
+
+#define TB_CACHE_MAGIC "QEMUTBH"
+#define TB_CACHE_VERSION 1
+/* bytes hashed at each end of a mapping */
+#define TB_CACHE_SAMPLE_SIZE 4096
+#define TB_CACHE_MAX_RECORDS (64 * 1024)
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_records;
+} TBCacheHeader;
+
+typedef struct TBCacheRecord {
+    uint64_t offset;        /* of the TB's pc from the start of the mapping */
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBCacheRecord;
+
+typedef struct TBCacheMapping {
+    /* guest address of the start of the mapping, which records refer to */
+    abi_ulong base;
+    /* part of the mapping that is still there */
+    abi_ulong start;
+    abi_ulong end;
+    char *path;
+    GArray *records;        /* read from @path, then added to at exit */
+    bool prefetched;
+    QLIST_ENTRY(TBCacheMapping) entry;
+} TBCacheMapping;
+
+static struct {
+    char *dir;
+    /* set once the TB workers are running */
+    CPUState *cpu;
+    /* protected by mmap_lock */
+    QLIST_HEAD(, TBCacheMapping) mappings;
+} tb_cache;
+
+void tb_cache_user_enable(const char *dir)
+{
+    if (g_mkdir_with_parents(dir, 0755)) {
+        warn_report("Could not create TB cache directory %s: %s", dir,
+                    strerror(errno));
+        return;
+    }
+    tb_cache.dir = g_strdup(dir);
+}
+
+bool tb_cache_user_enabled(void)
+{
+    return tb_cache.dir != NULL;
+}
+
+static void tb_cache_hash_sample(GChecksum *sum, int fd, off_t offset,
+                                 size_t len)
+{
+    uint8_t buf[TB_CACHE_SAMPLE_SIZE];
+    ssize_t n = pread(fd, buf, MIN(len, sizeof(buf)), offset);
+
+    if (n > 0) {
+        g_checksum_update(sum, buf, n);
+    }
+}
+
+/* Return the path of the cache file for a mapping of @fd */
+static char *tb_cache_path(int fd, abi_ulong offset, abi_ulong len)
+{
+    const char *id = QEMU_VERSION QEMU_PKGVERSION " " TARGET_NAME;
+    GChecksum *sum;
+    struct stat st;
+    uint64_t file_id[8];
+    char *path;
+
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    file_id[0] = st.st_dev;
+    file_id[1] = st.st_ino;
+    file_id[2] = st.st_size;
+    file_id[3] = st.st_mtim.tv_sec;
+    file_id[4] = st.st_mtim.tv_nsec;
+    file_id[5] = st.st_ctim.tv_sec;
+    file_id[6] = st.st_ctim.tv_nsec;
+    file_id[7] = offset;
+
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sum, (const guchar *)id, strlen(id));
+    g_checksum_update(sum, (const guchar *)file_id, sizeof(file_id));
+    /* in case the file was rewritten in place with the same times */
+    tb_cache_hash_sample(sum, fd, offset, len);
+    if (len > TB_CACHE_SAMPLE_SIZE) {
+        tb_cache_hash_sample(sum, fd, offset + len - TB_CACHE_SAMPLE_SIZE,
+                             TB_CACHE_SAMPLE_SIZE);
+    }
+    path = g_strdup_printf("%s/%s.tbh", tb_cache.dir,
+                           g_checksum_get_string(sum));
+    g_checksum_free(sum);
+    return path;
+}
+
+static void tb_cache_read(TBCacheMapping *m)
+{
+    TBCacheHeader h;
+    uint32_t i;
+    FILE *f;
+
+    f = fopen(m->path, "rb");
+    if (f == NULL) {
+        return;
+    }
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, TB_CACHE_MAGIC, sizeof(h.magic)) ||
+        h.version != TB_CACHE_VERSION ||
+        h.nb_records > TB_CACHE_MAX_RECORDS) {
+        goto out;
+    }
+    for (i = 0; i < h.nb_records; i++) {
+        TBCacheRecord r;
+
+        if (fread(&r, sizeof(r), 1, f) != 1) {
+            break;
+        }
+        if (r.offset < m->end - m->base) {
+            g_array_append_val(m->records, r);
+        }
+    }
+ out:
+    fclose(f);
+}
+
+/* Hand the recorded TBs of @m to the workers; called with mmap_lock held */
+static void tb_cache_prefetch(TBCacheMapping *m)
+{
+    TBWorkerPrefetch *tbs;
+    guint i;
+
+    if (tb_cache.cpu == NULL || m->prefetched || m->records->len == 0) {
+        return;
+    }
+    m->prefetched = true;
+    tbs = g_new(TBWorkerPrefetch, m->records->len);
+    for (i = 0; i < m->records->len; i++) {
+        TBCacheRecord *r = &g_array_index(m->records, TBCacheRecord, i);
+
+        tbs[i].pc = m->base + r->offset;
+        tbs[i].cs_base = r->cs_base;
+        tbs[i].flags = r->flags;
+        tbs[i].cflags = r->cflags;
+    }
+    tb_worker_prefetch(tb_cache.cpu, tbs, m->records->len);
+}
+
+void tb_cache_user_start(CPUState *cpu)
+{
+    TBCacheMapping *m;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    object_ref(OBJECT(cpu));
+    mmap_lock();
+    tb_cache.cpu = cpu;
+    QLIST_FOREACH(m, &tb_cache.mappings, entry) {
+        tb_cache_prefetch(m);
+    }
+    mmap_unlock();
+}
+
+void tb_cache_user_map(abi_ulong start, abi_ulong len, int fd,
+                       abi_ulong offset)
+{
+    TBCacheMapping *m;
+    char *path;
+
+    assert(have_mmap_lock());
+    if (!tb_cache.dir) {
+        return;
+    }
+    path = tb_cache_path(fd, offset, len);
+    if (path == NULL) {
+        return;
+    }
+    m = g_new0(TBCacheMapping, 1);
+    m->base = start;
+    m->start = start;
+    m->end = start + len;
+    m->path = path;
+    m->records = g_array_new(false, false, sizeof(TBCacheRecord));
+    tb_cache_read(m);
+    QLIST_INSERT_HEAD(&tb_cache.mappings, m, entry);
+    tb_cache_prefetch(m);
+}
+
+static void tb_cache_mapping_free(TBCacheMapping *m)
+{
+    QLIST_REMOVE(m, entry);
+    g_array_free(m->records, true);
+    g_free(m->path);
+    g_free(m);
+}
+
+void tb_cache_user_unmap(abi_ulong start, abi_ulong len)
+{
+    abi_ulong end = start + len;
+    TBCacheMapping *m, *next;
+
+    assert(have_mmap_lock());
+    QLIST_FOREACH_SAFE(m, &tb_cache.mappings, entry, next) {
+        if (end <= m->start || start >= m->end) {
+            continue;
+        }
+        /*
+         * ld.so maps whole libraries and then maps the data segment over
+         * the end, so keep what remains below the hole if anything does.
+         */
+        if (start > m->start) {
+            m->end = start;
+        } else if (end < m->end) {
+            m->start = end;
+        } else {
+            tb_cache_mapping_free(m);
+        }
+    }
+}
+
+static gboolean tb_cache_collect(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    uint32_t cflags = tb_cflags(tb);
+    TBCacheMapping *m;
+
+    if (cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE | CF_INVALID |
+                  CF_TRACE)) {
+        return false;
+    }
+    QLIST_FOREACH(m, &tb_cache.mappings, entry) {
+        if (tb->pc >= m->start && tb->pc < m->end) {
+            TBCacheRecord r = {
+                .offset = tb->pc - m->base,
+                .cs_base = tb->cs_base,
+                .flags = tb->flags,
+                .cflags = cflags & CF_HASH_MASK,
+            };
+
+            if (m->records->len < TB_CACHE_MAX_RECORDS) {
+                g_array_append_val(m->records, r);
+            }
+            break;
+        }
+    }
+    return false;
+}
+
+static gint tb_cache_record_cmp(gconstpointer ap, gconstpointer bp)
+{
+    return memcmp(ap, bp, sizeof(TBCacheRecord));
+}
+
+static void tb_cache_write(TBCacheMapping *m)
+{
+    TBCacheHeader h;
+    TBCacheRecord *prev = NULL;
+    char *tmp;
+    FILE *f;
+    guint i;
+    bool ok;
+
+    if (m->records->len == 0) {
+        return;
+    }
+    /* drop the TBs that were both reloaded and translated again */
+    g_array_sort(m->records, tb_cache_record_cmp);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TB_CACHE_MAGIC, sizeof(h.magic));
+    h.version = TB_CACHE_VERSION;
+
+    /* Write to a temporary file, so that concurrent runs see a whole file */
+    tmp = g_strdup_printf("%s.%d", m->path, getpid());
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        g_free(tmp);
+        return;
+    }
+    fseek(f, sizeof(h), SEEK_SET);
+    for (i = 0; i < m->records->len; i++) {
+        TBCacheRecord *r = &g_array_index(m->records, TBCacheRecord, i);
+
+        if (prev && !tb_cache_record_cmp(prev, r)) {
+            continue;
+        }
+        if (fwrite(r, sizeof(*r), 1, f) != 1) {
+            break;
+        }
+        h.nb_records++;
+        prev = r;
+    }
+    rewind(f);
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 && !ferror(f);
+    if (fclose(f) || !ok || rename(tmp, m->path)) {
+        unlink(tmp);
+    }
+    g_free(tmp);
+}
+
+void tb_cache_user_save(void)
+{
+    TBCacheMapping *m;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    mmap_lock();
+    tcg_tb_foreach(tb_cache_collect, NULL);
+    QLIST_FOREACH(m, &tb_cache.mappings, entry) {
+        tb_cache_write(m);
+    }
+    mmap_unlock();
+}
@@ -38,7 +38,7 @@
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
-static bool global_dirty_log = false;
+bool global_dirty_log;
 
 static QTAILQ_HEAD(memory_listeners, MemoryListener) memory_listeners
     = QTAILQ_HEAD_INITIALIZER(memory_listeners);
@@ -244,6 +244,12 @@ static bool flatrange_equal(FlatRange *a, FlatRange *b)
         && a->readonly == b->readonly;
 }
 
+/* FlatRanges with the same attributes, including dirty logging */
+static bool flatrange_same(FlatRange *a, FlatRange *b)
+{
+    return flatrange_equal(a, b) && a->dirty_log_mask == b->dirty_log_mask;
+}
+
 static FlatView *flatview_new(MemoryRegion *mr_root)
 {
     FlatView *view;
@@ -745,9 +751,8 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
 }
 
 /* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static FlatView *render_memory_topology(MemoryRegion *mr)
 {
-    int i;
     FlatView *view;
 
     view = flatview_new(mr);
@@ -758,6 +763,13 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    return view;
+}
+
+static void flatview_build_dispatch(FlatView *view)
+{
+    int i;
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -765,11 +777,34 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
         flatview_add_to_dispatch(view, &mrs);
     }
     address_space_dispatch_compact(view->dispatch);
+}
+
+static FlatView *generate_memory_topology(MemoryRegion *mr)
+{
+    FlatView *view = render_memory_topology(mr);
+
+    flatview_build_dispatch(view);
     g_hash_table_replace(flat_views, mr, view);
 
     return view;
 }
 
+/* Whether two FlatViews render the same ranges */
+static bool flatview_content_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_same(&a->ranges[i], &b->ranges[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -955,25 +990,52 @@ static void flatviews_init(void)
     }
 }
 
+/*
+ * Render the FlatViews of all address spaces again after a topology change.
+ *
+ * Building the dispatch tree of a FlatView is much more expensive than
+ * rendering the FlatView itself, and most commits leave most views
+ * unchanged: a BAR remap only affects the address spaces that see that
+ * BAR.  So when a root renders the same ranges as in the previous commit,
+ * its previous FlatView and dispatch tree are kept.  Views are only reused
+ * for the root that rendered them, because a FlatView holds a reference
+ * to its root; sharing it with another root would keep the first root,
+ * and e.g. a hot-unplugged device owning it, alive.
+ */
 static void flatviews_reset(void)
 {
+    GHashTable *old_flat_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view, *old_view = NULL;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        view = render_memory_topology(physmr);
+        if (old_flat_views) {
+            old_view = g_hash_table_lookup(old_flat_views, physmr);
+        }
+        if (old_view && flatview_content_equal(old_view, view)) {
+            trace_flatview_reuse(old_view, physmr);
+            flatview_unref(view);
+            flatview_ref(old_view);
+            view = old_view;
+        } else {
+            flatview_build_dispatch(view);
+        }
+        g_hash_table_replace(flat_views, physmr, view);
+    }
+
+    if (old_flat_views) {
+        g_hash_table_unref(old_flat_views);
     }
 }
 
@@ -986,6 +1048,15 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        /*
+         * Nothing changed, but listeners such as vhost rebuild their state
+         * on every commit from region_add and region_nop, so replay the
+         * view to them.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, false);
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
         return;
     }
 
@@ -1501,6 +1572,9 @@ void memory_region_init_io(MemoryRegion *mr,
     mr->ops = ops ? ops : &unassigned_mem_ops;
     mr->opaque = opaque;
     mr->terminates = true;
+    if (mr->ops->lockless) {
+        mr->global_locking = false;
+    }
 }
 
 void memory_region_init_ram_nomigrate(MemoryRegion *mr,
@@ -1993,6 +2067,11 @@ static void memory_region_sync_dirty_bitmap(MemoryRegion *mr)
      * address space once.
      */
     QTAILQ_FOREACH(listener, &memory_listeners, link) {
+        if (listener->log_sync_global) {
+            /* Syncs more than @mr, which is harmless */
+            listener->log_sync_global(listener);
+            continue;
+        }
         if (!listener->log_sync) {
             continue;
         }
@@ -2008,15 +2087,59 @@ static void memory_region_sync_dirty_bitmap(MemoryRegion *mr)
     }
 }
 
+void memory_region_clear_dirty_bitmap(MemoryRegion *mr, hwaddr start,
+                                      hwaddr len)
+{
+    MemoryRegionSection mrs;
+    MemoryListener *listener;
+    AddressSpace *as;
+    FlatView *view;
+    FlatRange *fr;
+    hwaddr sec_start, sec_end;
+
+    QTAILQ_FOREACH(listener, &memory_listeners, link) {
+        if (!listener->log_clear) {
+            continue;
+        }
+        as = listener->address_space;
+        view = address_space_get_flatview(as);
+        FOR_EACH_FLAT_RANGE(fr, view) {
+            if (!fr->dirty_log_mask || fr->mr != mr) {
+                continue;
+            }
+
+            mrs = section_from_flat_range(fr, view);
+            sec_start = MAX(mrs.offset_within_region, start);
+            sec_end = mrs.offset_within_region + int128_get64(mrs.size);
+            sec_end = MIN(sec_end, start + len);
+            if (sec_start >= sec_end) {
+                continue;
+            }
+
+            /* Shrink the section to the part being cleared */
+            mrs.offset_within_address_space +=
+                sec_start - mrs.offset_within_region;
+            mrs.offset_within_region = sec_start;
+            mrs.size = int128_make64(sec_end - sec_start);
+            listener->log_clear(listener, &mrs);
+        }
+        flatview_unref(view);
+    }
+}
+
 DirtyBitmapSnapshot *memory_region_snapshot_and_clear_dirty(MemoryRegion *mr,
                                                             hwaddr addr,
                                                             hwaddr size,
                                                             unsigned client)
 {
+    DirtyBitmapSnapshot *snap;
+
     assert(mr->ram_block);
     memory_region_sync_dirty_bitmap(mr);
-    return cpu_physical_memory_snapshot_and_clear_dirty(
+    snap = cpu_physical_memory_snapshot_and_clear_dirty(
                 memory_region_get_ram_addr(mr) + addr, size, client);
+    memory_region_clear_dirty_bitmap(mr, addr, size);
+    return snap;
 }
 
 bool memory_region_snapshot_get_dirty(MemoryRegion *mr, DirtyBitmapSnapshot *snap,
@@ -2051,8 +2174,10 @@ void memory_region_reset_dirty(MemoryRegion *mr, hwaddr addr,
                                hwaddr size, unsigned client)
 {
     assert(mr->ram_block);
-    cpu_physical_memory_test_and_clear_dirty(
-        memory_region_get_ram_addr(mr) + addr, size, client);
+    if (cpu_physical_memory_test_and_clear_dirty(
+            memory_region_get_ram_addr(mr) + addr, size, client)) {
+        memory_region_clear_dirty_bitmap(mr, addr, size);
+    }
 }
 
 int memory_region_get_fd(MemoryRegion *mr)
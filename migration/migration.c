@@ -1835,6 +1835,15 @@ bool migrate_zero_blocks(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_BLOCKS];
 }
 
+bool migrate_auto_converge_per_vcpu(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_AUTO_CONVERGE_PER_VCPU];
+}
+
 bool migrate_postcopy_blocktime(void)
 {
     MigrationState *s;
@@ -44,6 +44,7 @@
 #include "page_cache.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
 #include "qapi/qapi-events-migration.h"
 #include "qapi/qmp/qerror.h"
 #include "trace.h"
@@ -1376,6 +1377,70 @@ static size_t save_page_header(RAMState *rs, QEMUFile *f,  RAMBlock *block,
     return size;
 }
 
+/*
+ * With auto-converge-per-vcpu, the vCPUs that are throttled are the fewest
+ * that dirtied this percentage of the pages attributed to vCPUs.
+ */
+#define THROTTLE_VCPU_DIRTY_SHARE 75
+
+static gint vcpu_dirty_rate_cmp(gconstpointer a, gconstpointer b)
+{
+    const CPUState *cpu_a = *(CPUState * const *)a;
+    const CPUState *cpu_b = *(CPUState * const *)b;
+
+    /* highest rate first */
+    if (cpu_a->dirty_pages_rate != cpu_b->dirty_pages_rate) {
+        return cpu_a->dirty_pages_rate > cpu_b->dirty_pages_rate ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * mig_throttle_dirty_vcpus: throttle down the vCPUs that dirty most memory
+ *
+ * Returns false, without throttling anything, if no page was attributed
+ * to a vCPU in the last period.
+ *
+ * @pct_initial: throttle percentage for vCPUs that are not throttled yet
+ * @pct_increment: increase of the percentage for vCPUs that already are
+ */
+static bool mig_throttle_dirty_vcpus(uint64_t pct_initial,
+                                     uint64_t pct_increment)
+{
+    GPtrArray *vcpus = g_ptr_array_new();
+    uint64_t total = 0, throttled = 0;
+    CPUState *cpu;
+    guint i;
+
+    CPU_FOREACH(cpu) {
+        g_ptr_array_add(vcpus, cpu);
+        total += cpu->dirty_pages_rate;
+    }
+    if (!total) {
+        g_ptr_array_free(vcpus, true);
+        return false;
+    }
+
+    g_ptr_array_sort(vcpus, vcpu_dirty_rate_cmp);
+    for (i = 0; i < vcpus->len; i++) {
+        int pct;
+
+        if (throttled * 100 >= total * THROTTLE_VCPU_DIRTY_SHARE) {
+            break;
+        }
+        cpu = g_ptr_array_index(vcpus, i);
+        pct = cpu_throttle_get_vcpu_percentage(cpu);
+        pct = pct ? pct + pct_increment : pct_initial;
+        trace_migration_throttle_vcpu(cpu->cpu_index, cpu->dirty_pages_rate,
+                                      pct);
+        cpu_throttle_set_vcpu(cpu, pct);
+        throttled += cpu->dirty_pages_rate;
+    }
+    g_ptr_array_free(vcpus, true);
+
+    return true;
+}
+
 /**
  * mig_throttle_guest_down: throotle down the guest
  *
@@ -1391,6 +1456,12 @@ static void mig_throttle_guest_down(void)
     uint64_t pct_initial = s->parameters.cpu_throttle_initial;
     uint64_t pct_icrement = s->parameters.cpu_throttle_increment;
 
+    /* Leave the vCPUs that hardly write to memory alone if we can */
+    if (migrate_auto_converge_per_vcpu() &&
+        mig_throttle_dirty_vcpus(pct_initial, pct_icrement)) {
+        return;
+    }
+
     /* We have not started throttling yet. Let's start it. */
     if (!cpu_throttle_active()) {
         cpu_throttle_set(pct_initial);
@@ -1537,12 +1608,41 @@ unsigned long migration_bitmap_find_dirty(RAMState *rs, RAMBlock *rb,
     return next;
 }
 
+/*
+ * The dirty log of the accelerator is cleared in chunks of
+ * (1 << CLEAR_BITMAP_SHIFT) target pages, i.e. 1GB with 4K pages
+ */
+#define CLEAR_BITMAP_SHIFT 18
+
+/*
+ * Clear the accelerator's dirty log for the chunk of @page, the first time
+ * one of its pages is sent after a bitmap sync.  Writes that happen after
+ * this point are logged again, and the page is read after it.
+ */
+static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
+                                                       unsigned long page)
+{
+    uint8_t shift = rb->clear_bmap_shift;
+    hwaddr size, start;
+
+    if (!rb->clear_bmap || !clear_bmap_test_and_clear(rb, page)) {
+        return;
+    }
+
+    size = 1ULL << (TARGET_PAGE_BITS + shift);
+    start = ((ram_addr_t)page << TARGET_PAGE_BITS) & -size;
+    trace_migration_bitmap_clear_dirty(rb->idstr, start, size, page);
+    memory_region_clear_dirty_bitmap(rb->mr, start, size);
+}
+
 static inline bool migration_bitmap_clear_dirty(RAMState *rs,
                                                 RAMBlock *rb,
                                                 unsigned long page)
 {
     bool ret;
 
+    migration_clear_memory_region_dirty_bitmap(rb, page);
+
     ret = test_and_clear_bit(page, rb->bmap);
 
     if (ret) {
@@ -1554,9 +1654,13 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
 static void migration_bitmap_sync_range(RAMState *rs, RAMBlock *rb,
                                         ram_addr_t start, ram_addr_t length)
 {
+    uint64_t dirty_pages = 0;
+
     rs->migration_dirty_pages +=
         cpu_physical_memory_sync_dirty_bitmap(rb, start, length,
-                                              &rs->num_dirty_pages_period);
+                                              &dirty_pages);
+    rs->num_dirty_pages_period += dirty_pages;
+    rb->dirty_pages_period += dirty_pages;
 }
 
 /**
@@ -1580,6 +1684,81 @@ uint64_t ram_pagesize_summary(void)
     return summary;
 }
 
+/* Start measuring the dirty page rates of vCPUs and RAMBlocks afresh */
+static void migration_reset_dirty_rates(void)
+{
+    RAMBlock *block;
+    CPUState *cpu;
+
+    rcu_read_lock();
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        block->dirty_pages_period = 0;
+        block->dirty_pages_rate = 0;
+    }
+    rcu_read_unlock();
+
+    CPU_FOREACH(cpu) {
+        cpu->dirty_pages_sampled = stat64_get(&cpu->dirty_pages);
+        cpu->dirty_pages_rate = 0;
+    }
+}
+
+static void migration_update_dirty_rates(int64_t period_ms)
+{
+    RAMBlock *block;
+    CPUState *cpu;
+
+    rcu_read_lock();
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        block->dirty_pages_rate = block->dirty_pages_period * 1000 / period_ms;
+        block->dirty_pages_period = 0;
+    }
+    rcu_read_unlock();
+
+    CPU_FOREACH(cpu) {
+        uint64_t pages = stat64_get(&cpu->dirty_pages);
+
+        cpu->dirty_pages_rate = (pages - cpu->dirty_pages_sampled) * 1000 /
+                                period_ms;
+        cpu->dirty_pages_sampled = pages;
+    }
+}
+
+DirtyRateInfo *qmp_query_dirty_rate(Error **errp)
+{
+    DirtyRateInfo *info = g_new0(DirtyRateInfo, 1);
+    VcpuDirtyRateList **vcpu_tail = &info->vcpus;
+    RAMBlockDirtyRateList **block_tail = &info->ramblocks;
+    RAMBlock *block;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyRateList *entry = g_new0(VcpuDirtyRateList, 1);
+
+        entry->value = g_new0(VcpuDirtyRate, 1);
+        entry->value->cpu_index = cpu->cpu_index;
+        entry->value->dirty_pages_rate = cpu->dirty_pages_rate;
+        entry->value->throttle_percentage =
+            cpu_throttle_get_vcpu_percentage(cpu);
+        *vcpu_tail = entry;
+        vcpu_tail = &entry->next;
+    }
+
+    rcu_read_lock();
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        RAMBlockDirtyRateList *entry = g_new0(RAMBlockDirtyRateList, 1);
+
+        entry->value = g_new0(RAMBlockDirtyRate, 1);
+        entry->value->id = g_strdup(block->idstr);
+        entry->value->dirty_pages_rate = block->dirty_pages_rate;
+        *block_tail = entry;
+        block_tail = &entry->next;
+    }
+    rcu_read_unlock();
+
+    return info;
+}
+
 static void migration_update_rates(RAMState *rs, int64_t end_time)
 {
     uint64_t iter_count = rs->iterations - rs->iterations_prev;
@@ -1587,6 +1766,7 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
     /* calculate period counters */
     ram_counters.dirty_pages_rate = rs->num_dirty_pages_period * 1000
                 / (end_time - rs->time_last_bitmap_sync);
+    migration_update_dirty_rates(end_time - rs->time_last_bitmap_sync);
 
     if (!iter_count) {
         return;
@@ -1609,6 +1789,7 @@ static void migration_bitmap_sync(RAMState *rs)
 
     if (!rs->time_last_bitmap_sync) {
         rs->time_last_bitmap_sync = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        migration_reset_dirty_rates();
     }
 
     trace_migration_bitmap_sync_start();
@@ -1631,6 +1812,9 @@ static void migration_bitmap_sync(RAMState *rs)
     if (end_time > rs->time_last_bitmap_sync + 1000) {
         bytes_xfer_now = ram_counters.transferred;
 
+        /* The per-vCPU rates are needed to pick the vCPUs to throttle */
+        migration_update_rates(rs, end_time);
+
         /* During block migration the auto-converge logic incorrectly detects
          * that ram migration makes no progress. Avoid this by disabling the
          * throttling logic during the bulk phase of block migration. */
@@ -1650,8 +1834,6 @@ static void migration_bitmap_sync(RAMState *rs)
             }
         }
 
-        migration_update_rates(rs, end_time);
-
         rs->iterations_prev = rs->iterations;
 
         /* reset period counters */
@@ -2418,6 +2600,8 @@ static void ram_save_cleanup(void *opaque)
     memory_global_dirty_log_stop();
 
     RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        g_free(block->clear_bmap);
+        block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
         g_free(block->unsentmap);
@@ -2936,6 +3120,9 @@ static void ram_list_init_bitmaps(void)
             pages = block->max_length >> TARGET_PAGE_BITS;
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            block->clear_bmap_shift = CLEAR_BITMAP_SHIFT;
+            block->clear_bmap = bitmap_new(clear_bmap_size(pages,
+                                                           CLEAR_BITMAP_SHIFT));
             if (migrate_postcopy_ram()) {
                 block->unsentmap = bitmap_new(pages);
                 bitmap_set(block->unsentmap, 0, pages);
@@ -70,6 +70,7 @@
 #endif
 #include "exec/memory.h"
 #include "exec/exec-all.h"
+#include "exec/tb-stats.h"
 #include "qemu/log.h"
 #include "qemu/option.h"
 #include "hmp.h"
@@ -1452,6 +1453,65 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
 }
+
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    int64_t count = qdict_get_try_int(qdict, "count", 10);
+    CPUState *cs = mon_get_cpu();
+    TBStatsInfoList *list, *entry;
+    Error *err = NULL;
+
+    list = qmp_query_tb_stats(true, count, &err);
+    if (err) {
+        error_report_err(err);
+        return;
+    }
+    if (!atomic_read(&tb_stats_enabled)) {
+        monitor_printf(mon, "TB statistics are disabled; "
+                       "use 'tb_stats on' to enable them\n");
+    }
+
+    for (entry = list; entry; entry = entry->next) {
+        TBStatsInfo *info = entry->value;
+
+        monitor_printf(mon, "TB pc=0x" TARGET_FMT_lx " phys=0x%" PRIx64
+                       " cs_base=0x" TARGET_FMT_lx " flags=0x%08x\n",
+                       (target_ulong)info->pc, info->phys_pc,
+                       (target_ulong)info->cs_base, info->flags);
+        monitor_printf(mon, "  exec %" PRIu64 " exits %" PRIu64
+                       " translations %" PRIu64 " (%" PRIu64 " ns)\n",
+                       info->exec_count, info->exit_count,
+                       info->translations, info->translate_time_ns);
+        monitor_printf(mon, "  guest insns %u, tcg ops %u, "
+                       "host code %u bytes, spills %u\n",
+                       info->guest_insns, info->tcg_ops,
+                       info->host_code_size, info->spills);
+        if (cs && info->guest_insns) {
+            monitor_disas(mon, cs, info->pc, info->guest_insns, 0);
+        }
+        monitor_printf(mon, "\n");
+    }
+    qapi_free_TBStatsInfoList(list);
+}
+
+static void hmp_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *option = qdict_get_str(qdict, "option");
+
+    if (!tcg_enabled()) {
+        error_report("TB statistics are only available with accel=tcg");
+        return;
+    }
+    if (!strcmp(option, "on")) {
+        tb_stats_enable(true);
+    } else if (!strcmp(option, "off")) {
+        tb_stats_enable(false);
+    } else if (!strcmp(option, "reset")) {
+        tb_stats_reset();
+    } else {
+        monitor_printf(mon, "unexpected option %s\n", option);
+    }
+}
 #endif
 
 static void hmp_info_history(Monitor *mon, const QDict *qdict)
@@ -35,6 +35,7 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                kernel_irqchip=on|off|split controls accelerated irqchip support (default=off)\n"
     "                vmport=on|off|auto controls emulation of vmport (default: auto)\n"
     "                kvm_shadow_mem=size of KVM shadow MMU in bytes\n"
+    "                kvm-dirty-ring-size=number of entries of the per-vCPU KVM dirty rings (default: 0, use dirty bitmaps)\n"
     "                dump-guest-core=on|off include guest memory in a core dump (default=on)\n"
     "                mem-merge=on|off controls memory merge support (default: on)\n"
     "                igd-passthru=on|off controls IGD GFX passthrough support (default=off)\n"
@@ -80,6 +81,12 @@ value based on accel. For accel=xen the default is off otherwise the default
 is on.
 @item kvm_shadow_mem=size
 Defines the size of the KVM shadow MMU.
+@item kvm-dirty-ring-size=@var{n}
+Track the pages written by the guest with per-vCPU rings of @var{n}
+entries, which must be a power of two, instead of a dirty bitmap per
+memory slot.  The cost of syncing the dirty log then depends on the number
+of pages written rather than on the size of guest memory.  The default,
+0, uses dirty bitmaps.
 @item dump-guest-core=on|off
 Include guest memory in a core dump. The default is on.
 @item mem-merge=on|off
@@ -128,9 +135,12 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi][,superblock-threshold=n]\n"
+    "                [,quantum=n]\n"
     "                select accelerator (kvm, xen, hax, hvf, whpx or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                superblock-threshold=n (form TCG superblocks after n executions)\n"
+    "                quantum=n (instructions per quantum of multi-threaded icount)\n", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -144,6 +154,24 @@ Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+
+@option{thread=multi} can be combined with @option{-icount} with a fixed
+@var{shift}, but not with record/replay.  The vCPUs then run in parallel for
+quanta of instructions.  A vCPU that reaches an atomic instruction or an I/O
+access (MMIO, port I/O, or a system register or MSR that touches a device)
+stops there; at the end of the quantum, the vCPUs that stopped run the rest of
+their quantum one at a time, in a fixed order.  Guests that race on plain,
+non-atomic accesses to shared memory, without synchronizing through atomics,
+still behave nondeterministically, and so do events from outside the guest.
+@item quantum=@var{n}
+Length in instructions of the quanta of multi-threaded icount; the default is
+10000.  Shorter quanta delay atomic instructions and I/O less, at the cost of
+more frequent synchronization between the vCPU threads.
+@item superblock-threshold=@var{n}
+Once a translated block has run @var{n} times, retranslate it together with
+the hot blocks that follow it in the same page as a single superblock, so that
+the TCG optimizer and register allocator work across the whole path.  The
+default of 0 disables superblocks.  They are not formed with icount.
 @end table
 ETEXI
 
@@ -3290,6 +3318,30 @@ STEXI
 Run the emulation in single step mode.
 ETEXI
 
+DEF("perfmap", 0, QEMU_OPTION_perfmap, \
+    "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perfmap
+@findex -perfmap
+Generate a map file for Linux perf tools that will allow basic profiling
+information to be broken down into translation blocks, named after the
+guest symbol they belong to when the guest symbol table is known.
+ETEXI
+
+DEF("jitdump", 0, QEMU_OPTION_jitdump, \
+    "-jitdump        generate a jit-${pid}.dump file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -jitdump
+@findex -jitdump
+Generate a dump file for Linux perf tools that maps translation blocks
+to symbol names and the host code generated for them, in the
+directory given by the @env{JITDUMPDIR} environment variable or in the
+current directory.  Record with @code{perf record -k 1} and process the
+result with @code{perf inject -j} before running @code{perf report}.
+ETEXI
+
 DEF("preconfig", 0, QEMU_OPTION_preconfig, \
     "--preconfig     pause QEMU before machine is initialized (experimental)\n",
     QEMU_ARCH_ALL)
@@ -3718,6 +3770,26 @@ STEXI
 Set TB size.
 ETEXI
 
+DEF("tb-cache", HAS_ARG, QEMU_OPTION_tb_cache, \
+    "-tb-cache [file=]path[,size=n]\n"
+    "                record the translated code in path on exit, and\n"
+    "                translate it ahead of time in later runs\n"
+    "                (size: max cache size, default 8M)\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -tb-cache [file=]@var{path}[,size=@var{n}]
+@findex -tb-cache
+Record in @var{path} on exit which guest code was translated by TCG, and in
+later runs translate it ahead of time, as soon as the guest executes code in
+the same page.  The file is limited to @var{n} bytes (8M by default).
+
+Only the addresses, CPU state and a checksum of the translated guest code are
+saved, not the generated host code, so the file can be shared by any run of
+the same QEMU version with the same machine type and @option{-cpu} option.
+Code is only translated ahead of time if the guest memory it comes from has
+not changed.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming tcp:[host]:port[,to=maxport][,ipv4][,ipv6]\n" \
     "-incoming rdma:host:port[,ipv4][,ipv6]\n" \
@@ -431,7 +431,8 @@ static inline bool use_goto_tb(DisasContext *s, int n, uint64_t dest)
      * debug architecture kind) or deterministic io
      */
     if (s->base.singlestep_enabled || s->ss_active ||
-        (tb_cflags(s->base.tb) & CF_LAST_IO)) {
+        (tb_cflags(s->base.tb) & CF_LAST_IO) ||
+        !translator_use_goto_tb(&s->base)) {
         return false;
     }
 
@@ -445,12 +446,26 @@ static inline bool use_goto_tb(DisasContext *s, int n, uint64_t dest)
     return true;
 }
 
+/* Jump to the TB for the pc in cpu_pc, which must use the same TB flags */
+static void gen_goto_ptr(DisasContext *s)
+{
+    TCGv_i32 flags = tcg_const_i32(s->base.tb->flags);
+
+    translator_lookup_and_goto_ptr(&s->base, cpu_pc, flags, 0, s->is_return);
+    tcg_temp_free_i32(flags);
+}
+
 static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
 {
     TranslationBlock *tb;
 
     tb = s->base.tb;
-    if (use_goto_tb(s, n, dest)) {
+    translator_add_successor(&s->base, dest);
+    if (!s->ss_active && translator_superblock_continue(&s->base, dest)) {
+        /* next block of the superblock: translation continues at dest */
+        s->pc = dest;
+        s->base.is_jmp = DISAS_NORETURN;
+    } else if (use_goto_tb(s, n, dest)) {
         tcg_gen_goto_tb(n);
         gen_a64_set_pc_im(dest);
         tcg_gen_exit_tb(tb, n);
@@ -462,7 +477,7 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
         } else if (s->base.singlestep_enabled) {
             gen_exception_internal(EXCP_DEBUG);
         } else {
-            tcg_gen_lookup_and_goto_ptr();
+            gen_goto_ptr(s);
             s->base.is_jmp = DISAS_NORETURN;
         }
     }
@@ -1361,6 +1376,7 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
     if (insn & (1U << 31)) {
         /* BL Branch with link */
         tcg_gen_movi_i64(cpu_reg(s, 30), s->pc);
+        translator_push_return(&s->base, s->pc);
     }
 
     /* B Branch / BL Branch with link */
@@ -1929,7 +1945,9 @@ static void disas_uncond_b_reg(DisasContext *s, uint32_t insn)
         /* BLR also needs to load return address */
         if (opc == 1) {
             tcg_gen_movi_i64(cpu_reg(s, 30), s->pc);
+            translator_push_return(&s->base, s->pc);
         }
+        s->is_return = (opc == 2);
         break;
     case 4: /* ERET */
         if (s->current_el == 0) {
@@ -13876,6 +13894,7 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     dc->ss_active = ARM_TBFLAG_SS_ACTIVE(dc->base.tb->flags);
     dc->pstate_ss = ARM_TBFLAG_PSTATE_SS(dc->base.tb->flags);
     dc->is_ldex = false;
+    dc->is_return = false;
     dc->ss_same_el = (arm_debug_target_el(env) == dc->current_el);
 
     /* Bound the number of insns to execute to those left on the page.  */
@@ -13994,7 +14013,7 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             tcg_gen_exit_tb(NULL, 0);
             break;
         case DISAS_JUMP:
-            tcg_gen_lookup_and_goto_ptr();
+            gen_goto_ptr(dc);
             break;
         case DISAS_NORETURN:
         case DISAS_SWI:
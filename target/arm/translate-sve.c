@@ -351,21 +351,83 @@ static bool do_zpzz_ool(DisasContext *s, arg_rprr_esz *a, gen_helper_gvec_4 *fn)
     return true;
 }
 
+/* Expand inline if the host can apply the predicate itself,
+ * otherwise call the out-of-line helper.
+ */
+static bool do_zpzz_pred(DisasContext *s, arg_rprr_esz *a,
+                         const GVecGen3Pred *gvec_op)
+{
+    if (sve_access_check(s)) {
+        unsigned vsz = vec_full_reg_size(s);
+        tcg_gen_gvec_3_pred(vec_full_reg_offset(s, a->rd),
+                            vec_full_reg_offset(s, a->rn),
+                            vec_full_reg_offset(s, a->rm),
+                            pred_full_reg_offset(s, a->pg),
+                            vsz, vsz, gvec_op);
+    }
+    return true;
+}
+
+static void gen_sel_vec(unsigned vece, TCGv_vec d, TCGv_vec n, TCGv_vec m)
+{
+    tcg_gen_mov_vec(d, n);
+}
+
 /* Select active elememnts from Zn and inactive elements from Zm,
  * storing the result in Zd.
  */
 static void do_sel_z(DisasContext *s, int rd, int rn, int rm, int pg, int esz)
 {
-    static gen_helper_gvec_4 * const fns[4] = {
-        gen_helper_sve_sel_zpzz_b, gen_helper_sve_sel_zpzz_h,
-        gen_helper_sve_sel_zpzz_s, gen_helper_sve_sel_zpzz_d
+    static const GVecGen3Pred ops[4] = {
+        { .fniv = gen_sel_vec,
+          .fno = gen_helper_sve_sel_zpzz_b,
+          .vece = MO_8,
+          .inactive_b = true },
+        { .fniv = gen_sel_vec,
+          .fno = gen_helper_sve_sel_zpzz_h,
+          .vece = MO_16,
+          .inactive_b = true },
+        { .fniv = gen_sel_vec,
+          .fno = gen_helper_sve_sel_zpzz_s,
+          .vece = MO_32,
+          .inactive_b = true },
+        { .fniv = gen_sel_vec,
+          .fno = gen_helper_sve_sel_zpzz_d,
+          .vece = MO_64,
+          .inactive_b = true },
     };
     unsigned vsz = vec_full_reg_size(s);
-    tcg_gen_gvec_4_ool(vec_full_reg_offset(s, rd),
-                       vec_full_reg_offset(s, rn),
-                       vec_full_reg_offset(s, rm),
-                       pred_full_reg_offset(s, pg),
-                       vsz, vsz, 0, fns[esz]);
+    tcg_gen_gvec_3_pred(vec_full_reg_offset(s, rd),
+                        vec_full_reg_offset(s, rn),
+                        vec_full_reg_offset(s, rm),
+                        pred_full_reg_offset(s, pg),
+                        vsz, vsz, &ops[esz]);
+}
+
+/* Merging predicated operations with a TCG vector equivalent.  */
+#define DO_ZPZZ_VEC(NAME, name, op) \
+static bool trans_##NAME##_zpzz(DisasContext *s, arg_rprr_esz *a,         \
+                                uint32_t insn)                            \
+{                                                                         \
+    static const GVecGen3Pred ops[4] = {                                  \
+        { .fniv = tcg_gen_##op##_vec,                                     \
+          .fno = gen_helper_sve_##name##_zpzz_b,                          \
+          .opc = INDEX_op_##op##_vec,                                     \
+          .vece = MO_8 },                                                 \
+        { .fniv = tcg_gen_##op##_vec,                                     \
+          .fno = gen_helper_sve_##name##_zpzz_h,                          \
+          .opc = INDEX_op_##op##_vec,                                     \
+          .vece = MO_16 },                                                \
+        { .fniv = tcg_gen_##op##_vec,                                     \
+          .fno = gen_helper_sve_##name##_zpzz_s,                          \
+          .opc = INDEX_op_##op##_vec,                                     \
+          .vece = MO_32 },                                                \
+        { .fniv = tcg_gen_##op##_vec,                                     \
+          .fno = gen_helper_sve_##name##_zpzz_d,                          \
+          .opc = INDEX_op_##op##_vec,                                     \
+          .vece = MO_64 },                                                \
+    };                                                                    \
+    return do_zpzz_pred(s, a, &ops[a->esz]);                              \
 }
 
 #define DO_ZPZZ(NAME, name) \
@@ -379,13 +441,13 @@ static bool trans_##NAME##_zpzz(DisasContext *s, arg_rprr_esz *a,         \
     return do_zpzz_ool(s, a, fns[a->esz]);                                \
 }
 
-DO_ZPZZ(AND, and)
-DO_ZPZZ(EOR, eor)
-DO_ZPZZ(ORR, orr)
-DO_ZPZZ(BIC, bic)
+DO_ZPZZ_VEC(AND, and, and)
+DO_ZPZZ_VEC(EOR, eor, xor)
+DO_ZPZZ_VEC(ORR, orr, or)
+DO_ZPZZ_VEC(BIC, bic, andc)
 
-DO_ZPZZ(ADD, add)
-DO_ZPZZ(SUB, sub)
+DO_ZPZZ_VEC(ADD, add, add)
+DO_ZPZZ_VEC(SUB, sub, sub)
 
 DO_ZPZZ(SMAX, smax)
 DO_ZPZZ(UMAX, umax)
@@ -394,7 +456,7 @@ DO_ZPZZ(UMIN, umin)
 DO_ZPZZ(SABD, sabd)
 DO_ZPZZ(UABD, uabd)
 
-DO_ZPZZ(MUL, mul)
+DO_ZPZZ_VEC(MUL, mul, mul)
 DO_ZPZZ(SMULH, smulh)
 DO_ZPZZ(UMULH, umulh)
 
@@ -427,6 +489,7 @@ static bool trans_SEL_zpzz(DisasContext *s, arg_rprr_esz *a, uint32_t insn)
 }
 
 #undef DO_ZPZZ
+#undef DO_ZPZZ_VEC
 
 /*
  *** SVE Integer Arithmetic - Unary Predicated Group
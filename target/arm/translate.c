@@ -4263,9 +4263,25 @@ static inline bool use_goto_tb(DisasContext *s, target_ulong dest)
 #endif
 }
 
-static void gen_goto_ptr(void)
+/* Jump to the TB for the pc and Thumb state set by gen_bx and friends */
+static void gen_goto_ptr(DisasContext *s)
 {
-    tcg_gen_lookup_and_goto_ptr();
+    TCGv_i32 flags = tcg_temp_new_i32();
+    TCGv_i32 tmp = tcg_temp_new_i32();
+    TCGv pc = tcg_temp_new();
+
+    /* Everything but the Thumb and IT state is constant within a TB */
+    tcg_gen_movi_i32(flags, s->base.tb->flags & ~(ARM_TBFLAG_THUMB_MASK |
+                                                  ARM_TBFLAG_CONDEXEC_MASK));
+    tcg_gen_ld_i32(tmp, cpu_env, offsetof(CPUARMState, thumb));
+    tcg_gen_deposit_i32(flags, flags, tmp, ARM_TBFLAG_THUMB_SHIFT, 1);
+    tcg_gen_ld_i32(tmp, cpu_env, offsetof(CPUARMState, condexec_bits));
+    tcg_gen_deposit_i32(flags, flags, tmp, ARM_TBFLAG_CONDEXEC_SHIFT, 8);
+    tcg_temp_free_i32(tmp);
+    tcg_gen_extu_i32_tl(pc, cpu_R[15]);
+    translator_lookup_and_goto_ptr(&s->base, pc, flags, 0, s->is_return);
+    tcg_temp_free(pc);
+    tcg_temp_free_i32(flags);
 }
 
 /* This will end the TB but doesn't guarantee we'll return to
@@ -4274,13 +4290,14 @@ static void gen_goto_ptr(void)
  */
 static void gen_goto_tb(DisasContext *s, int n, target_ulong dest)
 {
+    translator_add_successor(&s->base, dest);
     if (use_goto_tb(s, dest)) {
         tcg_gen_goto_tb(n);
         gen_set_pc_im(s, dest);
         tcg_gen_exit_tb(s->base.tb, n);
     } else {
         gen_set_pc_im(s, dest);
-        gen_goto_ptr();
+        gen_goto_ptr(s);
     }
     s->base.is_jmp = DISAS_NORETURN;
 }
@@ -8643,6 +8660,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
             tmp = tcg_temp_new_i32();
             tcg_gen_movi_i32(tmp, val);
             store_reg(s, 14, tmp);
+            translator_push_return(&s->base, s->pc);
             /* Sign-extend the 24-bit offset */
             offset = (((int32_t)insn) << 8) >> 8;
             /* offset * 4 + bit24 * 2 + (thumb bit) */
@@ -8800,6 +8818,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
                 ARCH(4T);
                 tmp = load_reg(s, rm);
                 gen_bx(s, tmp);
+                s->is_return = (rm == 14);
             } else if (op1 == 3) {
                 /* clz */
                 ARCH(5);
@@ -8831,6 +8850,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
             tmp2 = tcg_temp_new_i32();
             tcg_gen_movi_i32(tmp2, s->pc);
             store_reg(s, 14, tmp2);
+            translator_push_return(&s->base, s->pc);
             gen_bx(s, tmp);
             break;
         case 0x4:
@@ -9826,6 +9846,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
             if (insn & (1 << 20)) {
                 /* Complete the load.  */
                 store_reg_from_load(s, rd, tmp);
+                s->is_return = (rd == 15 && rn == 13);
             }
             break;
         case 0x08:
@@ -9897,6 +9918,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
                                 store_pc_exc_ret(s, tmp);
                             } else {
                                 store_reg_from_load(s, i, tmp);
+                                s->is_return = (i == 15 && rn == 13);
                             }
                         } else {
                             /* store */
@@ -9975,6 +9997,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
                     tmp = tcg_temp_new_i32();
                     tcg_gen_movi_i32(tmp, val);
                     store_reg(s, 14, tmp);
+                    translator_push_return(&s->base, s->pc);
                 }
                 offset = sextract32(insn << 2, 0, 26);
                 val += offset + 4;
@@ -10468,6 +10491,7 @@ static void disas_thumb2_insn(DisasContext *s, uint32_t insn)
                         gen_aa32_ld32u(s, tmp, addr, get_mem_index(s));
                         if (i == 15) {
                             gen_bx_excret(s, tmp);
+                            s->is_return = (rn == 13);
                         } else if (i == rn) {
                             loaded_var = tmp;
                             loaded_base = 1;
@@ -10995,6 +11019,7 @@ static void disas_thumb2_insn(DisasContext *s, uint32_t insn)
                 if (insn & (1 << 14)) {
                     /* Branch and link.  */
                     tcg_gen_movi_i32(cpu_R[14], s->pc | 1);
+                    translator_push_return(&s->base, s->pc);
                 }
 
                 offset += s->pc;
@@ -11530,6 +11555,7 @@ static void disas_thumb2_insn(DisasContext *s, uint32_t insn)
             }
             if (rs == 15) {
                 gen_bx_excret(s, tmp);
+                s->is_return = (rn == 13);
             } else {
                 store_reg(s, rs, tmp);
             }
@@ -11739,10 +11765,12 @@ static void disas_thumb_insn(DisasContext *s, uint32_t insn)
                     tmp2 = tcg_temp_new_i32();
                     tcg_gen_movi_i32(tmp2, val);
                     store_reg(s, 14, tmp2);
+                    translator_push_return(&s->base, s->pc);
                     gen_bx(s, tmp);
                 } else {
                     /* Only BX works as exception-return, not BLX */
                     gen_bx_excret(s, tmp);
+                    s->is_return = (rm == 14);
                 }
                 break;
             }
@@ -12125,6 +12153,7 @@ static void disas_thumb_insn(DisasContext *s, uint32_t insn)
             /* set the new PC value */
             if ((insn & 0x0900) == 0x0900) {
                 store_reg_from_load(s, 15, tmp);
+                s->is_return = true;
             }
             break;
 
@@ -12322,6 +12351,7 @@ static void disas_thumb_insn(DisasContext *s, uint32_t insn)
             tmp2 = tcg_temp_new_i32();
             tcg_gen_movi_i32(tmp2, s->pc | 1);
             store_reg(s, 14, tmp2);
+            translator_push_return(&s->base, s->pc);
             gen_bx(s, tmp);
             break;
         }
@@ -12347,6 +12377,7 @@ static void disas_thumb_insn(DisasContext *s, uint32_t insn)
             tmp2 = tcg_temp_new_i32();
             tcg_gen_movi_i32(tmp2, s->pc | 1);
             store_reg(s, 14, tmp2);
+            translator_push_return(&s->base, s->pc);
             gen_bx(s, tmp);
         } else {
             /* 0b1111_0xxx_xxxx_xxxx : BL/BLX prefix */
@@ -12432,6 +12463,7 @@ static void arm_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
     dc->ss_active = ARM_TBFLAG_SS_ACTIVE(dc->base.tb->flags);
     dc->pstate_ss = ARM_TBFLAG_PSTATE_SS(dc->base.tb->flags);
     dc->is_ldex = false;
+    dc->is_return = false;
     dc->ss_same_el = false; /* Can't be true since EL_d must be AArch64 */
 
     dc->page_start = dc->base.pc_first & TARGET_PAGE_MASK;
@@ -12784,7 +12816,7 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             gen_goto_tb(dc, 1, dc->pc);
             break;
         case DISAS_JUMP:
-            gen_goto_ptr();
+            gen_goto_ptr(dc);
             break;
         case DISAS_UPDATE:
             gen_set_pc_im(dc, dc->pc);
@@ -64,6 +64,10 @@ typedef struct DisasContext {
      * ie A64 LDX*, LDAX*, A32/T32 LDREX*, LDAEX*.
      */
     bool is_ldex;
+    /* True if the indirect branch that ends the TB is a function return,
+     * i.e. a branch to LR or a load of the PC from the stack.
+     */
+    bool is_return;
     /* True if a single-step exception will be taken to the current EL */
     bool ss_same_el;
     /* Bottom two bits of XScale c15_cpar coprocessor access control reg */
@@ -2,7 +2,9 @@ DEF_HELPER_FLAGS_4(cc_compute_all, TCG_CALL_NO_RWG_SE, tl, tl, tl, tl, int)
 DEF_HELPER_FLAGS_4(cc_compute_c, TCG_CALL_NO_RWG_SE, tl, tl, tl, tl, int)
 
 DEF_HELPER_3(write_eflags, void, env, tl, i32)
+DEF_HELPER_GLOBALS(write_eflags, , dh_env(cc_src) dh_env(cc_op))
 DEF_HELPER_1(read_eflags, tl, env)
+DEF_HELPER_GLOBALS(read_eflags, dh_env_range(cc_dst, cc_op), )
 DEF_HELPER_2(divb_AL, void, env, tl)
 DEF_HELPER_2(idivb_AL, void, env, tl)
 DEF_HELPER_2(divw_AX, void, env, tl)
@@ -28,6 +30,18 @@ DEF_HELPER_1(aaa, void, env)
 DEF_HELPER_1(aas, void, env)
 DEF_HELPER_1(daa, void, env)
 DEF_HELPER_1(das, void, env)
+DEF_HELPER_GLOBALS(aam, dh_env(regs[R_EAX]),
+                   dh_env(regs[R_EAX]) dh_env(cc_dst))
+DEF_HELPER_GLOBALS(aad, dh_env(regs[R_EAX]),
+                   dh_env(regs[R_EAX]) dh_env(cc_dst))
+DEF_HELPER_GLOBALS(aaa, dh_env(regs[R_EAX]) dh_env_range(cc_dst, cc_op),
+                   dh_env(regs[R_EAX]) dh_env(cc_src))
+DEF_HELPER_GLOBALS(aas, dh_env(regs[R_EAX]) dh_env_range(cc_dst, cc_op),
+                   dh_env(regs[R_EAX]) dh_env(cc_src))
+DEF_HELPER_GLOBALS(daa, dh_env(regs[R_EAX]) dh_env_range(cc_dst, cc_op),
+                   dh_env(regs[R_EAX]) dh_env(cc_src))
+DEF_HELPER_GLOBALS(das, dh_env(regs[R_EAX]) dh_env_range(cc_dst, cc_op),
+                   dh_env(regs[R_EAX]) dh_env(cc_src))
 
 DEF_HELPER_2(lsl, tl, env, tl)
 DEF_HELPER_2(lar, tl, env, tl)
@@ -140,6 +140,8 @@ typedef struct DisasContext {
 
 static void gen_eob(DisasContext *s);
 static void gen_jr(DisasContext *s, TCGv dest);
+static void gen_jr_ret(DisasContext *s, TCGv dest);
+static void gen_jr_far(DisasContext *s);
 static void gen_jmp(DisasContext *s, target_ulong eip);
 static void gen_jmp_tb(DisasContext *s, target_ulong eip, int tb_num);
 static void gen_op(DisasContext *s1, int op, TCGMemOp ot, int d);
@@ -2177,6 +2179,9 @@ static inline int insn_const_size(TCGMemOp ot)
 
 static inline bool use_goto_tb(DisasContext *s, target_ulong pc)
 {
+    if (!translator_use_goto_tb(&s->base)) {
+        return false;
+    }
 #ifndef CONFIG_USER_ONLY
     return (pc & TARGET_PAGE_MASK) == (s->base.tb->pc & TARGET_PAGE_MASK) ||
            (pc & TARGET_PAGE_MASK) == (s->pc_start & TARGET_PAGE_MASK);
@@ -2189,7 +2194,11 @@ static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
 {
     target_ulong pc = s->cs_base + eip;
 
-    if (use_goto_tb(s, pc))  {
+    translator_add_successor(&s->base, pc);
+    if (translator_superblock_continue(&s->base, pc)) {
+        /* next block of the superblock: translation continues at pc */
+        s->base.is_jmp = DISAS_NORETURN;
+    } else if (use_goto_tb(s, pc))  {
         /* jump to same page: we can use a direct jump */
         tcg_gen_goto_tb(tb_num);
         gen_jmp_im(eip);
@@ -2549,12 +2558,41 @@ static void gen_bnd_jmp(DisasContext *s)
     }
 }
 
+/* Kinds of jump to register */
+typedef enum JRKind {
+    JR_NONE,
+    JR_NEAR,    /* jump to DEST within the current code segment */
+    JR_RET,     /* near return to DEST */
+    JR_FAR,     /* CS or the TB flags may have changed */
+} JRKind;
+
+/* Look up the TB for EIP, which is in the current code segment.  The
+   destination's TB flags are the current ones, minus those that the end
+   of block has reset.  */
+static void gen_lookup_and_goto_ptr(DisasContext *s, TCGv eip, bool is_ret)
+{
+    TCGv pc = tcg_temp_new();
+    /* do_gen_eob_worker has already cleared RF and INHIBIT_IRQ in
+       env->hflags on every path that reaches here; the next TB must be
+       looked up with the same flags cpu_get_tb_cpu_state would see.  */
+    TCGv_i32 flags = tcg_const_i32(s->flags &
+                                   ~(HF_RF_MASK | HF_INHIBIT_IRQ_MASK));
+
+    tcg_gen_addi_tl(pc, eip, s->cs_base);
+    translator_lookup_and_goto_ptr(&s->base, pc, flags, s->cs_base, is_ret);
+    tcg_temp_free_i32(flags);
+    tcg_temp_free(pc);
+}
+
 /* Generate an end of block. Trace exception is also generated if needed.
    If INHIBIT, set HF_INHIBIT_IRQ_MASK if it isn't already set.
    If RECHECK_TF, emit a rechecking helper for #DB, ignoring the state of
-   S->TF.  This is used by the syscall/sysret insns.  */
+   S->TF.  This is used by the syscall/sysret insns.
+   If JR is not JR_NONE, jump to the next TB without going back to the
+   main loop; DEST is the new EIP for JR_NEAR and JR_RET.  */
 static void
-do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
+do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf,
+                  JRKind jr, TCGv dest)
 {
     gen_update_cc_op(s);
 
@@ -2575,8 +2613,10 @@ do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
         tcg_gen_exit_tb(NULL, 0);
     } else if (s->tf) {
         gen_helper_single_step(cpu_env);
-    } else if (jr) {
+    } else if (jr == JR_FAR) {
         tcg_gen_lookup_and_goto_ptr();
+    } else if (jr != JR_NONE) {
+        gen_lookup_and_goto_ptr(s, dest, jr == JR_RET);
     } else {
         tcg_gen_exit_tb(NULL, 0);
     }
@@ -2586,7 +2626,7 @@ do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
 static inline void
 gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf)
 {
-    do_gen_eob_worker(s, inhibit, recheck_tf, false);
+    do_gen_eob_worker(s, inhibit, recheck_tf, JR_NONE, NULL);
 }
 
 /* End of block.
@@ -2602,10 +2642,22 @@ static void gen_eob(DisasContext *s)
     gen_eob_worker(s, false, false);
 }
 
-/* Jump to register */
+/* Jump to register.  DEST holds the new EIP; CS must not change.  */
 static void gen_jr(DisasContext *s, TCGv dest)
 {
-    do_gen_eob_worker(s, false, false, true);
+    do_gen_eob_worker(s, false, false, JR_NEAR, dest);
+}
+
+/* Near return.  DEST holds the new EIP.  */
+static void gen_jr_ret(DisasContext *s, TCGv dest)
+{
+    do_gen_eob_worker(s, false, false, JR_RET, dest);
+}
+
+/* Jump to the new CS:EIP after a far jump or call.  */
+static void gen_jr_far(DisasContext *s)
+{
+    do_gen_eob_worker(s, false, false, JR_FAR, NULL);
 }
 
 /* generate a jump to eip. No segment change must happen before as a
@@ -5026,6 +5078,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             gen_push_v(s, cpu_T1);
             gen_op_jmp_v(cpu_T0);
             gen_bnd_jmp(s);
+            translator_push_return(&s->base, s->pc);
             gen_jr(s, cpu_T0);
             break;
         case 3: /* lcall Ev */
@@ -5044,8 +5097,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
                                       tcg_const_i32(dflag - 1),
                                       tcg_const_i32(s->pc - s->cs_base));
             }
-            tcg_gen_ld_tl(cpu_tmp4, cpu_env, offsetof(CPUX86State, eip));
-            gen_jr(s, cpu_tmp4);
+            gen_jr_far(s);
             break;
         case 4: /* jmp Ev */
             if (dflag == MO_16) {
@@ -5068,8 +5120,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
                 gen_op_movl_seg_T0_vm(R_CS);
                 gen_op_jmp_v(cpu_T1);
             }
-            tcg_gen_ld_tl(cpu_tmp4, cpu_env, offsetof(CPUX86State, eip));
-            gen_jr(s, cpu_tmp4);
+            gen_jr_far(s);
             break;
         case 6: /* push Ev */
             gen_push_v(s, cpu_T0);
@@ -6445,7 +6496,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(cpu_T0);
         gen_bnd_jmp(s);
-        gen_jr(s, cpu_T0);
+        gen_jr_ret(s, cpu_T0);
         break;
     case 0xc3: /* ret */
         ot = gen_pop_T0(s);
@@ -6453,7 +6504,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(cpu_T0);
         gen_bnd_jmp(s);
-        gen_jr(s, cpu_T0);
+        gen_jr_ret(s, cpu_T0);
         break;
     case 0xca: /* lret im */
         val = x86_ldsw_code(env, s);
@@ -6519,6 +6570,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             tcg_gen_movi_tl(cpu_T0, next_eip);
             gen_push_v(s, cpu_T0);
             gen_bnd_jmp(s);
+            translator_push_return(&s->base, s->pc);
             gen_jmp(s, tval);
         }
         break;
@@ -25,6 +25,7 @@
 #include "exec/exec-all.h"
 #include "exec/cpu_ldst.h"
 #include "qemu/int128.h"
+#include "qemu/atomic128.h"
 
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/s390x/storage-keys.h"
@@ -1375,14 +1376,14 @@ static void do_cdsg(CPUS390XState *env, uint64_t addr,
     bool fail;
 
     if (parallel) {
-#ifndef CONFIG_ATOMIC128
-        cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
-#else
         int mem_idx = cpu_mmu_index(env, false);
         TCGMemOpIdx oi = make_memop_idx(MO_TEQ | MO_ALIGN_16, mem_idx);
+
+        if (!HAVE_CMPXCHG128) {
+            cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
+        }
         oldv = helper_atomic_cmpxchgo_be_mmu(env, addr, cmpv, newv, oi, ra);
         fail = !int128_eq(oldv, cmpv);
-#endif
     } else {
         uint64_t oldh, oldl;
 
@@ -1421,9 +1422,7 @@ void HELPER(cdsg_parallel)(CPUS390XState *env, uint64_t addr,
 static uint32_t do_csst(CPUS390XState *env, uint32_t r3, uint64_t a1,
                         uint64_t a2, bool parallel)
 {
-#if !defined(CONFIG_USER_ONLY) || defined(CONFIG_ATOMIC128)
     uint32_t mem_idx = cpu_mmu_index(env, false);
-#endif
     uintptr_t ra = GETPC();
     uint32_t fc = extract32(env->regs[0], 0, 8);
     uint32_t sc = extract32(env->regs[0], 8, 8);
@@ -1459,8 +1458,10 @@ static uint32_t do_csst(CPUS390XState *env, uint32_t r3, uint64_t a1,
         int mask = 0;
 #if !defined(CONFIG_ATOMIC64)
         mask = -8;
-#elif !defined(CONFIG_ATOMIC128)
-        mask = -16;
+#else
+        if (!HAVE_CMPXCHG128 || !HAVE_ATOMIC128) {
+            mask = -16;
+        }
 #endif
         if (((4 << fc) | (1 << sc)) & mask) {
             cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
@@ -1533,14 +1534,9 @@ static uint32_t do_csst(CPUS390XState *env, uint32_t r3, uint64_t a1,
             Int128 ov;
 
             if (parallel) {
-#ifdef CONFIG_ATOMIC128
                 TCGMemOpIdx oi = make_memop_idx(MO_TEQ | MO_ALIGN_16, mem_idx);
                 ov = helper_atomic_cmpxchgo_be_mmu(env, a1, cv, nv, oi, ra);
                 cc = !int128_eq(ov, cv);
-#else
-                /* Note that we asserted !parallel above.  */
-                g_assert_not_reached();
-#endif
             } else {
                 uint64_t oh = cpu_ldq_data_ra(env, a1 + 0, ra);
                 uint64_t ol = cpu_ldq_data_ra(env, a1 + 8, ra);
@@ -1583,14 +1579,9 @@ static uint32_t do_csst(CPUS390XState *env, uint32_t r3, uint64_t a1,
             break;
         case 4:
             if (parallel) {
-#ifdef CONFIG_ATOMIC128
                 TCGMemOpIdx oi = make_memop_idx(MO_TEQ | MO_ALIGN_16, mem_idx);
                 Int128 sv = int128_make128(svl, svh);
                 helper_atomic_sto_be_mmu(env, a2, sv, oi, ra);
-#else
-                /* Note that we asserted !parallel above.  */
-                g_assert_not_reached();
-#endif
             } else {
                 cpu_stq_data_ra(env, a2 + 0, svh, ra);
                 cpu_stq_data_ra(env, a2 + 8, svl, ra);
@@ -2092,15 +2083,16 @@ static uint64_t do_lpq(CPUS390XState *env, uint64_t addr, bool parallel)
     uint64_t hi, lo;
 
     if (parallel) {
-#ifndef CONFIG_ATOMIC128
-        cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
-#else
         int mem_idx = cpu_mmu_index(env, false);
         TCGMemOpIdx oi = make_memop_idx(MO_TEQ | MO_ALIGN_16, mem_idx);
-        Int128 v = helper_atomic_ldo_be_mmu(env, addr, oi, ra);
+        Int128 v;
+
+        if (!HAVE_ATOMIC128) {
+            cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
+        }
+        v = helper_atomic_ldo_be_mmu(env, addr, oi, ra);
         hi = int128_gethi(v);
         lo = int128_getlo(v);
-#endif
     } else {
         check_alignment(env, addr, 16, ra);
 
@@ -2129,15 +2121,14 @@ static void do_stpq(CPUS390XState *env, uint64_t addr,
     uintptr_t ra = GETPC();
 
     if (parallel) {
-#ifndef CONFIG_ATOMIC128
-        cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
-#else
         int mem_idx = cpu_mmu_index(env, false);
         TCGMemOpIdx oi = make_memop_idx(MO_TEQ | MO_ALIGN_16, mem_idx);
-
         Int128 v = int128_make128(low, high);
+
+        if (!HAVE_ATOMIC128) {
+            cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
+        }
         helper_atomic_sto_be_mmu(env, addr, v, oi, ra);
-#endif
     } else {
         check_alignment(env, addr, 16, ra);
 
@@ -154,6 +154,7 @@ bool have_bmi1;
 bool have_popcnt;
 bool have_avx1;
 bool have_avx2;
+bool have_avx512;
 
 #ifdef CONFIG_CPUID_H
 static bool have_movbe;
@@ -334,6 +335,7 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define OPC_ARITH_GvEv	(0x03)		/* ... plus (ARITH_FOO << 3) */
 #define OPC_ANDN        (0xf2 | P_EXT38)
 #define OPC_ADD_GvEv	(OPC_ARITH_GvEv | (ARITH_ADD << 3))
+#define OPC_AND_GvEv    (OPC_ARITH_GvEv | (ARITH_AND << 3))
 #define OPC_BLENDPS     (0x0c | P_EXT3A | P_DATA16)
 #define OPC_BSF         (0xbc | P_EXT)
 #define OPC_BSR         (0xbd | P_EXT)
@@ -350,6 +352,7 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define OPC_JCC_short	(0x70)		/* ... plus condition code */
 #define OPC_JMP_long	(0xe9)
 #define OPC_JMP_short	(0xeb)
+#define OPC_KMOVQ_KkRy  (0x92 | P_EXT | P_SIMDF2 | P_REXW) /* VEX */
 #define OPC_LEA         (0x8d)
 #define OPC_LZCNT       (0xbd | P_EXT | P_SIMDF3)
 #define OPC_MOVB_EvGv	(0x88)		/* stores, more or less */
@@ -440,13 +443,24 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define OPC_TZCNT       (0xbc | P_EXT | P_SIMDF3)
 #define OPC_UD2         (0x0b | P_EXT)
 #define OPC_VPBLENDD    (0x02 | P_EXT3A | P_DATA16)
+#define OPC_VPBLENDMB   (0x66 | P_EXT38 | P_DATA16) /* EVEX, W1 for VPBLENDMW */
+#define OPC_VPBLENDMD   (0x64 | P_EXT38 | P_DATA16) /* EVEX, W1 for VPBLENDMQ */
 #define OPC_VPBLENDVB   (0x4c | P_EXT3A | P_DATA16)
 #define OPC_VPBROADCASTB (0x78 | P_EXT38 | P_DATA16)
 #define OPC_VPBROADCASTW (0x79 | P_EXT38 | P_DATA16)
 #define OPC_VPBROADCASTD (0x58 | P_EXT38 | P_DATA16)
 #define OPC_VPBROADCASTQ (0x59 | P_EXT38 | P_DATA16)
+#define OPC_VPCMPB      (0x3f | P_EXT3A | P_DATA16) /* EVEX, W1 for VPCMPW */
+#define OPC_VPCMPUB     (0x3e | P_EXT3A | P_DATA16) /* EVEX, W1 for VPCMPUW */
+#define OPC_VPCMPD      (0x1f | P_EXT3A | P_DATA16) /* EVEX, W1 for VPCMPQ */
+#define OPC_VPCMPUD     (0x1e | P_EXT3A | P_DATA16) /* EVEX, W1 for VPCMPUQ */
 #define OPC_VPERMQ      (0x00 | P_EXT3A | P_DATA16 | P_REXW)
 #define OPC_VPERM2I128  (0x46 | P_EXT3A | P_DATA16 | P_VEXL)
+#define OPC_VPMOVB2M    (0x29 | P_EXT38 | P_SIMDF3) /* EVEX, W1 for VPMOVW2M */
+#define OPC_VPMOVD2M    (0x39 | P_EXT38 | P_SIMDF3) /* EVEX, W1 for VPMOVQ2M */
+#define OPC_VPMOVM2B    (0x28 | P_EXT38 | P_SIMDF3) /* EVEX, W1 for VPMOVM2W */
+#define OPC_VPMOVM2D    (0x38 | P_EXT38 | P_SIMDF3) /* EVEX, W1 for VPMOVM2Q */
+#define OPC_VPTERNLOGD  (0x25 | P_EXT3A | P_DATA16) /* EVEX */
 #define OPC_VZEROUPPER  (0x77 | P_EXT)
 #define OPC_XCHG_ax_r32	(0x90)
 
@@ -657,6 +671,64 @@ static void tcg_out_vex_modrm(TCGContext *s, int opc, int r, int v, int rm)
     tcg_out8(s, 0xc0 | (LOWREGMASK(r) << 3) | LOWREGMASK(rm));
 }
 
+/* The EVEX prefix is only used for 512-bit operations.  We do not
+   allocate %zmm16-31, so EVEX.R' and EVEX.V' are always clear, and we
+   never use broadcast.  A non-zero K selects merge-masking with that
+   opmask register.  */
+static void tcg_out_evex_opc(TCGContext *s, int opc, int r, int v,
+                             int rm, int index, int k)
+{
+    int tmp;
+
+    tcg_out8(s, 0x62);
+
+    /* EVEX.mm */
+    if (opc & P_EXT3A) {
+        tmp = 3;
+    } else if (opc & P_EXT38) {
+        tmp = 2;
+    } else if (opc & P_EXT) {
+        tmp = 1;
+    } else {
+        g_assert_not_reached();
+    }
+    tmp |= (r & 8 ? 0 : 0x80);             /* EVEX.R */
+    tmp |= (index & 8 ? 0 : 0x40);         /* EVEX.X */
+    tmp |= (rm & 8 ? 0 : 0x20);            /* EVEX.B */
+    tmp |= 0x10;                           /* EVEX.R' */
+    tcg_out8(s, tmp);
+
+    tmp = (opc & P_REXW ? 0x80 : 0);       /* EVEX.W */
+    tmp |= (~v & 15) << 3;                 /* EVEX.vvvv */
+    tmp |= 0x04;
+    /* EVEX.pp */
+    if (opc & P_DATA16) {
+        tmp |= 1;                          /* 0x66 */
+    } else if (opc & P_SIMDF3) {
+        tmp |= 2;                          /* 0xf3 */
+    } else if (opc & P_SIMDF2) {
+        tmp |= 3;                          /* 0xf2 */
+    }
+    tcg_out8(s, tmp);
+
+    /* EVEX.L'L = 512 bits, EVEX.V', EVEX.aaa */
+    tcg_out8(s, 0x40 | 0x08 | k);
+    tcg_out8(s, opc);
+}
+
+static void tcg_out_evex_modrm(TCGContext *s, int opc, int r, int v, int rm)
+{
+    tcg_out_evex_opc(s, opc, r, v, rm, 0, 0);
+    tcg_out8(s, 0xc0 | (LOWREGMASK(r) << 3) | LOWREGMASK(rm));
+}
+
+static void tcg_out_evex_modrm_k(TCGContext *s, int opc, int r, int v,
+                                 int rm, int k)
+{
+    tcg_out_evex_opc(s, opc, r, v, rm, 0, k);
+    tcg_out8(s, 0xc0 | (LOWREGMASK(r) << 3) | LOWREGMASK(rm));
+}
+
 /* Output an opcode with a full "rm + (index<<shift) + offset" address mode.
    We handle either RM and INDEX missing with a negative value.  In 64-bit
    mode for absolute addresses, ~RM is the size of the immediate operand
@@ -785,6 +857,47 @@ static inline void tcg_out_vex_modrm_pool(TCGContext *s, int opc, int r)
     tcg_out32(s, 0);
 }
 
+/* Output a full-vector EVEX load or store at RM + OFFSET.  EVEX scales
+   an 8-bit displacement by the size of the memory operand, here the
+   64 bytes of a whole vector, so tcg_out_sib_offset cannot be used.  */
+static void tcg_out_evex_modrm_offset(TCGContext *s, int opc, int r,
+                                      int rm, intptr_t offset)
+{
+    int mod, len;
+
+    tcg_out_evex_opc(s, opc, r, 0, rm, 0, 0);
+
+    if (offset == 0 && LOWREGMASK(rm) != TCG_REG_EBP) {
+        mod = 0, len = 0;
+    } else if (offset % 64 == 0 && offset / 64 == (int8_t)(offset / 64)) {
+        mod = 0x40, len = 1;
+    } else {
+        mod = 0x80, len = 4;
+    }
+
+    tcg_out8(s, mod | (LOWREGMASK(r) << 3) | LOWREGMASK(rm));
+    if (LOWREGMASK(rm) == TCG_REG_ESP) {
+        /* SIB byte with no index.  */
+        tcg_out8(s, 0x24);
+    }
+
+    if (len == 1) {
+        tcg_out8(s, offset / 64);
+    } else if (len == 4) {
+        tcg_out32(s, offset);
+    }
+}
+
+/* Output an opcode with an expected reference to the constant pool.
+   A 32-bit displacement is never scaled.  */
+static inline void tcg_out_evex_modrm_pool(TCGContext *s, int opc, int r)
+{
+    tcg_out_evex_opc(s, opc, r, 0, 0, 0, 0);
+    /* Absolute for 32-bit, pc-relative for 64-bit.  */
+    tcg_out8(s, LOWREGMASK(r) << 3 | 5);
+    tcg_out32(s, 0);
+}
+
 /* Generate dest op= src.  Uses the same ARITH_* codes as tgen_arithi.  */
 static inline void tgen_arithr(TCGContext *s, int subop, int dest, int src)
 {
@@ -834,6 +947,11 @@ static void tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
         tcg_debug_assert(ret >= 16 && arg >= 16);
         tcg_out_vex_modrm(s, OPC_MOVDQA_VxWx | P_VEXL, ret, 0, arg);
         break;
+    case TCG_TYPE_V512:
+        tcg_debug_assert(ret >= 16 && arg >= 16);
+        /* vmovdqa64 */
+        tcg_out_evex_modrm(s, OPC_MOVDQA_VxWx | P_REXW, ret, 0, arg);
+        break;
 
     default:
         g_assert_not_reached();
@@ -843,11 +961,15 @@ static void tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
 static void tcg_out_dup_vec(TCGContext *s, TCGType type, unsigned vece,
                             TCGReg r, TCGReg a)
 {
-    if (have_avx2) {
-        static const int dup_insn[4] = {
-            OPC_VPBROADCASTB, OPC_VPBROADCASTW,
-            OPC_VPBROADCASTD, OPC_VPBROADCASTQ,
-        };
+    static const int dup_insn[4] = {
+        OPC_VPBROADCASTB, OPC_VPBROADCASTW,
+        OPC_VPBROADCASTD, OPC_VPBROADCASTQ,
+    };
+
+    if (type == TCG_TYPE_V512) {
+        tcg_out_evex_modrm(s, dup_insn[vece] | (vece == MO_64 ? P_REXW : 0),
+                           r, 0, a);
+    } else if (have_avx2) {
         int vex_l = (type == TCG_TYPE_V256 ? P_VEXL : 0);
         tcg_out_vex_modrm(s, dup_insn[vece] + vex_l, r, 0, a);
     } else {
@@ -881,9 +1003,20 @@ static void tcg_out_dupi_vec(TCGContext *s, TCGType type,
     int vex_l = (type == TCG_TYPE_V256 ? P_VEXL : 0);
 
     if (arg == 0) {
+        /* The VEX encoding clears the register up to the full width.  */
         tcg_out_vex_modrm(s, OPC_PXOR, ret, ret, ret);
         return;
     }
+    if (type == TCG_TYPE_V512) {
+        if (arg == -1) {
+            tcg_out_evex_modrm(s, OPC_VPTERNLOGD, ret, ret, ret);
+            tcg_out8(s, 0xff);
+        } else {
+            tcg_out_evex_modrm_pool(s, OPC_VPBROADCASTQ | P_REXW, ret);
+            new_pool_label(s, arg, R_386_PC32, s->code_ptr - 4, -4);
+        }
+        return;
+    }
     if (arg == -1) {
         tcg_out_vex_modrm(s, OPC_PCMPEQB + vex_l, ret, ret, ret);
         return;
@@ -925,6 +1058,7 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         tcg_debug_assert(ret >= 16);
         tcg_out_dupi_vec(s, type, ret, arg);
         return;
@@ -1025,6 +1159,12 @@ static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret,
         tcg_out_vex_modrm_offset(s, OPC_MOVDQU_VxWx | P_VEXL,
                                  ret, 0, arg1, arg2);
         break;
+    case TCG_TYPE_V512:
+        tcg_debug_assert(ret >= 16);
+        /* vmovdqu64 */
+        tcg_out_evex_modrm_offset(s, OPC_MOVDQU_VxWx | P_REXW,
+                                  ret, arg1, arg2);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1060,6 +1200,11 @@ static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg,
         tcg_out_vex_modrm_offset(s, OPC_MOVDQU_WxVx | P_VEXL,
                                  arg, 0, arg1, arg2);
         break;
+    case TCG_TYPE_V512:
+        tcg_debug_assert(arg >= 16);
+        tcg_out_evex_modrm_offset(s, OPC_MOVDQU_WxVx | P_REXW,
+                                  arg, arg1, arg2);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1629,7 +1774,7 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
         }
         if (TCG_TYPE_PTR == TCG_TYPE_I64) {
             hrexw = P_REXW;
-            if (TARGET_PAGE_BITS + CPU_TLB_BITS > 32) {
+            if (TARGET_PAGE_BITS + CPU_TLB_DYN_MAX_BITS > 32) {
                 tlbtype = TCG_TYPE_I64;
                 tlbrexw = P_REXW;
             }
@@ -1637,6 +1782,17 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     }
 
     tcg_out_mov(s, tlbtype, r0, addrlo);
+    tcg_out_shifti(s, SHIFT_SHR + tlbrexw, r0,
+                   TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
+
+    /* and tlb_mask[mem_index](env), r0 */
+    tcg_out_modrm_offset(s, OPC_AND_GvEv + hrexw, r0, TCG_AREG0,
+                         offsetof(CPUArchState, tlb_mask[mem_index]));
+
+    /* add tlb_table[mem_index](env), r0 */
+    tcg_out_modrm_offset(s, OPC_ADD_GvEv + hrexw, r0, TCG_AREG0,
+                         offsetof(CPUArchState, tlb_table[mem_index]));
+
     /* If the required alignment is at least as large as the access, simply
        copy the address and mask.  For lesser alignments, check that we don't
        cross pages for the complete access.  */
@@ -1646,20 +1802,10 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
         tcg_out_modrm_offset(s, OPC_LEA + trexw, r1, addrlo, s_mask - a_mask);
     }
     tlb_mask = (target_ulong)TARGET_PAGE_MASK | a_mask;
-
-    tcg_out_shifti(s, SHIFT_SHR + tlbrexw, r0,
-                   TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
-
     tgen_arithi(s, ARITH_AND + trexw, r1, tlb_mask, 0);
-    tgen_arithi(s, ARITH_AND + tlbrexw, r0,
-                (CPU_TLB_SIZE - 1) << CPU_TLB_ENTRY_BITS, 0);
-
-    tcg_out_modrm_sib_offset(s, OPC_LEA + hrexw, r0, TCG_AREG0, r0, 0,
-                             offsetof(CPUArchState, tlb_table[mem_index][0])
-                             + which);
 
-    /* cmp 0(r0), r1 */
-    tcg_out_modrm_offset(s, OPC_CMP_GvEv + trexw, r1, r0, 0);
+    /* cmp which(r0), r1 */
+    tcg_out_modrm_offset(s, OPC_CMP_GvEv + trexw, r1, r0, which);
 
     /* Prepare for both the fast path add of the tlb addend, and the slow
        path function argument setup.  There are two cases worth note:
@@ -1675,8 +1821,8 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     s->code_ptr += 4;
 
     if (TARGET_LONG_BITS > TCG_TARGET_REG_BITS) {
-        /* cmp 4(r0), addrhi */
-        tcg_out_modrm_offset(s, OPC_CMP_GvEv, addrhi, r0, 4);
+        /* cmp which+4(r0), addrhi */
+        tcg_out_modrm_offset(s, OPC_CMP_GvEv, addrhi, r0, which + 4);
 
         /* jne slow_path */
         tcg_out_opc(s, OPC_JCC_long + JCC_JNE, 0, 0, 0);
@@ -1688,7 +1834,7 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
 
     /* add addend(r0), r1 */
     tcg_out_modrm_offset(s, OPC_ADD_GvEv + hrexw, r1, r0,
-                         offsetof(CPUTLBEntry, addend) - which);
+                         offsetof(CPUTLBEntry, addend));
 }
 
 /*
@@ -2622,6 +2768,142 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
 #undef OP_32_64
 }
 
+/* With EVEX, several insns use W to select between dword and qword
+   elements, so the MO_64 entries below include P_REXW.  Comparisons
+   write an opmask register, which we expand back into a vector.  */
+static void tcg_out_vec512_op(TCGContext *s, TCGOpcode opc, unsigned vece,
+                              const TCGArg *args)
+{
+    static int const add_insn[4] = {
+        OPC_PADDB, OPC_PADDW, OPC_PADDD, OPC_PADDQ | P_REXW
+    };
+    static int const sub_insn[4] = {
+        OPC_PSUBB, OPC_PSUBW, OPC_PSUBD, OPC_PSUBQ | P_REXW
+    };
+    static int const mul_insn[4] = {
+        OPC_UD2, OPC_PMULLW, OPC_PMULLD, OPC_PMULLD | P_REXW
+    };
+    static int const shift_imm_insn[4] = {
+        OPC_UD2, OPC_PSHIFTW_Ib, OPC_PSHIFTD_Ib, OPC_PSHIFTQ_Ib | P_REXW
+    };
+    static int const cmp_insn[4] = {
+        OPC_VPCMPB, OPC_VPCMPB | P_REXW, OPC_VPCMPD, OPC_VPCMPD | P_REXW
+    };
+    static int const cmpu_insn[4] = {
+        OPC_VPCMPUB, OPC_VPCMPUB | P_REXW, OPC_VPCMPUD, OPC_VPCMPUD | P_REXW
+    };
+    static int const movm2_insn[4] = {
+        OPC_VPMOVM2B, OPC_VPMOVM2B | P_REXW,
+        OPC_VPMOVM2D, OPC_VPMOVM2D | P_REXW
+    };
+    static int const mov2m_insn[4] = {
+        OPC_VPMOVB2M, OPC_VPMOVB2M | P_REXW,
+        OPC_VPMOVD2M, OPC_VPMOVD2M | P_REXW
+    };
+    static int const blendm_insn[4] = {
+        OPC_VPBLENDMB, OPC_VPBLENDMB | P_REXW,
+        OPC_VPBLENDMD, OPC_VPBLENDMD | P_REXW
+    };
+    /* The VPCMP predicate immediate.  */
+    static uint8_t const cmp_pred[16] = {
+        [TCG_COND_EQ] = 0,
+        [TCG_COND_LT] = 1, [TCG_COND_LTU] = 1,
+        [TCG_COND_LE] = 2, [TCG_COND_LEU] = 2,
+        [TCG_COND_NE] = 4,
+        [TCG_COND_GE] = 5, [TCG_COND_GEU] = 5,
+        [TCG_COND_GT] = 6, [TCG_COND_GTU] = 6,
+    };
+    /* %k1 is not otherwise used by TCG.  */
+    const int kreg = 1;
+
+    TCGArg a0 = args[0], a1 = args[1], a2 = args[2];
+    int insn, sub;
+
+    switch (opc) {
+    case INDEX_op_add_vec:
+        insn = add_insn[vece];
+        goto gen_simd;
+    case INDEX_op_sub_vec:
+        insn = sub_insn[vece];
+        goto gen_simd;
+    case INDEX_op_mul_vec:
+        insn = mul_insn[vece];
+        goto gen_simd;
+    case INDEX_op_and_vec:
+        insn = OPC_PAND | P_REXW;
+        goto gen_simd;
+    case INDEX_op_or_vec:
+        insn = OPC_POR | P_REXW;
+        goto gen_simd;
+    case INDEX_op_xor_vec:
+        insn = OPC_PXOR | P_REXW;
+    gen_simd:
+        tcg_debug_assert(insn != OPC_UD2);
+        tcg_out_evex_modrm(s, insn, a0, a1, a2);
+        break;
+
+    case INDEX_op_andc_vec:
+        tcg_out_evex_modrm(s, OPC_PANDN | P_REXW, a0, a2, a1);
+        break;
+
+    case INDEX_op_cmp_vec:
+        sub = args[3];
+        insn = is_unsigned_cond(sub) ? cmpu_insn[vece] : cmp_insn[vece];
+        tcg_out_evex_modrm(s, insn, kreg, a1, a2);
+        tcg_out8(s, cmp_pred[sub]);
+        tcg_out_evex_modrm(s, movm2_insn[vece], a0, 0, kreg);
+        break;
+
+    case INDEX_op_predsel_vec:
+        /* The mask has one bit per byte.  For wider elements, keep the
+           bit of the least significant byte: expand the mask to bytes,
+           shift each element's low byte into its sign bit, and collect
+           the sign bits into %k1 again.  A0 is a new register, so it
+           can be clobbered before A1 and A2 are read.  */
+        tcg_out_vex_modrm(s, OPC_KMOVQ_KkRy, kreg, 0, args[3]);
+        if (vece != MO_8) {
+            tcg_out_evex_modrm(s, OPC_VPMOVM2B, a0, 0, kreg);
+            tcg_out_evex_modrm(s, shift_imm_insn[vece], 6, a0, a0);
+            tcg_out8(s, (8 << vece) - 8);
+            tcg_out_evex_modrm(s, mov2m_insn[vece], kreg, 0, a0);
+        }
+        tcg_out_evex_modrm_k(s, blendm_insn[vece], a0, a2, a1, kreg);
+        break;
+
+    case INDEX_op_shli_vec:
+        sub = 6;
+        goto gen_shift;
+    case INDEX_op_shri_vec:
+        sub = 2;
+        goto gen_shift;
+    case INDEX_op_sari_vec:
+        sub = 4;
+    gen_shift:
+        tcg_debug_assert(vece != MO_8);
+        insn = shift_imm_insn[vece];
+        if (vece == MO_64 && sub == 4) {
+            /* vpsraq shares its opcode with vpsrad.  */
+            insn = OPC_PSHIFTD_Ib | P_REXW;
+        }
+        tcg_out_evex_modrm(s, insn, sub, a0, a1);
+        tcg_out8(s, a2);
+        break;
+
+    case INDEX_op_ld_vec:
+        tcg_out_ld(s, TCG_TYPE_V512, a0, a1, a2);
+        break;
+    case INDEX_op_st_vec:
+        tcg_out_st(s, TCG_TYPE_V512, a0, a1, a2);
+        break;
+    case INDEX_op_dup_vec:
+        tcg_out_dup_vec(s, TCG_TYPE_V512, vece, a0, a1);
+        break;
+
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
                            unsigned vecl, unsigned vece,
                            const TCGArg *args, const int *const_args)
@@ -2661,6 +2943,11 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
     int insn, sub;
     TCGArg a0, a1, a2;
 
+    if (type == TCG_TYPE_V512) {
+        tcg_out_vec512_op(s, opc, vece, args);
+        return;
+    }
+
     a0 = args[0];
     a1 = args[1];
     a2 = args[2];
@@ -3063,6 +3350,12 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
         return &x_x;
     case INDEX_op_x86_vpblendvb_vec:
         return &x_x_x_x;
+    case INDEX_op_predsel_vec:
+        {
+            static const TCGTargetOpDef ps
+                = { .args_ct_str = { "&x", "x", "x", "r" } };
+            return &ps;
+        }
 
     default:
         break;
@@ -3072,6 +3365,29 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
 
 int tcg_can_emit_vec_op(TCGOpcode opc, TCGType type, unsigned vece)
 {
+    if (type == TCG_TYPE_V512) {
+        /* None of the expansions below are available for 512 bits;
+           leave those element sizes to the narrower types.  */
+        switch (opc) {
+        case INDEX_op_add_vec:
+        case INDEX_op_sub_vec:
+        case INDEX_op_and_vec:
+        case INDEX_op_or_vec:
+        case INDEX_op_xor_vec:
+        case INDEX_op_andc_vec:
+        case INDEX_op_cmp_vec:
+        case INDEX_op_predsel_vec:
+            return 1;
+        case INDEX_op_shli_vec:
+        case INDEX_op_shri_vec:
+        case INDEX_op_sari_vec:
+        case INDEX_op_mul_vec:
+            return vece != MO_8;
+        default:
+            return 0;
+        }
+    }
+
     switch (opc) {
     case INDEX_op_add_vec:
     case INDEX_op_sub_vec:
@@ -3509,6 +3825,16 @@ static void tcg_target_init(TCGContext *s)
                 have_avx1 = (c & bit_AVX) != 0;
                 have_avx2 = (b7 & bit_AVX2) != 0;
             }
+            /* The OS must also save the opmask and upper ZMM state.  We
+               use byte and quadword element operations from AVX512BW and
+               AVX512DQ, so require those along with the foundation.
+               EVEX.W selects the element size, so only for 64-bit.  */
+            if (TCG_TARGET_REG_BITS == 64 && (xcrl & 0xe6) == 0xe6
+                && have_avx2) {
+                const unsigned avx512 = bit_AVX512F | bit_AVX512DQ
+                                        | bit_AVX512BW;
+                have_avx512 = (b7 & avx512) == avx512;
+            }
         }
     }
 
@@ -3531,6 +3857,9 @@ static void tcg_target_init(TCGContext *s)
     if (have_avx2) {
         tcg_target_available_regs[TCG_TYPE_V256] = ALL_VECTOR_REGS;
     }
+    if (have_avx512) {
+        tcg_target_available_regs[TCG_TYPE_V512] = ALL_VECTOR_REGS;
+    }
 
     tcg_target_call_clobber_regs = ALL_VECTOR_REGS;
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_EAX);
@@ -1216,27 +1216,26 @@ static void tcg_out_tlb_load(TCGContext *s, TCGReg base, TCGReg addrl,
     unsigned a_bits = get_alignment_bits(opc);
     target_ulong mask;
     int mem_index = get_mmuidx(oi);
+    int mask_off = offsetof(CPUArchState, tlb_mask[mem_index]);
+    int table_off = offsetof(CPUArchState, tlb_table[mem_index]);
     int cmp_off
         = (is_load
-           ? offsetof(CPUArchState, tlb_table[mem_index][0].addr_read)
-           : offsetof(CPUArchState, tlb_table[mem_index][0].addr_write));
-    int add_off = offsetof(CPUArchState, tlb_table[mem_index][0].addend);
+           ? offsetof(CPUTLBEntry, addr_read)
+           : offsetof(CPUTLBEntry, addr_write));
+    int add_off = offsetof(CPUTLBEntry, addend);
 
-    tcg_out_opc_sa(s, ALIAS_TSRL, TCG_REG_A0, addrl,
+    /* Load tlb_mask[mmu_idx] and tlb_table[mmu_idx].  Very large
+       offsets into env are handled by tcg_out_ld, using TMP0.  */
+    tcg_out_ld(s, TCG_TYPE_PTR, TCG_REG_A0, TCG_AREG0, mask_off);
+    tcg_out_ld(s, TCG_TYPE_PTR, TCG_TMP1, TCG_AREG0, table_off);
+
+    /* Extract the TLB index from the address into A0.  */
+    tcg_out_opc_sa(s, ALIAS_TSRL, TCG_TMP0, addrl,
                    TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
-    tcg_out_opc_imm(s, OPC_ANDI, TCG_REG_A0, TCG_REG_A0,
-                    (CPU_TLB_SIZE - 1) << CPU_TLB_ENTRY_BITS);
-    tcg_out_opc_reg(s, ALIAS_PADD, TCG_REG_A0, TCG_REG_A0, TCG_AREG0);
-
-    /* Compensate for very large offsets.  */
-    while (add_off >= 0x8000) {
-        /* Most target env are smaller than 32k, but a few are larger than 64k,
-         * so handle an arbitrarily large offset.
-         */
-        tcg_out_opc_imm(s, ALIAS_PADDI, TCG_REG_A0, TCG_REG_A0, 0x7ff0);
-        cmp_off -= 0x7ff0;
-        add_off -= 0x7ff0;
-    }
+    tcg_out_opc_reg(s, OPC_AND, TCG_REG_A0, TCG_REG_A0, TCG_TMP0);
+
+    /* Add the tlb_table pointer, creating the CPUTLBEntry address in A0.  */
+    tcg_out_opc_reg(s, ALIAS_PADD, TCG_REG_A0, TCG_REG_A0, TCG_TMP1);
 
     /* We don't currently support unaligned accesses.
        We could do so with mips32r6.  */
@@ -587,13 +587,264 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
-/* Propagate constants and copies, fold constant expressions. */
+/*
+ * Translators access some CPU state, such as vector registers, with
+ * explicit loads and stores to env rather than through globals, and
+ * reload it for every guest instruction.  Within a basic block, remember
+ * which temp holds the contents of each such field, so that loads can be
+ * replaced with moves, and which stores have not been read yet, so that
+ * those overwritten by a later store can be removed.
+ */
+typedef struct EnvMemInfo {
+    intptr_t start;
+    intptr_t end;
+    TCGOpcode ld_opc;   /* the load that reads back @val */
+    TCGTemp *val;       /* holds the contents of the field, or NULL */
+    TCGOp *store;       /* a store to the field that is still unread */
+} EnvMemInfo;
+
+#define MAX_ENV_MEM_INFO 32
+
+typedef struct EnvMemState {
+    int nb_info;
+    EnvMemInfo info[MAX_ENV_MEM_INFO];
+} EnvMemState;
+
+/* Find the env range accessed by a load or store op */
+static bool env_mem_range(TCGOp *op, intptr_t *start, intptr_t *end)
+{
+    int size;
+
+    switch (op->opc) {
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(st8):
+        size = 1;
+        break;
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(st16):
+        size = 2;
+        break;
+    case INDEX_op_ld_i32:
+    case INDEX_op_st_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_st32_i64:
+        size = 4;
+        break;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        size = 8;
+        break;
+    case INDEX_op_ld_vec:
+    case INDEX_op_st_vec:
+        size = 8 << TCGOP_VECL(op);
+        break;
+    default:
+        return false;
+    }
+    *start = op->args[2];
+    *end = *start + size;
+    return true;
+}
+
+/* The load that reads back all of the value stored by @opc, if any */
+static TCGOpcode env_mem_load_opc(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_st_i32:
+        return INDEX_op_ld_i32;
+    case INDEX_op_st_i64:
+        return INDEX_op_ld_i64;
+    case INDEX_op_st_vec:
+        return INDEX_op_ld_vec;
+    default:
+        return INDEX_op_discard;
+    }
+}
+
+static void env_mem_add(EnvMemState *e, intptr_t start, intptr_t end,
+                        TCGOpcode ld_opc, TCGTemp *val, TCGOp *store)
+{
+    EnvMemInfo *info;
+
+    if (e->nb_info == MAX_ENV_MEM_INFO) {
+        return;
+    }
+    info = &e->info[e->nb_info++];
+    info->start = start;
+    info->end = end;
+    info->ld_opc = ld_opc;
+    info->val = val;
+    info->store = store;
+}
+
+/* @ts is about to change, so it no longer holds any field */
+static void env_mem_forget(EnvMemState *e, TCGTemp *ts)
+{
+    int i;
+
+    for (i = 0; i < e->nb_info; i++) {
+        if (e->info[i].val == ts) {
+            e->info[i].val = NULL;
+        }
+    }
+}
+
+/* env may be read by something we do not track; keep all the stores */
+static void env_mem_sync(EnvMemState *e)
+{
+    int i;
+
+    for (i = 0; i < e->nb_info; i++) {
+        e->info[i].store = NULL;
+    }
+}
+
+/* Returns true if the load was replaced with a move */
+static bool env_mem_load(TCGContext *s, EnvMemState *e, TCGOp *op,
+                         intptr_t start, intptr_t end)
+{
+    TCGTemp *dst = arg_temp(op->args[0]);
+    TCGTemp *val = NULL;
+    int i;
+
+    for (i = 0; i < e->nb_info; i++) {
+        EnvMemInfo *info = &e->info[i];
+
+        if (info->start < end && start < info->end) {
+            info->store = NULL;
+            if (info->start == start && info->end == end &&
+                info->ld_opc == op->opc && info->val &&
+                info->val->type == dst->type) {
+                val = info->val;
+            }
+        }
+    }
+
+    if (val) {
+        if (val != dst) {
+            env_mem_forget(e, dst);
+        }
+        tcg_opt_gen_mov(s, op, op->args[0], temp_arg(val));
+#ifdef CONFIG_PROFILER
+        atomic_set(&s->prof.env_ld_fwd_count, s->prof.env_ld_fwd_count + 1);
+#endif
+        return true;
+    }
+    env_mem_forget(e, dst);
+    env_mem_add(e, start, end, op->opc, dst, NULL);
+    return false;
+}
+
+/* Returns true if the store was removed */
+static bool env_mem_store(TCGContext *s, EnvMemState *e, TCGOp *op,
+                          intptr_t start, intptr_t end)
+{
+    TCGTemp *val = arg_temp(op->args[0]);
+    TCGOpcode ld_opc = env_mem_load_opc(op->opc);
+    int i;
+
+    for (i = 0; i < e->nb_info; i++) {
+        EnvMemInfo *info = &e->info[i];
+
+        /* Storing what the field already holds */
+        if (info->start == start && info->end == end &&
+            info->ld_opc == ld_opc && info->val == val) {
+            tcg_op_remove(s, op);
+            return true;
+        }
+    }
+
+    for (i = 0; i < e->nb_info; ) {
+        EnvMemInfo *info = &e->info[i];
+
+        if (info->start < end && start < info->end) {
+            if (info->store && start <= info->start && info->end <= end) {
+                tcg_op_remove(s, info->store);
+#ifdef CONFIG_PROFILER
+                atomic_set(&s->prof.env_st_del_count,
+                           s->prof.env_st_del_count + 1);
+#endif
+            }
+            *info = e->info[--e->nb_info];
+        } else {
+            i++;
+        }
+    }
+    env_mem_add(e, start, end, ld_opc,
+                ld_opc == INDEX_op_discard ? NULL : val, op);
+    return false;
+}
+
+/* Returns true if @op was removed or replaced with a move */
+static bool env_mem_op(TCGContext *s, EnvMemState *e, TCGOp *op,
+                       int nb_oargs, int nb_iargs)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    TCGTemp *env = tcgv_ptr_temp(cpu_env);
+    intptr_t start, end;
+    int i;
+
+    if (def->flags & TCG_OPF_BB_END) {
+        e->nb_info = 0;
+        return false;
+    }
+    if (op->opc == INDEX_op_call) {
+        int flags = op->args[nb_oargs + nb_iargs + 1];
+
+        /* Helpers can reach all of env, but pure ones only read it */
+        if ((flags & (TCG_CALL_NO_SIDE_EFFECTS | TCG_CALL_NO_WRITE_GLOBALS))
+            != (TCG_CALL_NO_SIDE_EFFECTS | TCG_CALL_NO_WRITE_GLOBALS)) {
+            e->nb_info = 0;
+            return false;
+        }
+        env_mem_sync(e);
+    } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
+        /*
+         * An exception leaves the TB with env as it is now.  Guest memory
+         * accesses do not modify env otherwise, as for globals.
+         */
+        env_mem_sync(e);
+    }
+
+    if (op->opc == INDEX_op_call || !env_mem_range(op, &start, &end)) {
+        for (i = 0; i < nb_oargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (ts) {
+                env_mem_forget(e, ts);
+            }
+        }
+        return false;
+    }
+
+    if (def->nb_oargs == 0) {
+        if (arg_temp(op->args[1]) == env) {
+            return env_mem_store(s, e, op, start, end);
+        }
+        /* This may point into env */
+        e->nb_info = 0;
+        return false;
+    }
+    if (arg_temp(op->args[1]) == env) {
+        return env_mem_load(s, e, op, start, end);
+    }
+    env_mem_sync(e);
+    env_mem_forget(e, arg_temp(op->args[0]));
+    return false;
+}
+
+/* Propagate constants and copies, fold constant expressions, and forward
+   and remove loads and stores of env.  */
 void tcg_optimize(TCGContext *s)
 {
     int nb_temps, nb_globals;
     TCGOp *op, *op_next, *prev_mb = NULL;
     struct tcg_temp_info *infos;
     TCGTempSet temps_used;
+    EnvMemState env_mem;
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -604,6 +855,7 @@ void tcg_optimize(TCGContext *s)
     nb_globals = s->nb_globals;
     bitmap_zero(temps_used.l, nb_temps);
     infos = tcg_malloc(sizeof(struct tcg_temp_info) * nb_temps);
+    env_mem.nb_info = 0;
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         tcg_target_ulong mask, partmask, affected;
@@ -639,6 +891,10 @@ void tcg_optimize(TCGContext *s)
             }
         }
 
+        if (env_mem_op(s, &env_mem, op, nb_oargs, nb_iargs)) {
+            continue;
+        }
+
         /* For commutative operations make constant second argument */
         switch (opc) {
         CASE_OP_32_64_VEC(add):
@@ -1431,10 +1687,16 @@ void tcg_optimize(TCGContext *s)
             break;
 
         case INDEX_op_call:
-            if (!(op->args[nb_oargs + nb_iargs + 1]
-                  & (TCG_CALL_NO_READ_GLOBALS | TCG_CALL_NO_WRITE_GLOBALS))) {
+            tmp = op->args[nb_oargs + nb_iargs + 1];
+            if (!(tmp & (TCG_CALL_NO_READ_GLOBALS
+                         | TCG_CALL_NO_WRITE_GLOBALS))) {
+                const TCGHelperGlobals *g = tcg_call_globals(op);
+
+                /* Only the globals that the helper may write change */
                 for (i = 0; i < nb_globals; i++) {
-                    if (test_bit(i, temps_used.l)) {
+                    if (test_bit(i, temps_used.l)
+                        && tcg_call_global_flags(s, g, tmp,
+                                                 &s->temps[i]) == 0) {
                         reset_ts(&s->temps[i]);
                     }
                 }
@@ -363,6 +363,20 @@ static void gen_dup_i64(unsigned vece, TCGv_i64 out, TCGv_i64 in)
 static TCGType choose_vector_type(TCGOpcode op, unsigned vece, uint32_t size,
                                   bool prefer_i64)
 {
+    /* With SVE at a vector length of 512 bits or more, a single host
+     * operation covers a whole guest register or a power-of-2 part of it.
+     * Any remainder is handled by the narrower types, as for V256.
+     */
+    if (TCG_TARGET_HAS_v512 && check_size_impl(size, 64)) {
+        if (op == 0) {
+            return TCG_TYPE_V512;
+        }
+        if (tcg_can_emit_vec_op(op, TCG_TYPE_V512, vece)
+            && (size % 64 == 0
+                || tcg_can_emit_vec_op(op, TCG_TYPE_V256, vece))) {
+            return TCG_TYPE_V512;
+        }
+    }
     if (TCG_TARGET_HAS_v256 && check_size_impl(size, 32)) {
         if (op == 0) {
             return TCG_TYPE_V256;
@@ -447,6 +461,11 @@ static void do_dup(unsigned vece, uint32_t dofs, uint32_t oprsz,
 
         i = 0;
         switch (type) {
+        case TCG_TYPE_V512:
+            for (; i + 64 <= oprsz; i += 64) {
+                tcg_gen_stl_vec(t_vec, cpu_env, dofs + i, TCG_TYPE_V512);
+            }
+            /* fallthru */
         case TCG_TYPE_V256:
             /* Recall that ARM SVE allows vector sizes that are not a
              * power of 2, but always a multiple of 16.  The intent is
@@ -918,6 +937,17 @@ void tcg_gen_gvec_2(uint32_t dofs, uint32_t aofs,
         type = choose_vector_type(g->opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_2_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -976,6 +1006,18 @@ void tcg_gen_gvec_2i(uint32_t dofs, uint32_t aofs, uint32_t oprsz,
         type = choose_vector_type(g->opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_2i_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                      c, g->load_dest, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1048,6 +1090,18 @@ void tcg_gen_gvec_2s(uint32_t dofs, uint32_t aofs, uint32_t oprsz,
         tcg_gen_dup_i64_vec(g->vece, t_vec, c);
 
         switch (type) {
+        case TCG_TYPE_V512:
+            some = QEMU_ALIGN_DOWN(oprsz, 64);
+            expand_2s_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                          t_vec, g->scalar_first, g->fniv);
+            if (some == oprsz) {
+                break;
+            }
+            dofs += some;
+            aofs += some;
+            oprsz -= some;
+            maxsz -= some;
+            /* fallthru */
         case TCG_TYPE_V256:
             /* Recall that ARM SVE allows vector sizes that are not a
              * power of 2, but always a multiple of 16.  The intent is
@@ -1117,6 +1171,19 @@ void tcg_gen_gvec_3(uint32_t dofs, uint32_t aofs, uint32_t bofs,
         type = choose_vector_type(g->opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_3_vec(g->vece, dofs, aofs, bofs, some, 64, TCG_TYPE_V512,
+                     g->load_dest, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1180,6 +1247,20 @@ void tcg_gen_gvec_4(uint32_t dofs, uint32_t aofs, uint32_t bofs, uint32_t cofs,
         type = choose_vector_type(g->opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_4_vec(g->vece, dofs, aofs, bofs, cofs, some,
+                     64, TCG_TYPE_V512, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        cofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1229,6 +1310,66 @@ void tcg_gen_gvec_4(uint32_t dofs, uint32_t aofs, uint32_t bofs, uint32_t cofs,
     }
 }
 
+/* Expand OPSZ bytes worth of predicated three-operand operations,
+   64 bytes at a time: predsel_vec takes one 64-bit predicate word,
+   which covers exactly one V512 vector.  */
+static void expand_3_pred_vec(unsigned vece, uint32_t dofs, uint32_t aofs,
+                              uint32_t bofs, uint32_t pofs, uint32_t oprsz,
+                              bool inactive_b,
+                              void (*fni)(unsigned, TCGv_vec,
+                                          TCGv_vec, TCGv_vec))
+{
+    TCGv_vec t0 = tcg_temp_new_vec(TCG_TYPE_V512);
+    TCGv_vec t1 = tcg_temp_new_vec(TCG_TYPE_V512);
+    TCGv_vec t2 = tcg_temp_new_vec(TCG_TYPE_V512);
+    TCGv_i64 p = tcg_temp_new_i64();
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 64) {
+        tcg_gen_ld_vec(t1, cpu_env, aofs + i);
+        tcg_gen_ld_vec(t2, cpu_env, bofs + i);
+        fni(vece, t0, t1, t2);
+        if (!inactive_b) {
+            tcg_gen_ld_vec(t2, cpu_env, dofs + i);
+        }
+        tcg_gen_ld_i64(p, cpu_env, pofs + i / 8);
+        tcg_gen_predsel_vec(vece, t0, p, t0, t2);
+        tcg_gen_st_vec(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(p);
+    tcg_temp_free_vec(t2);
+    tcg_temp_free_vec(t1);
+    tcg_temp_free_vec(t0);
+}
+
+/* Expand a predicated vector three-operand operation.  Without a host
+   vector type that supports predsel_vec and the operation itself for
+   the whole of OPRSZ, call the out-of-line helper.  */
+void tcg_gen_gvec_3_pred(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                         uint32_t pofs, uint32_t oprsz, uint32_t maxsz,
+                         const GVecGen3Pred *g)
+{
+    check_size_align(oprsz, maxsz, dofs | aofs | bofs);
+    check_overlap_3(dofs, aofs, bofs, maxsz);
+
+    if (TCG_TARGET_HAS_v512 && TCG_TARGET_HAS_predsel_vec
+        && g->fniv && oprsz % 64 == 0
+        && tcg_can_emit_vec_op(INDEX_op_predsel_vec,
+                               TCG_TYPE_V512, g->vece) > 0
+        && (g->opc == 0
+            || tcg_can_emit_vec_op(g->opc, TCG_TYPE_V512, g->vece))) {
+        expand_3_pred_vec(g->vece, dofs, aofs, bofs, pofs, oprsz,
+                          g->inactive_b, g->fniv);
+        if (oprsz < maxsz) {
+            expand_clr(dofs + oprsz, maxsz - oprsz);
+        }
+    } else {
+        assert(g->fno != NULL);
+        tcg_gen_gvec_4_ool(dofs, aofs, bofs, pofs,
+                           oprsz, maxsz, g->data, g->fno);
+    }
+}
+
 /*
  * Expand specific vector operations.
  */
@@ -2246,6 +2387,18 @@ void tcg_gen_gvec_cmp(TCGCond cond, unsigned vece, uint32_t dofs,
     type = choose_vector_type(INDEX_op_cmp_vec, vece, oprsz,
                               TCG_TARGET_REG_BITS == 64 && vece == MO_64);
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_cmp_vec(vece, dofs, aofs, bofs, some, 64, TCG_TYPE_V512, cond);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
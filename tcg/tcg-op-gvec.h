@@ -183,6 +183,23 @@ typedef struct {
     bool prefer_i64;
 } GVecGen4;
 
+typedef struct {
+    /* Expand inline with a host vector type, if it has predsel_vec.  */
+    void (*fniv)(unsigned, TCGv_vec, TCGv_vec, TCGv_vec);
+    /* Expand out-of-line helper w/descriptor; the predicate is the
+       fourth operand.  */
+    gen_helper_gvec_4 *fno;
+    /* The opcode, if any, to which this corresponds.  */
+    TCGOpcode opc;
+    /* The data argument to the out-of-line helper.  */
+    int32_t data;
+    /* The vector element size, if applicable.  */
+    uint8_t vece;
+    /* Take inactive elements from the 2nd source operand,
+       rather than leaving them unchanged in dest.  */
+    bool inactive_b;
+} GVecGen3Pred;
+
 void tcg_gen_gvec_2(uint32_t dofs, uint32_t aofs,
                     uint32_t oprsz, uint32_t maxsz, const GVecGen2 *);
 void tcg_gen_gvec_2i(uint32_t dofs, uint32_t aofs, uint32_t oprsz,
@@ -194,6 +211,14 @@ void tcg_gen_gvec_3(uint32_t dofs, uint32_t aofs, uint32_t bofs,
 void tcg_gen_gvec_4(uint32_t dofs, uint32_t aofs, uint32_t bofs, uint32_t cofs,
                     uint32_t oprsz, uint32_t maxsz, const GVecGen4 *);
 
+/* The predicate at POFS has one bit per byte of the operands, as for
+   ARM SVE; only the bit for the least significant byte of each element
+   is used.  Active elements of dest are set to the operation on the
+   sources.  */
+void tcg_gen_gvec_3_pred(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                         uint32_t pofs, uint32_t oprsz, uint32_t maxsz,
+                         const GVecGen3Pred *);
+
 /* Expand a specific vector operation.  */
 
 void tcg_gen_gvec_mov(unsigned vece, uint32_t dofs, uint32_t aofs,
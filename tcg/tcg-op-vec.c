@@ -365,6 +365,24 @@ void tcg_gen_cmp_vec(TCGCond cond, unsigned vece,
     }
 }
 
+/* There is no generic expansion; callers must check
+   tcg_can_emit_vec_op(INDEX_op_predsel_vec, type, vece) first.  */
+void tcg_gen_predsel_vec(unsigned vece, TCGv_vec r, TCGv_i64 p,
+                         TCGv_vec a, TCGv_vec b)
+{
+    TCGTemp *rt = tcgv_vec_temp(r);
+    TCGTemp *at = tcgv_vec_temp(a);
+    TCGTemp *bt = tcgv_vec_temp(b);
+    TCGType type = rt->base_type;
+
+    tcg_debug_assert(at->base_type >= type);
+    tcg_debug_assert(bt->base_type >= type);
+    tcg_debug_assert(tcg_can_emit_vec_op(INDEX_op_predsel_vec,
+                                         type, vece) > 0);
+    vec_gen_4(INDEX_op_predsel_vec, type, vece, temp_arg(rt),
+              temp_arg(at), temp_arg(bt), tcgv_i64_arg(p));
+}
+
 void tcg_gen_mul_vec(unsigned vece, TCGv_vec r, TCGv_vec a, TCGv_vec b)
 {
     TCGTemp *rt = tcgv_vec_temp(r);
@@ -2845,6 +2845,9 @@ void tcg_gen_atomic_cmpxchg_i32(TCGv_i32 retv, TCGv addr, TCGv_i32 cmpv,
             tcg_gen_mov_i32(retv, t1);
         }
         tcg_temp_free_i32(t1);
+    } else if (serial_atomics) {
+        gen_helper_exit_atomic(cpu_env);
+        tcg_gen_movi_i32(retv, 0);
     } else {
         gen_atomic_cx_i32 gen;
 
@@ -2889,6 +2892,9 @@ void tcg_gen_atomic_cmpxchg_i64(TCGv_i64 retv, TCGv addr, TCGv_i64 cmpv,
             tcg_gen_mov_i64(retv, t1);
         }
         tcg_temp_free_i64(t1);
+    } else if (serial_atomics) {
+        gen_helper_exit_atomic(cpu_env);
+        tcg_gen_movi_i64(retv, 0);
     } else if ((memop & MO_SIZE) == MO_64) {
 #ifdef CONFIG_ATOMIC64
         gen_atomic_cx_i64 gen;
@@ -2956,6 +2962,12 @@ static void do_atomic_op_i32(TCGv_i32 ret, TCGv addr, TCGv_i32 val,
 
     memop = tcg_canonicalize_memop(memop, 0, 0);
 
+    if (serial_atomics) {
+        gen_helper_exit_atomic(cpu_env);
+        tcg_gen_movi_i32(ret, 0);
+        return;
+    }
+
     gen = table[memop & (MO_SIZE | MO_BSWAP)];
     tcg_debug_assert(gen != NULL);
 
@@ -2997,7 +3009,10 @@ static void do_atomic_op_i64(TCGv_i64 ret, TCGv addr, TCGv_i64 val,
 {
     memop = tcg_canonicalize_memop(memop, 1, 0);
 
-    if ((memop & MO_SIZE) == MO_64) {
+    if (serial_atomics) {
+        gen_helper_exit_atomic(cpu_env);
+        tcg_gen_movi_i64(ret, 0);
+    } else if ((memop & MO_SIZE) == MO_64) {
 #ifdef CONFIG_ATOMIC64
         gen_atomic_op_i64 gen;
 
@@ -967,6 +967,8 @@ void tcg_gen_sari_vec(unsigned vece, TCGv_vec r, TCGv_vec a, int64_t i);
 
 void tcg_gen_cmp_vec(TCGCond cond, unsigned vece, TCGv_vec r,
                      TCGv_vec a, TCGv_vec b);
+void tcg_gen_predsel_vec(unsigned vece, TCGv_vec r, TCGv_i64 p,
+                         TCGv_vec a, TCGv_vec b);
 
 void tcg_gen_ld_vec(TCGv_vec r, TCGv_ptr base, TCGArg offset);
 void tcg_gen_st_vec(TCGv_vec r, TCGv_ptr base, TCGArg offset);
@@ -1208,6 +1210,11 @@ static inline void tcg_gen_ld_ptr(TCGv_ptr r, TCGv_ptr a, intptr_t o)
     glue(tcg_gen_ld_,PTR)((NAT)r, a, o);
 }
 
+static inline void tcg_gen_st_ptr(TCGv_ptr r, TCGv_ptr a, intptr_t o)
+{
+    glue(tcg_gen_st_,PTR)((NAT)r, a, o);
+}
+
 static inline void tcg_gen_discard_ptr(TCGv_ptr a)
 {
     glue(tcg_gen_discard_,PTR)((NAT)a);
@@ -1229,6 +1236,14 @@ static inline void tcg_gen_brcondi_ptr(TCGCond cond, TCGv_ptr a,
     glue(tcg_gen_brcondi_,PTR)(cond, (NAT)a, b, label);
 }
 
+static inline void tcg_gen_movcond_ptr(TCGCond cond, TCGv_ptr ret,
+                                       TCGv_ptr c1, TCGv_ptr c2,
+                                       TCGv_ptr v1, TCGv_ptr v2)
+{
+    glue(tcg_gen_movcond_,PTR)(cond, (NAT)ret, (NAT)c1, (NAT)c2,
+                               (NAT)v1, (NAT)v2);
+}
+
 static inline void tcg_gen_ext_i32_ptr(TCGv_ptr r, TCGv_i32 a)
 {
 #if UINTPTR_MAX == UINT32_MAX
@@ -30,6 +30,7 @@
 /* Define to jump the ELF file used to communicate with GDB.  */
 #undef DEBUG_JIT
 
+#include "qemu/bitmap.h"
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
 #include "qemu/timer.h"
@@ -59,6 +60,7 @@
 #include "elf.h"
 #include "exec/log.h"
 #include "sysemu/sysemu.h"
+#include "perf.h"
 
 /* Forward declarations for functions declared in tcg-target.inc.c and
    used here. */
@@ -146,6 +148,10 @@ struct tcg_region_tree {
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Once all regions are taken, the oldest full ones can be evicted and
+ * handed out again (see tcg_region_evict), which lets the TBs in the
+ * other regions survive.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -159,8 +165,11 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    unsigned long *free; /* regions not assigned to any context */
+    uint64_t *seq; /* order in which the regions were assigned */
+    uint64_t next_seq;
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t n_evicted; /* regions evicted since startup */
 };
 
 static struct tcg_region_state region;
@@ -372,22 +381,24 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_index(void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
+            return region.n - 1;
         } else {
-            region_idx = offset / region.stride;
+            return offset / region.stride;
         }
     }
-    return region_trees + region_idx * tree_size;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -522,11 +533,14 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i = find_first_bit(region.free, region.n);
+
+    if (i == region.n) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    clear_bit(i, region.free);
+    region.seq[i] = region.next_seq++;
+    tcg_region_assign(s, i);
     return false;
 }
 
@@ -565,7 +579,7 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    bitmap_fill(region.free, region.n);
     region.agg_size_full = 0;
 
     for (i = 0; i < n_ctxs; i++) {
@@ -579,6 +593,104 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return FALSE;
+}
+
+/* Call with region.lock held, on a full region */
+static void tcg_region_evict__locked(size_t i, GFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt = region_trees + i * tree_size;
+    GPtrArray *tbs = g_ptr_array_new();
+    void *start, *end;
+
+    /* @func may take page locks, which nest outside of rt->lock */
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    g_ptr_array_foreach(tbs, func, user_data);
+    g_ptr_array_free(tbs, TRUE);
+
+    qemu_mutex_lock(&rt->lock);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(i, &start, &end);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    set_bit(i, region.free);
+    region.n_evicted++;
+}
+
+/*
+ * Evict up to @n full regions, oldest first, so that they can be allocated
+ * again.  @func is called on each TB in those regions before its code is
+ * discarded, and must unlink the TB from everything that may still point
+ * to it.  The regions that the TCG contexts are filling are left alone.
+ *
+ * Returns the number of regions that were evicted.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(size_t n, GFunc func, gpointer user_data)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned long *busy = bitmap_new(region.n);
+    size_t evicted = 0;
+    unsigned int i;
+
+    qemu_mutex_lock(&region.lock);
+    bitmap_copy(busy, region.free, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        set_bit(tc_ptr_to_region_index(s->code_gen_buffer), busy);
+    }
+
+    while (evicted < n) {
+        size_t oldest = region.n;
+        size_t j;
+
+        for (j = find_first_zero_bit(busy, region.n); j < region.n;
+             j = find_next_zero_bit(busy, region.n, j + 1)) {
+            if (oldest == region.n || region.seq[j] < region.seq[oldest]) {
+                oldest = j;
+            }
+        }
+        if (oldest == region.n) {
+            break;
+        }
+        set_bit(oldest, busy);
+        tcg_region_evict__locked(oldest, func, user_data);
+        evicted++;
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    g_free(busy);
+    return evicted;
+}
+
+size_t tcg_nb_regions(void)
+{
+    /* set at init time */
+    return region.n;
+}
+
+size_t tcg_region_evict_count(void)
+{
+    size_t n;
+
+    qemu_mutex_lock(&region.lock);
+    n = region.n_evicted;
+    qemu_mutex_unlock(&region.lock);
+    return n;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -595,9 +707,13 @@ static size_t tcg_n_regions(void)
 {
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
+    /*
+     * With a single vCPU thread, still split the buffer into a few regions
+     * of at least 2 MB, so that it can be recycled piecemeal once full.
+     */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        i = tcg_init_ctx.code_gen_buffer_size / (2 * 1024u * 1024);
+        return MAX(MIN(i, 8), 1);
     }
 
     /* Try to have more regions than max_cpus, with each region being >= 2 MB */
@@ -628,7 +744,8 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG the single TCG thread moves
+ * through a handful of regions.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -674,6 +791,9 @@ void tcg_region_init(void)
     /* init the region struct */
     qemu_mutex_init(&region.lock);
     region.n = n_regions;
+    region.free = bitmap_new(n_regions);
+    bitmap_fill(region.free, n_regions);
+    region.seq = g_new0(uint64_t, n_regions);
     region.size = region_size - page_size;
     region.stride = region_size;
     region.start = buf;
@@ -813,6 +933,21 @@ size_t tcg_tb_phys_invalidate_count(void)
     return total;
 }
 
+void tcg_smc_write_counts(size_t *writes, size_t *hits)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned int i;
+
+    *writes = 0;
+    *hits = 0;
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        *writes += atomic_read(&s->smc_write_count);
+        *hits += atomic_read(&s->smc_write_hit_count);
+    }
+}
+
 /* pool based memory allocation */
 void *tcg_malloc_internal(TCGContext *s, int size)
 {
@@ -866,18 +1001,34 @@ void tcg_pool_reset(TCGContext *s)
     s->pool_current = NULL;
 }
 
+/* A byte range [start, end) of CPUArchState */
+typedef struct TCGHelperGlobalRange {
+    intptr_t start;
+    intptr_t end;
+} TCGHelperGlobalRange;
+
+struct TCGHelperGlobals {
+    void *func;
+    const TCGHelperGlobalRange *reads;
+    const TCGHelperGlobalRange *writes;
+};
+
 typedef struct TCGHelperInfo {
     void *func;
     const char *name;
     unsigned flags;
     unsigned sizemask;
+    const TCGHelperGlobals *globals;
 } TCGHelperInfo;
 
 #include "exec/helper-proto.h"
 
-static const TCGHelperInfo all_helpers[] = {
+static TCGHelperInfo all_helpers[] = {
 #include "exec/helper-tcg.h"
 };
+static const TCGHelperGlobals all_helper_globals[] = {
+#include "exec/helper-globals.h"
+};
 static GHashTable *helper_table;
 
 static int indirect_reg_alloc_order[ARRAY_SIZE(tcg_target_reg_alloc_order)];
@@ -925,6 +1076,13 @@ void tcg_context_init(TCGContext *s)
         g_hash_table_insert(helper_table, (gpointer)all_helpers[i].func,
                             (gpointer)&all_helpers[i]);
     }
+    for (i = 0; i < ARRAY_SIZE(all_helper_globals); ++i) {
+        TCGHelperInfo *info;
+
+        info = g_hash_table_lookup(helper_table, all_helper_globals[i].func);
+        tcg_debug_assert(info != NULL);
+        info->globals = &all_helper_globals[i];
+    }
 
     tcg_target_init(s);
     process_op_defs(s);
@@ -1033,6 +1191,7 @@ void tcg_prologue_init(TCGContext *s)
     s->code_gen_buffer_size = total_size;
 
     tcg_register_jit(s->code_gen_buffer, total_size);
+    perf_report_prologue(buf0, prologue_size);
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM)) {
@@ -1081,6 +1240,7 @@ void tcg_func_start(TCGContext *s)
 
     s->nb_ops = 0;
     s->nb_labels = 0;
+    s->nb_spills = 0;
     s->current_frame_offset = s->frame_start;
 
 #ifdef CONFIG_DEBUG_TCG
@@ -1254,6 +1414,9 @@ TCGv_vec tcg_temp_new_vec(TCGType type)
     case TCG_TYPE_V256:
         assert(TCG_TARGET_HAS_v256);
         break;
+    case TCG_TYPE_V512:
+        assert(TCG_TARGET_HAS_v512);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1353,7 +1516,8 @@ int tcg_check_temp_count(void)
 bool tcg_op_supported(TCGOpcode op)
 {
     const bool have_vec
-        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256;
+        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256
+        | TCG_TARGET_HAS_v512;
 
     switch (op) {
     case INDEX_op_discard:
@@ -1604,6 +1768,8 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_shrv_vec:
     case INDEX_op_sarv_vec:
         return have_vec && TCG_TARGET_HAS_shv_vec;
+    case INDEX_op_predsel_vec:
+        return have_vec && TCG_TARGET_HAS_predsel_vec;
 
     default:
         tcg_debug_assert(op > INDEX_op_last_generic && op < NB_OPS);
@@ -1624,6 +1790,9 @@ void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args)
     info = g_hash_table_lookup(helper_table, (gpointer)func);
     flags = info->flags;
     sizemask = info->sizemask;
+    if (info->globals) {
+        flags |= TCG_CALL_GLOBAL_SETS;
+    }
 
 #if defined(__sparc__) && !defined(__arch64__) \
     && !defined(CONFIG_TCG_INTERPRETER)
@@ -1783,6 +1952,61 @@ void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args)
 #endif /* TCG_TARGET_EXTEND_ARGS */
 }
 
+/* Return the global sets of the helper called by @op, or NULL if the
+   helper did not declare them.  */
+const TCGHelperGlobals *tcg_call_globals(TCGOp *op)
+{
+    int nb_args = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+    TCGHelperInfo *info;
+
+    if (!(op->args[nb_args + 1] & TCG_CALL_GLOBAL_SETS)) {
+        return NULL;
+    }
+    info = g_hash_table_lookup(helper_table, (gpointer)op->args[nb_args]);
+    return info->globals;
+}
+
+static bool helper_global_in(const TCGHelperGlobalRange *r,
+                             intptr_t start, intptr_t end)
+{
+    for (; r->start != r->end; r++) {
+        if (start < r->end && end > r->start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Narrow @call_flags, the flags of a call to a helper with global sets @g,
+   down to their effect on global @ts: TCG_CALL_NO_READ_GLOBALS if the
+   helper does not touch it, TCG_CALL_NO_WRITE_GLOBALS if it may only
+   read it.  */
+int tcg_call_global_flags(TCGContext *s, const TCGHelperGlobals *g,
+                          int call_flags, TCGTemp *ts)
+{
+    intptr_t start, end;
+
+    call_flags &= TCG_CALL_NO_READ_GLOBALS | TCG_CALL_NO_WRITE_GLOBALS;
+    if (g == NULL || (call_flags & TCG_CALL_NO_READ_GLOBALS)) {
+        return call_flags;
+    }
+    /* Indirect globals may alias anything in env.  */
+    if (ts->fixed_reg || ts->mem_base != tcgv_ptr_temp(cpu_env)) {
+        return call_flags;
+    }
+
+    start = ts->mem_offset;
+    end = start + (ts->type == TCG_TYPE_I32 ? 4 : 8);
+    if (!(call_flags & TCG_CALL_NO_WRITE_GLOBALS)
+        && helper_global_in(g->writes, start, end)) {
+        return 0;
+    }
+    if (helper_global_in(g->reads, start, end)) {
+        return TCG_CALL_NO_WRITE_GLOBALS;
+    }
+    return TCG_CALL_NO_READ_GLOBALS;
+}
+
 static void tcg_reg_alloc_start(TCGContext *s)
 {
     int i, n;
@@ -2310,8 +2534,25 @@ static void liveness_pass_1(TCGContext *s)
                         arg_ts->state = TS_DEAD;
                     }
 
-                    if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
-                                        TCG_CALL_NO_READ_GLOBALS))) {
+                    if (call_flags & TCG_CALL_GLOBAL_SETS) {
+                        const TCGHelperGlobals *g = tcg_call_globals(op);
+
+                        /* only the globals the helper touches need to
+                           go back to memory or be synced to it */
+                        for (i = 0; i < nb_globals; i++) {
+                            int gflags;
+
+                            arg_ts = &s->temps[i];
+                            gflags = tcg_call_global_flags(s, g, call_flags,
+                                                           arg_ts);
+                            if (gflags == 0) {
+                                arg_ts->state = TS_DEAD | TS_MEM;
+                            } else if (!(gflags & TCG_CALL_NO_READ_GLOBALS)) {
+                                arg_ts->state |= TS_MEM;
+                            }
+                        }
+                    } else if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
+                                               TCG_CALL_NO_READ_GLOBALS))) {
                         /* globals should go back to memory */
                         for (i = 0; i < nb_globals; i++) {
                             s->temps[i].state = TS_DEAD | TS_MEM;
@@ -2582,21 +2823,30 @@ static bool liveness_pass_2(TCGContext *s)
            all correct, for call sites and basic block end points.  */
         if (call_flags & TCG_CALL_NO_READ_GLOBALS) {
             /* Nothing to do */
-        } else if (call_flags & TCG_CALL_NO_WRITE_GLOBALS) {
-            for (i = 0; i < nb_globals; ++i) {
-                /* Liveness should see that globals are synced back,
-                   that is, either TS_DEAD or TS_MEM.  */
-                arg_ts = &s->temps[i];
-                tcg_debug_assert(arg_ts->state_ptr == 0
-                                 || arg_ts->state != 0);
-            }
         } else {
+            const TCGHelperGlobals *g = NULL;
+
+            if (opc == INDEX_op_call) {
+                g = tcg_call_globals(op);
+            }
             for (i = 0; i < nb_globals; ++i) {
-                /* Liveness should see that globals are saved back,
-                   that is, TS_DEAD, waiting to be reloaded.  */
+                int gflags;
+
                 arg_ts = &s->temps[i];
-                tcg_debug_assert(arg_ts->state_ptr == 0
-                                 || arg_ts->state == TS_DEAD);
+                gflags = tcg_call_global_flags(s, g, call_flags, arg_ts);
+                if (gflags & TCG_CALL_NO_READ_GLOBALS) {
+                    /* Nothing to do */
+                } else if (gflags & TCG_CALL_NO_WRITE_GLOBALS) {
+                    /* Liveness should see that globals are synced back,
+                       that is, either TS_DEAD or TS_MEM.  */
+                    tcg_debug_assert(arg_ts->state_ptr == 0
+                                     || arg_ts->state != 0);
+                } else {
+                    /* Liveness should see that globals are saved back,
+                       that is, TS_DEAD, waiting to be reloaded.  */
+                    tcg_debug_assert(arg_ts->state_ptr == 0
+                                     || arg_ts->state == TS_DEAD);
+                }
             }
         }
 
@@ -2710,20 +2960,27 @@ static void check_regs(TCGContext *s)
 
 static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
 {
+    /* Vector temps need a slot as wide as the vector, which for V512
+       is eight times the size of a host register.  */
+    tcg_target_long size = sizeof(tcg_target_long);
+
+    if (ts->type >= TCG_TYPE_V64) {
+        size = 8 << (ts->type - TCG_TYPE_V64);
+        size = MAX(size, (tcg_target_long)sizeof(tcg_target_long));
+    }
 #if !(defined(__sparc__) && TCG_TARGET_REG_BITS == 64)
     /* Sparc64 stack is accessed with offset of 2047 */
     s->current_frame_offset = (s->current_frame_offset +
                                (tcg_target_long)sizeof(tcg_target_long) - 1) &
         ~(sizeof(tcg_target_long) - 1);
 #endif
-    if (s->current_frame_offset + (tcg_target_long)sizeof(tcg_target_long) >
-        s->frame_end) {
+    if (s->current_frame_offset + size > s->frame_end) {
         tcg_abort();
     }
     ts->mem_offset = s->current_frame_offset;
     ts->mem_base = s->frame_temp;
     ts->mem_allocated = 1;
-    s->current_frame_offset += sizeof(tcg_target_long);
+    s->current_frame_offset += size;
 }
 
 static void temp_load(TCGContext *, TCGTemp *, TCGRegSet, TCGRegSet);
@@ -2830,6 +3087,7 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet desired_regs,
         reg = order[i];
         if (tcg_regset_test_reg(reg_ct, reg)) {
             tcg_reg_free(s, reg, allocated_regs);
+            s->nb_spills++;
             return reg;
         }
     }
@@ -2902,6 +3160,29 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/* save or sync the globals that a helper with global sets 'g' might
+   write or read, and leave the others alone. */
+static void call_globals(TCGContext *s, const TCGHelperGlobals *g,
+                         int call_flags, TCGRegSet allocated_regs)
+{
+    int i, n;
+
+    for (i = 0, n = s->nb_globals; i < n; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int gflags = tcg_call_global_flags(s, g, call_flags, ts);
+
+        if (gflags & TCG_CALL_NO_READ_GLOBALS) {
+            /* Nothing to do */
+        } else if (gflags & TCG_CALL_NO_WRITE_GLOBALS) {
+            tcg_debug_assert(ts->val_type != TEMP_VAL_REG
+                             || ts->fixed_reg
+                             || ts->mem_coherent);
+        } else {
+            temp_save(s, ts, allocated_regs);
+        }
+    }
+}
+
 /* at the end of a basic block, we assume all temporaries are dead and
    all globals are stored at their canonical location. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
@@ -3297,6 +3578,8 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
        they might be read. */
     if (flags & TCG_CALL_NO_READ_GLOBALS) {
         /* Nothing to do */
+    } else if (flags & TCG_CALL_GLOBAL_SETS) {
+        call_globals(s, tcg_call_globals(op), flags, allocated_regs);
     } else if (flags & TCG_CALL_NO_WRITE_GLOBALS) {
         sync_globals(s, allocated_regs);
     } else {
@@ -3368,6 +3651,8 @@ void tcg_profile_snapshot(TCGProfile *prof, bool counters, bool table)
             PROF_ADD(prof, orig, temp_count);
             PROF_MAX(prof, orig, temp_count_max);
             PROF_ADD(prof, orig, del_op_count);
+            PROF_ADD(prof, orig, env_ld_fwd_count);
+            PROF_ADD(prof, orig, env_st_del_count);
             PROF_ADD(prof, orig, code_in_len);
             PROF_ADD(prof, orig, code_out_len);
             PROF_ADD(prof, orig, search_out_len);
@@ -3632,6 +3917,10 @@ void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
                 (double)s->op_count / tb_div_count, s->op_count_max);
     cpu_fprintf(f, "deleted ops/TB      %0.2f\n",
                 (double)s->del_op_count / tb_div_count);
+    cpu_fprintf(f, "env loads fwd/TB    %0.2f\n",
+                (double)s->env_ld_fwd_count / tb_div_count);
+    cpu_fprintf(f, "env stores del/TB   %0.2f\n",
+                (double)s->env_st_del_count / tb_div_count);
     cpu_fprintf(f, "avg temps/TB        %0.2f max=%d\n",
                 (double)s->temp_count / tb_div_count, s->temp_count_max);
     cpu_fprintf(f, "avg host code/TB    %0.1f\n",
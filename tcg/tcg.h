@@ -172,7 +172,8 @@ typedef uint64_t TCGRegSet;
 
 #if !defined(TCG_TARGET_HAS_v64) \
     && !defined(TCG_TARGET_HAS_v128) \
-    && !defined(TCG_TARGET_HAS_v256)
+    && !defined(TCG_TARGET_HAS_v256) \
+    && !defined(TCG_TARGET_HAS_v512)
 #define TCG_TARGET_MAYBE_vec            0
 #define TCG_TARGET_HAS_neg_vec          0
 #define TCG_TARGET_HAS_not_vec          0
@@ -182,6 +183,7 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_HAS_shs_vec          0
 #define TCG_TARGET_HAS_shv_vec          0
 #define TCG_TARGET_HAS_mul_vec          0
+#define TCG_TARGET_HAS_predsel_vec      0
 #else
 #define TCG_TARGET_MAYBE_vec            1
 #endif
@@ -194,6 +196,9 @@ typedef uint64_t TCGRegSet;
 #ifndef TCG_TARGET_HAS_v256
 #define TCG_TARGET_HAS_v256             0
 #endif
+#ifndef TCG_TARGET_HAS_v512
+#define TCG_TARGET_HAS_v512             0
+#endif
 
 #ifndef TARGET_INSN_START_EXTRA_WORDS
 # define TARGET_INSN_START_WORDS 1
@@ -263,6 +268,8 @@ typedef struct TCGPool {
 
 #define TCG_MAX_TEMPS 512
 #define TCG_MAX_INSNS 512
+#define TCG_MAX_TB_SUCCESSORS 2
+#define TCG_MAX_SB_PATH 8
 
 /* when the size of the arguments of a called function is smaller than
    this value, they are statically allocated in the TB stack frame */
@@ -275,6 +282,7 @@ typedef enum TCGType {
     TCG_TYPE_V64,
     TCG_TYPE_V128,
     TCG_TYPE_V256,
+    TCG_TYPE_V512,
 
     TCG_TYPE_COUNT, /* number of different types */
 
@@ -468,6 +476,9 @@ typedef TCGv_ptr TCGv_env;
 #define TCG_CALL_NO_WRITE_GLOBALS   0x0020
 /* Helper can be safely suppressed if the return value is not used. */
 #define TCG_CALL_NO_SIDE_EFFECTS    0x0040
+/* Helper only accesses the globals declared with DEF_HELPER_GLOBALS.
+   This is set by tcg_gen_callN, and is not meant for helper.h files. */
+#define TCG_CALL_GLOBAL_SETS        0x0080
 
 /* convenience version of most used call flags */
 #define TCG_CALL_NO_RWG         TCG_CALL_NO_READ_GLOBALS
@@ -636,6 +647,8 @@ typedef struct TCGProfile {
     int64_t temp_count;
     int temp_count_max;
     int64_t del_op_count;
+    int64_t env_ld_fwd_count;
+    int64_t env_st_del_count;
     int64_t code_in_len;
     int64_t code_out_len;
     int64_t search_out_len;
@@ -656,6 +669,7 @@ struct TCGContext {
     int nb_temps;
     int nb_indirects;
     int nb_ops;
+    int nb_spills; /* registers spilled by tcg_reg_alloc for this TB */
 
     /* goto_tb support */
     tcg_insn_unit *code_buf;
@@ -696,6 +710,9 @@ struct TCGContext {
     void *code_gen_highwater;
 
     size_t tb_phys_invalidate_count;
+    /* guest writes to pages with code, and those that overlapped a TB */
+    size_t smc_write_count;
+    size_t smc_write_hit_count;
 
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
@@ -721,6 +738,14 @@ struct TCGContext {
 
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
+
+    /* Direct branch targets of the current TB, see translator_add_successor */
+    target_ulong tb_successors[TCG_MAX_TB_SUCCESSORS];
+    int nb_tb_successors;
+
+    /* Start pc of the blocks a CF_TRACE TB is made of, see tb_gen_superblock */
+    target_ulong sb_path[TCG_MAX_SB_PATH];
+    int sb_path_len;
 };
 
 extern TCGContext tcg_init_ctx;
@@ -866,6 +891,9 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+size_t tcg_region_evict(size_t n, GFunc func, gpointer user_data);
+size_t tcg_nb_regions(void);
+size_t tcg_region_evict_count(void);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -873,6 +901,7 @@ size_t tcg_code_capacity(void);
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
 size_t tcg_tb_phys_invalidate_count(void);
+void tcg_smc_write_counts(size_t *writes, size_t *hits);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
 size_t tcg_nb_tbs(void);
@@ -1068,6 +1097,11 @@ bool tcg_op_supported(TCGOpcode op);
 
 void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args);
 
+typedef struct TCGHelperGlobals TCGHelperGlobals;
+const TCGHelperGlobals *tcg_call_globals(TCGOp *op);
+int tcg_call_global_flags(TCGContext *s, const TCGHelperGlobals *g,
+                          int call_flags, TCGTemp *ts);
+
 TCGOp *tcg_emit_op(TCGOpcode opc);
 void tcg_op_remove(TCGContext *s, TCGOp *op);
 TCGOp *tcg_op_insert_before(TCGContext *s, TCGOp *op, TCGOpcode opc, int narg);
@@ -1454,7 +1488,6 @@ GEN_ATOMIC_HELPER_ALL(xchg)
 #undef GEN_ATOMIC_HELPER
 #endif /* CONFIG_SOFTMMU */
 
-#ifdef CONFIG_ATOMIC128
 #include "qemu/int128.h"
 
 /* These aren't really a "proper" helpers because TCG cannot manage Int128.
@@ -1475,6 +1508,4 @@ void helper_atomic_sto_le_mmu(CPUArchState *env, target_ulong addr, Int128 val,
 void helper_atomic_sto_be_mmu(CPUArchState *env, target_ulong addr, Int128 val,
                               TCGMemOpIdx oi, uintptr_t retaddr);
 
-#endif /* CONFIG_ATOMIC128 */
-
 #endif /* TCG_H */
@@ -0,0 +1,353 @@
+/*
+ * fp-bench.c - A collection of simple floating point microbenchmarks.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qemu/timer.h"
+#include "fpu/softfloat.h"
+
+/* amortize the computation of random inputs */
+#define OPS_PER_ITER     50000
+
+#define MAX_OPERANDS 3
+
+#define SEED_A 0xdeadfacedeadface
+#define SEED_B 0xbadc0feebadc0fee
+#define SEED_C 0xbeefdeadbeefdead
+
+enum op {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_FMA,
+    OP_SQRT,
+};
+
+static const char * const op_names[] = {
+    [OP_ADD] = "add",
+    [OP_SUB] = "sub",
+    [OP_MUL] = "mul",
+    [OP_DIV] = "div",
+    [OP_FMA] = "fma",
+    [OP_SQRT] = "sqrt",
+};
+
+enum precision {
+    PREC_SINGLE,
+    PREC_DOUBLE,
+};
+
+static const char * const prec_names[] = {
+    [PREC_SINGLE] = "single",
+    [PREC_DOUBLE] = "double",
+};
+
+enum tester {
+    TESTER_SOFT,
+    TESTER_HOST,
+};
+
+static const char * const tester_names[] = {
+    [TESTER_SOFT] = "soft",
+    [TESTER_HOST] = "host",
+};
+
+union fp {
+    float f;
+    double d;
+    float32 f32;
+    float64 f64;
+    uint64_t u64;
+};
+
+static uint64_t random_ops[MAX_OPERANDS] = {
+    SEED_A, SEED_B, SEED_C,
+};
+static float_status soft_status;
+static enum precision precision;
+static enum op operation;
+static enum tester tester;
+static uint64_t n_completed_ops;
+static unsigned int duration = 1;
+static int64_t ns_elapsed;
+/* disable optimizations with volatile */
+static volatile union fp res;
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void update_random_ops(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_OPERANDS; i++) {
+        random_ops[i] = xorshift64star(random_ops[i]);
+    }
+}
+
+/*
+ * Generate normal inputs in [1.0, 2.0), so that results are normal as
+ * well and every operation can take the host FPU fast path.
+ */
+static void fill_random(union fp *ops, enum precision prec)
+{
+    int i;
+
+    for (i = 0; i < MAX_OPERANDS; i++) {
+        uint64_t r = random_ops[i];
+
+        switch (prec) {
+        case PREC_SINGLE:
+            ops[i].f32 = make_float32(0x3f800000 | (r & 0x7fffff));
+            break;
+        case PREC_DOUBLE:
+            ops[i].f64 = make_float64(0x3ff0000000000000ULL |
+                                      (r & 0xfffffffffffffULL));
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+}
+
+/*
+ * The main benchmark function. Instead of (ab)using macros, we rely
+ * on the compiler to unfold this at compile-time.
+ */
+static void bench(enum precision prec, enum op op, bool host)
+{
+    int64_t tf = get_clock() + duration * 1000000000LL;
+
+    while (get_clock() < tf) {
+        union fp ops[MAX_OPERANDS];
+        int64_t t0;
+        int i;
+
+        update_random_ops();
+        fill_random(ops, prec);
+        t0 = get_clock();
+        for (i = 0; i < OPS_PER_ITER; i++) {
+            union fp a = ops[0];
+            union fp b = ops[1];
+            union fp c = ops[2];
+
+            switch (prec) {
+            case PREC_SINGLE:
+                if (host) {
+                    switch (op) {
+                    case OP_ADD:
+                        res.f = a.f + b.f;
+                        break;
+                    case OP_SUB:
+                        res.f = a.f - b.f;
+                        break;
+                    case OP_MUL:
+                        res.f = a.f * b.f;
+                        break;
+                    case OP_DIV:
+                        res.f = a.f / b.f;
+                        break;
+                    case OP_FMA:
+                        res.f = fmaf(a.f, b.f, c.f);
+                        break;
+                    case OP_SQRT:
+                        res.f = sqrtf(a.f);
+                        break;
+                    default:
+                        g_assert_not_reached();
+                    }
+                } else {
+                    switch (op) {
+                    case OP_ADD:
+                        res.f32 = float32_add(a.f32, b.f32, &soft_status);
+                        break;
+                    case OP_SUB:
+                        res.f32 = float32_sub(a.f32, b.f32, &soft_status);
+                        break;
+                    case OP_MUL:
+                        res.f32 = float32_mul(a.f32, b.f32, &soft_status);
+                        break;
+                    case OP_DIV:
+                        res.f32 = float32_div(a.f32, b.f32, &soft_status);
+                        break;
+                    case OP_FMA:
+                        res.f32 = float32_muladd(a.f32, b.f32, c.f32, 0,
+                                                 &soft_status);
+                        break;
+                    case OP_SQRT:
+                        res.f32 = float32_sqrt(a.f32, &soft_status);
+                        break;
+                    default:
+                        g_assert_not_reached();
+                    }
+                }
+                break;
+            case PREC_DOUBLE:
+                if (host) {
+                    switch (op) {
+                    case OP_ADD:
+                        res.d = a.d + b.d;
+                        break;
+                    case OP_SUB:
+                        res.d = a.d - b.d;
+                        break;
+                    case OP_MUL:
+                        res.d = a.d * b.d;
+                        break;
+                    case OP_DIV:
+                        res.d = a.d / b.d;
+                        break;
+                    case OP_FMA:
+                        res.d = fma(a.d, b.d, c.d);
+                        break;
+                    case OP_SQRT:
+                        res.d = sqrt(a.d);
+                        break;
+                    default:
+                        g_assert_not_reached();
+                    }
+                } else {
+                    switch (op) {
+                    case OP_ADD:
+                        res.f64 = float64_add(a.f64, b.f64, &soft_status);
+                        break;
+                    case OP_SUB:
+                        res.f64 = float64_sub(a.f64, b.f64, &soft_status);
+                        break;
+                    case OP_MUL:
+                        res.f64 = float64_mul(a.f64, b.f64, &soft_status);
+                        break;
+                    case OP_DIV:
+                        res.f64 = float64_div(a.f64, b.f64, &soft_status);
+                        break;
+                    case OP_FMA:
+                        res.f64 = float64_muladd(a.f64, b.f64, c.f64, 0,
+                                                 &soft_status);
+                        break;
+                    case OP_SQRT:
+                        res.f64 = float64_sqrt(a.f64, &soft_status);
+                        break;
+                    default:
+                        g_assert_not_reached();
+                    }
+                }
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+        ns_elapsed += get_clock() - t0;
+        n_completed_ops += OPS_PER_ITER;
+    }
+}
+
+static void run_bench(void)
+{
+    bench(precision, operation, tester == TESTER_HOST);
+}
+
+static int find_name(const char * const *tbl, size_t n, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (tbl[i] && strcmp(tbl[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, " -d = duration, in seconds. Default: %u\n", duration);
+    fprintf(stderr, " -h = show this help message.\n");
+    fprintf(stderr, " -o = floating point operation (add, sub, mul, div, "
+            "fma, sqrt). Default: %s\n", op_names[operation]);
+    fprintf(stderr, " -p = floating point precision (single, double). "
+            "Default: %s\n", prec_names[precision]);
+    fprintf(stderr, " -t = tester (soft, host). Default: %s\n",
+            tester_names[tester]);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+    int val;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:ho:p:t:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(EXIT_SUCCESS);
+        case 'o':
+            val = find_name(op_names, ARRAY_SIZE(op_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported op '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            operation = val;
+            break;
+        case 'p':
+            val = find_name(prec_names, ARRAY_SIZE(prec_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported precision '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            precision = val;
+            break;
+        case 't':
+            val = find_name(tester_names, ARRAY_SIZE(tester_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported tester '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            tester = val;
+            break;
+        default:
+            usage_complete(argc, argv);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void pr_stats(void)
+{
+    printf("%.2f MFlops\n", (double)n_completed_ops / ns_elapsed * 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    /*
+     * Most guests accumulate the inexact flag, which is what allows
+     * softfloat to use the host FPU; mimic that here.
+     */
+    soft_status.float_exception_flags = float_flag_inexact;
+    run_bench();
+    pr_stats();
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * Stress test and benchmark for the jump lists of translation blocks.
+ *
+ * Each thread chains jumps from its own TBs ("origins") to TBs shared by
+ * all threads ("destinations"), and at the update rate invalidates a
+ * destination, resetting all the jumps chained to it, as vCPU threads do
+ * under MTTCG.  Compare the scaling of both schemes with e.g.
+ *
+ *   for n in 1 2 4 8 16 32 64 128; do ./tb-jmp-bench -n $n; done
+ *   for n in 1 2 4 8 16 32 64 128; do ./tb-jmp-bench -n $n -L; done
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/processor.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "exec/tb-jmp-list.h"
+
+/* the fields of TranslationBlock that are involved in chaining jumps */
+struct node {
+    QemuSpin jmp_lock;
+    uintptr_t jmp_list_head;
+    uintptr_t jmp_list_next[2];
+    uintptr_t jmp_dest[2];
+} QEMU_ALIGNED(64);
+
+struct thread_stats {
+    size_t link;
+    size_t not_link;
+    size_t inval;
+    size_t reset;
+};
+
+struct thread_info {
+    struct thread_stats stats;
+    struct node *origins;
+    uint64_t r;
+} QEMU_ALIGNED(64); /* avoid false sharing among threads */
+
+#define DEFAULT_N_DESTS 1024
+#define DEFAULT_N_ORIGINS 1024
+
+static unsigned int duration = 1;
+static unsigned int n_threads = 1;
+static unsigned long n_dests = DEFAULT_N_DESTS;
+static unsigned long n_origins = DEFAULT_N_ORIGINS;
+static bool locked;
+
+static double update_rate = 0.01; /* 0.0 to 1.0 */
+static uint64_t update_threshold;
+
+static struct node *dests;
+static QemuThread *threads;
+static struct thread_info *info;
+static size_t n_ready_threads;
+
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of threads\n"
+    "\n"
+    " -D = number of destination TBs, shared by all threads "
+    "(will be rounded up to pow2)\n"
+    " -O = number of origin TBs per thread (will be rounded up to pow2)\n"
+    "\n"
+    " -u = update rate (0.0 to 100.0): invalidations of a destination TB\n"
+    "\n"
+    " -L = take the destination's lock to chain a jump, as done before\n"
+    "      jump lists became lock-free";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static uintptr_t *node_jmp_list_next(uintptr_t entry)
+{
+    struct node *node = (struct node *)(entry & ~1);
+
+    return &node->jmp_list_next[entry & 1];
+}
+
+/* see tb_add_jump() */
+static bool link_lockfree(struct node *orig, int n, struct node *dest)
+{
+    if (atomic_cmpxchg(&orig->jmp_dest[n], 0, (uintptr_t)dest)) {
+        return false;
+    }
+    if (!tb_jmp_list_push(&dest->jmp_list_head, (uintptr_t)orig | n,
+                          &orig->jmp_list_next[n])) {
+        atomic_set(&orig->jmp_dest[n], 0);
+        return false;
+    }
+    return true;
+}
+
+/* see tb_jmp_unlink() */
+static size_t inval_lockfree(struct node *dest)
+{
+    uintptr_t entry;
+    size_t n_reset = 0;
+
+    qemu_spin_lock(&dest->jmp_lock);
+    entry = tb_jmp_list_close(&dest->jmp_list_head);
+    qemu_spin_unlock(&dest->jmp_lock);
+
+    while (entry) {
+        struct node *orig = (struct node *)(entry & ~1);
+        int n = entry & 1;
+
+        entry = atomic_read(&orig->jmp_list_next[n]);
+        g_assert(atomic_read(&orig->jmp_dest[n]) == (uintptr_t)dest);
+        atomic_set(&orig->jmp_dest[n], 0);
+        n_reset++;
+    }
+
+    /*
+     * Unlike a TB, the destination is reused right away.  Another thread
+     * may have reopened the list already, in which case it must be left
+     * alone; and if the list was not closed by us the walk above was empty.
+     */
+    atomic_cmpxchg(&dest->jmp_list_head, TB_JMP_LIST_CLOSED, 0);
+    return n_reset;
+}
+
+static bool link_locked(struct node *orig, int n, struct node *dest)
+{
+    bool ret = false;
+
+    qemu_spin_lock(&dest->jmp_lock);
+    if (atomic_cmpxchg(&orig->jmp_dest[n], 0, (uintptr_t)dest) == 0) {
+        orig->jmp_list_next[n] = dest->jmp_list_head;
+        dest->jmp_list_head = (uintptr_t)orig | n;
+        ret = true;
+    }
+    qemu_spin_unlock(&dest->jmp_lock);
+    return ret;
+}
+
+static size_t inval_locked(struct node *dest)
+{
+    uintptr_t entry;
+    size_t n_reset = 0;
+
+    qemu_spin_lock(&dest->jmp_lock);
+    for (entry = dest->jmp_list_head; entry; ) {
+        struct node *orig = (struct node *)(entry & ~1);
+        int n = entry & 1;
+
+        entry = orig->jmp_list_next[n];
+        g_assert(atomic_read(&orig->jmp_dest[n]) == (uintptr_t)dest);
+        atomic_set(&orig->jmp_dest[n], 0);
+        n_reset++;
+    }
+    dest->jmp_list_head = 0;
+    qemu_spin_unlock(&dest->jmp_lock);
+    return n_reset;
+}
+
+static void do_op(struct thread_info *info)
+{
+    struct thread_stats *stats = &info->stats;
+    uint64_t r = info->r;
+    struct node *dest = &dests[(r >> 32) & (n_dests - 1)];
+
+    if (r < update_threshold) {
+        stats->reset += locked ? inval_locked(dest) : inval_lockfree(dest);
+        stats->inval++;
+    } else {
+        struct node *orig = &info->origins[(r >> 1) & (n_origins - 1)];
+        int n = r & 1;
+        bool linked;
+
+        if (locked) {
+            linked = link_locked(orig, n, dest);
+        } else {
+            linked = link_lockfree(orig, n, dest);
+        }
+        if (linked) {
+            stats->link++;
+        } else {
+            stats->not_link++;
+        }
+    }
+}
+
+static void *thread_func(void *p)
+{
+    struct thread_info *info = p;
+
+    atomic_inc(&n_ready_threads);
+    while (!atomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    while (!atomic_read(&test_stop)) {
+        info->r = xorshift64star(info->r);
+        do_op(info);
+    }
+    return NULL;
+}
+
+static void node_init(struct node *node)
+{
+    qemu_spin_init(&node->jmp_lock);
+    node->jmp_list_head = 0;
+    node->jmp_dest[0] = 0;
+    node->jmp_dest[1] = 0;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %d s\n", duration);
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" # of dest TBs:     %lu\n", n_dests);
+    printf(" # of orig TBs:     %lu per thread\n", n_origins);
+    printf(" update rate:       %f%%\n", update_rate * 100.0);
+    printf(" chaining:          %s\n", locked ? "locked" : "lock-free");
+}
+
+static void bench_init(void)
+{
+    unsigned long i;
+
+    if (update_rate == 1.0) {
+        update_threshold = UINT64_MAX;
+    } else {
+        update_threshold = update_rate * UINT64_MAX;
+    }
+
+    dests = qemu_memalign(64, sizeof(*dests) * n_dests);
+    for (i = 0; i < n_dests; i++) {
+        node_init(&dests[i]);
+    }
+    pr_params();
+}
+
+static void create_threads(void)
+{
+    unsigned int i;
+    unsigned long j;
+
+    threads = g_malloc(sizeof(*threads) * n_threads);
+    info = qemu_memalign(64, sizeof(*info) * n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        struct thread_info *ti = &info[i];
+
+        memset(&ti->stats, 0, sizeof(ti->stats));
+        /* seed for the RNG; each thread should have a different one */
+        ti->r = (i + 1) ^ time(NULL);
+        ti->origins = qemu_memalign(64, sizeof(*ti->origins) * n_origins);
+        for (j = 0; j < n_origins; j++) {
+            node_init(&ti->origins[j]);
+        }
+        qemu_thread_create(&threads[i], "jmp", thread_func, ti,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void run_test(void)
+{
+    unsigned int remaining;
+    unsigned int i;
+
+    while (atomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+    atomic_set(&test_start, true);
+    do {
+        remaining = sleep(duration);
+    } while (remaining);
+    atomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+/* every jump that is still chained must be in its destination's list */
+static void check_lists(void)
+{
+    size_t n_chained = 0;
+    size_t n_listed = 0;
+    unsigned long i, j;
+    int n;
+
+    for (i = 0; i < n_threads; i++) {
+        for (j = 0; j < n_origins; j++) {
+            for (n = 0; n < 2; n++) {
+                n_chained += !!info[i].origins[j].jmp_dest[n];
+            }
+        }
+    }
+    for (i = 0; i < n_dests; i++) {
+        uintptr_t entry = dests[i].jmp_list_head;
+
+        g_assert(entry != TB_JMP_LIST_CLOSED);
+        while (entry) {
+            g_assert(*node_jmp_list_next(entry) != TB_JMP_LIST_CLOSED);
+            g_assert(((struct node *)(entry & ~1))->jmp_dest[entry & 1] ==
+                     (uintptr_t)&dests[i]);
+            entry = *node_jmp_list_next(entry);
+            n_listed++;
+        }
+    }
+    g_assert_cmpuint(n_chained, ==, n_listed);
+}
+
+static void pr_stats(void)
+{
+    struct thread_stats s = {};
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < n_threads; i++) {
+        s.link += info[i].stats.link;
+        s.not_link += info[i].stats.not_link;
+        s.inval += info[i].stats.inval;
+        s.reset += info[i].stats.reset;
+    }
+
+    printf("Results:\n");
+    printf(" Linked:            %.2f M (%.2f%% of %.2fM)\n",
+           (double)s.link / 1e6,
+           (double)s.link / (s.link + s.not_link) * 100,
+           (double)(s.link + s.not_link) / 1e6);
+    printf(" Invalidated:       %.2f M (%.2f jumps reset each)\n",
+           (double)s.inval / 1e6,
+           s.inval ? (double)s.reset / s.inval : 0.0);
+
+    tx = (s.link + s.not_link + s.inval) / 1e6 / duration;
+    printf(" Throughput:        %.2f MT/s\n", tx);
+    printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_threads);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:D:hLn:O:u:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'D':
+            n_dests = pow2ceil(atol(optarg));
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'L':
+            locked = true;
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'O':
+            n_origins = pow2ceil(atol(optarg));
+            break;
+        case 'u':
+            update_rate = atof(optarg) / 100.0;
+            if (update_rate > 1.0) {
+                update_rate = 1.0;
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    bench_init();
+    create_threads();
+    run_test();
+    check_lists();
+    pr_stats();
+    return 0;
+}
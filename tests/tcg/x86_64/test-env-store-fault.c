@@ -0,0 +1,101 @@
+/*
+ * Check that CPU state written just before a faulting memory access is
+ * visible to the signal handler, even if the same state is overwritten
+ * by the following instruction in the same translation block.
+ *
+ * The xmm registers live in env.  A register to register movaps is
+ * translated into plain TCG loads and stores of env, and tcg/optimize.c
+ * removes such a store when a later store covers it.  A guest memory
+ * access that faults in between must keep the first store alive.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define BEFORE 0x1111111111111111ULL
+#define AFTER  0x2222222222222222ULL
+
+static sigjmp_buf jmpbuf;
+static uint64_t xmm0_at_fault;
+
+static void segv_handler(int sig, siginfo_t *info, void *puc)
+{
+    ucontext_t *uc = puc;
+
+    memcpy(&xmm0_at_fault, &uc->uc_mcontext.fpregs->_xmm[0],
+           sizeof(xmm0_at_fault));
+    siglongjmp(jmpbuf, 1);
+}
+
+static int check(const char *name, int faulted)
+{
+    if (!faulted) {
+        printf("FAIL %s: no fault\n", name);
+        return 1;
+    }
+    if (xmm0_at_fault != BEFORE) {
+        printf("FAIL %s: xmm0 = 0x%016llx, expected 0x%016llx\n", name,
+               (unsigned long long)xmm0_at_fault, (unsigned long long)BEFORE);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_load(void)
+{
+    if (sigsetjmp(jmpbuf, 1)) {
+        return check("load", 1);
+    }
+    asm volatile("movq %0, %%xmm1\n\t"
+                 "movq %1, %%xmm2\n\t"
+                 "movaps %%xmm1, %%xmm0\n\t"
+                 "movq (%2), %%rcx\n\t"
+                 "movaps %%xmm2, %%xmm0"
+                 : : "r"(BEFORE), "r"(AFTER), "r"(0UL)
+                 : "rcx", "xmm0", "xmm1", "xmm2", "memory");
+    return check("load", 0);
+}
+
+static int test_store(void)
+{
+    if (sigsetjmp(jmpbuf, 1)) {
+        return check("store", 1);
+    }
+    asm volatile("movq %0, %%xmm1\n\t"
+                 "movq %1, %%xmm2\n\t"
+                 "movaps %%xmm1, %%xmm0\n\t"
+                 "movq %%rcx, (%2)\n\t"
+                 "movaps %%xmm2, %%xmm0"
+                 : : "r"(BEFORE), "r"(AFTER), "r"(0UL)
+                 : "rcx", "xmm0", "xmm1", "xmm2", "memory");
+    return check("store", 0);
+}
+
+int main(void)
+{
+    struct sigaction sa;
+    int err = 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv_handler;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGSEGV, &sa, NULL)) {
+        perror("sigaction");
+        return EXIT_FAILURE;
+    }
+
+    err |= test_load();
+    err |= test_store();
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
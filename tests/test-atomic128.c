@@ -0,0 +1,88 @@
+/*
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+#include "qemu/atomic128.h"
+
+#define N_THREADS 4
+#define N_INCS 100000
+
+static Int128 counter QEMU_ALIGNED(16);
+
+/* increment one 64-bit half of @counter with 16-byte compare-and-swaps */
+static void *cmpxchg_thread(void *arg)
+{
+    int half = (uintptr_t)arg;
+    Int128 old = int128_zero();
+    int i;
+
+    for (i = 0; i < N_INCS; i++) {
+        for (;;) {
+            uint64_t words[2];
+            Int128 new, prev;
+
+            memcpy(words, &old, sizeof(words));
+            words[half]++;
+            memcpy(&new, words, sizeof(new));
+            prev = atomic16_cmpxchg(&counter, old, new);
+            if (int128_eq(prev, old)) {
+                break;
+            }
+            old = prev;
+        }
+    }
+    return NULL;
+}
+
+/* increment one 64-bit half of @counter with 64-bit atomics */
+static void *inc_thread(void *arg)
+{
+    uint64_t *words = (uint64_t *)&counter;
+    int half = (uintptr_t)arg;
+    int i;
+
+    for (i = 0; i < N_INCS; i++) {
+        atomic_inc(&words[half]);
+    }
+    return NULL;
+}
+
+/*
+ * The 16-byte operations must be atomic not only with respect to each
+ * other, but also against narrower atomics to the same bytes.
+ */
+static void test_mixed(void)
+{
+    QemuThread threads[N_THREADS];
+    uint64_t words[2];
+    uintptr_t i;
+
+    if (!HAVE_CMPXCHG128) {
+        g_test_skip("no 128-bit compare-and-swap on this host");
+        return;
+    }
+
+    counter = int128_zero();
+    for (i = 0; i < N_THREADS; i++) {
+        qemu_thread_create(&threads[i], "atomic128",
+                           i & 1 ? inc_thread : cmpxchg_thread,
+                           (void *)(i / 2 & 1), QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < N_THREADS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+
+    memcpy(words, &counter, sizeof(words));
+    g_assert_cmpuint(words[0], ==, 2 * N_INCS);
+    g_assert_cmpuint(words[1], ==, 2 * N_INCS);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/atomic128/mixed", test_mixed);
+    return g_test_run();
+}
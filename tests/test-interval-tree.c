@@ -0,0 +1,139 @@
+/*
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
+
+#define N 2000
+#define SPACE 10000
+
+static IntervalTreeRoot root;
+static IntervalTreeNode nodes[N];
+static bool in_tree[N];
+
+static void insert(int i, uint64_t start, uint64_t last)
+{
+    nodes[i].start = start;
+    nodes[i].last = last;
+    interval_tree_insert(&nodes[i], &root);
+    in_tree[i] = true;
+}
+
+static void remove_node(int i)
+{
+    interval_tree_remove(&nodes[i], &root);
+    in_tree[i] = false;
+}
+
+/* compare the result of a query against a linear scan */
+static void check_query(uint64_t start, uint64_t last)
+{
+    bool found[N] = { };
+    IntervalTreeNode *node;
+    uint64_t prev_start = 0;
+    int i;
+
+    for (node = interval_tree_iter_first(&root, start, last);
+         node;
+         node = interval_tree_iter_next(&root, node, start, last)) {
+        i = node - nodes;
+        g_assert_cmpint(i, >=, 0);
+        g_assert_cmpint(i, <, N);
+        g_assert_true(in_tree[i]);
+        g_assert_false(found[i]);
+        g_assert_cmpuint(node->start, >=, prev_start);
+        prev_start = node->start;
+        found[i] = true;
+    }
+    for (i = 0; i < N; i++) {
+        bool overlaps = in_tree[i] &&
+                        nodes[i].start <= last && nodes[i].last >= start;
+
+        g_assert_cmpint(found[i], ==, overlaps);
+    }
+}
+
+static void test_basic(void)
+{
+    interval_tree_init(&root);
+    g_assert_true(interval_tree_is_empty(&root));
+    g_assert_null(interval_tree_iter_first(&root, 0, UINT64_MAX));
+
+    insert(0, 10, 19);
+    insert(1, 20, 29);
+    /* same range twice */
+    insert(2, 20, 29);
+    insert(3, 0, UINT64_MAX);
+
+    check_query(0, 9);
+    check_query(19, 20);
+    check_query(25, 25);
+    check_query(30, 100);
+    check_query(0, UINT64_MAX);
+
+    remove_node(3);
+    check_query(0, 9);
+    g_assert_null(interval_tree_iter_first(&root, 30, 100));
+    remove_node(1);
+    check_query(20, 29);
+    remove_node(0);
+    remove_node(2);
+    g_assert_true(interval_tree_is_empty(&root));
+}
+
+static void test_random(void)
+{
+    GRand *rand = g_rand_new_with_seed(1);
+    int i, j;
+
+    interval_tree_init(&root);
+    for (i = 0; i < N; i++) {
+        uint64_t start = g_rand_int_range(rand, 0, SPACE);
+
+        insert(i, start, start + g_rand_int_range(rand, 0, 100));
+    }
+    for (j = 0; j < 10 * N; j++) {
+        uint64_t start = g_rand_int_range(rand, 0, SPACE);
+
+        i = g_rand_int_range(rand, 0, N);
+        if (in_tree[i]) {
+            remove_node(i);
+        } else {
+            insert(i, start, start + g_rand_int_range(rand, 0, 100));
+        }
+        if (j % 100 == 0) {
+            check_query(start, start + g_rand_int_range(rand, 0, 500));
+        }
+    }
+    g_rand_free(rand);
+}
+
+/* nodes can be removed as the iteration reaches them */
+static void test_remove_while_iterating(void)
+{
+    IntervalTreeNode *node;
+    int i;
+
+    interval_tree_init(&root);
+    for (i = 0; i < N; i++) {
+        insert(i, i * 4, i * 4 + 7);
+    }
+    for (node = interval_tree_iter_first(&root, 1000, 1999);
+         node;
+         node = interval_tree_iter_next(&root, node, 1000, 1999)) {
+        remove_node(node - nodes);
+    }
+    g_assert_null(interval_tree_iter_first(&root, 1000, 1999));
+    check_query(0, SPACE);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/interval-tree/basic", test_basic);
+    g_test_add_func("/interval-tree/random", test_random);
+    g_test_add_func("/interval-tree/remove-while-iterating",
+                    test_remove_while_iterating);
+    return g_test_run();
+}
@@ -25,6 +25,7 @@
 #include "libqos/virtio-pci.h"
 
 #include "libqos/malloc-pc.h"
+#include "hw/pci/pci_regs.h"
 #include "hw/virtio/virtio-net.h"
 
 #include <linux/vhost.h>
@@ -384,6 +385,7 @@ static void chr_read(void *opaque, const uint8_t *buf, int size)
 
         assert(msg.payload.state.index < s->queues * 2);
         s->rings &= ~(0x1ULL << msg.payload.state.index);
+        g_cond_broadcast(&s->data_cond);
         break;
 
     case VHOST_USER_SET_MEM_TABLE:
@@ -895,6 +897,55 @@ static void test_flags_mismatch(void)
 
 #endif
 
+/*
+ * A commit that changes only another device's bus master address space
+ * must not leave vhost with an empty memory table.
+ */
+static void test_bus_master_toggle(void)
+{
+    TestServer *server = test_server_new("bus-master");
+    QPCIDevice *ide;
+    uint16_t cmd;
+    char *qemu_cmd;
+
+    test_server_listen(server);
+
+    qemu_cmd = get_qemu_cmd(server, 512, TEST_MEMFD_AUTO, root, "", "");
+    qtest_start(qemu_cmd);
+    g_free(qemu_cmd);
+
+    init_virtio_dev(server, 1u << VIRTIO_NET_F_MAC);
+    wait_for_fds(server);
+    wait_for_rings_started(server, 2);
+
+    /* The PIIX IDE function of the pc machine */
+    ide = qpci_device_find(server->bus, QPCI_DEVFN(1, 1));
+    g_assert_nonnull(ide);
+    cmd = qpci_config_readw(ide, PCI_COMMAND);
+    qpci_config_writew(ide, PCI_COMMAND, cmd ^ PCI_COMMAND_MASTER);
+    qpci_config_writew(ide, PCI_COMMAND, cmd);
+    g_free(ide);
+
+    /*
+     * Stopping the rings is sent on the same socket as any memory table
+     * the toggle may have caused, so once they are stopped that table
+     * has been received too.
+     */
+    qvirtio_reset(&server->dev->vdev);
+    wait_for_rings_started(server, 0);
+
+    g_mutex_lock(&server->data_mutex);
+    g_assert_cmpint(server->memory.nregions, >, 0);
+    g_assert_cmpint(server->fds_num, ==, server->memory.nregions);
+    g_mutex_unlock(&server->data_mutex);
+
+    uninit_virtio_dev(server);
+
+    qtest_end();
+
+    test_server_free(server);
+}
+
 static void test_multiqueue(void)
 {
     TestServer *s = test_server_new("mq");
@@ -974,6 +1025,7 @@ int main(int argc, char **argv)
                         GINT_TO_POINTER(TEST_MEMFD_NO), test_read_guest_mem);
     qtest_add_func("/vhost-user/migrate", test_migrate);
     qtest_add_func("/vhost-user/multiqueue", test_multiqueue);
+    qtest_add_func("/vhost-user/bus-master-toggle", test_bus_master_toggle);
 
 #if defined(CONFIG_HAS_GLIB_SUBPROCESS_TESTS)
     /* keeps failing on build-system since Aug 15 2017 */
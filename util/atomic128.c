@@ -0,0 +1,25 @@
+/*
+ * Detection of host support for 128-bit atomic operations.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/atomic128.h"
+
+#if !defined(CONFIG_ATOMIC128) && defined(__x86_64__) && \
+    defined(CONFIG_INT128) && defined(CONFIG_CPUID_H)
+#include "qemu/cpuid.h"
+
+bool have_cmpxchg16b;
+
+static void __attribute__((constructor)) init_cmpxchg16b(void)
+{
+    int a, b, c, d;
+
+    if (__get_cpuid_max(0, NULL) >= 1) {
+        __cpuid(1, a, b, c, d);
+        have_cmpxchg16b = c & bit_CMPXCHG16B;
+    }
+}
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Intrusive interval tree.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
+
+/*
+ * Nodes are ordered by start address, and nodes with the same start by
+ * their own address, so that every node has a unique key even if several
+ * of them cover the same range.  This lets interval_tree_iter_next resume
+ * from a node without having to find it in the tree first.
+ */
+static inline bool node_before(const IntervalTreeNode *a,
+                               const IntervalTreeNode *b)
+{
+    return a->start < b->start ||
+           (a->start == b->start && (uintptr_t)a < (uintptr_t)b);
+}
+
+static uint32_t node_priority(const IntervalTreeNode *node)
+{
+    uint64_t x = (uintptr_t)node;
+
+    /* the finalizer of MurmurHash3, so that nearby nodes are spread out */
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void node_update(IntervalTreeNode *node)
+{
+    uint64_t last = node->last;
+
+    if (node->left && node->left->subtree_last > last) {
+        last = node->left->subtree_last;
+    }
+    if (node->right && node->right->subtree_last > last) {
+        last = node->right->subtree_last;
+    }
+    node->subtree_last = last;
+}
+
+static IntervalTreeNode *rotate_right(IntervalTreeNode *node)
+{
+    IntervalTreeNode *l = node->left;
+
+    node->left = l->right;
+    l->right = node;
+    node_update(node);
+    node_update(l);
+    return l;
+}
+
+static IntervalTreeNode *rotate_left(IntervalTreeNode *node)
+{
+    IntervalTreeNode *r = node->right;
+
+    node->right = r->left;
+    r->left = node;
+    node_update(node);
+    node_update(r);
+    return r;
+}
+
+static IntervalTreeNode *do_insert(IntervalTreeNode *t, IntervalTreeNode *node)
+{
+    if (t == NULL) {
+        return node;
+    }
+    if (node_before(node, t)) {
+        t->left = do_insert(t->left, node);
+        node_update(t);
+        if (t->left->priority > t->priority) {
+            t = rotate_right(t);
+        }
+    } else {
+        t->right = do_insert(t->right, node);
+        node_update(t);
+        if (t->right->priority > t->priority) {
+            t = rotate_left(t);
+        }
+    }
+    return t;
+}
+
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    g_assert(node->start <= node->last);
+
+    node->subtree_last = node->last;
+    node->priority = node_priority(node);
+    node->left = NULL;
+    node->right = NULL;
+    root->root = do_insert(root->root, node);
+}
+
+/* join two treaps, all of whose keys in @a come before those in @b */
+static IntervalTreeNode *merge(IntervalTreeNode *a, IntervalTreeNode *b)
+{
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (a->priority > b->priority) {
+        a->right = merge(a->right, b);
+        node_update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    node_update(b);
+    return b;
+}
+
+static IntervalTreeNode *do_remove(IntervalTreeNode *t, IntervalTreeNode *node)
+{
+    g_assert(t);
+    if (t == node) {
+        return merge(t->left, t->right);
+    }
+    if (node_before(node, t)) {
+        t->left = do_remove(t->left, node);
+    } else {
+        t->right = do_remove(t->right, node);
+    }
+    node_update(t);
+    return t;
+}
+
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    root->root = do_remove(root->root, node);
+    node->left = NULL;
+    node->right = NULL;
+}
+
+/*
+ * Return the first node of @t that comes after @prev (or the first node
+ * at all, if @prev is NULL) and overlaps [@start, @last].
+ */
+static IntervalTreeNode *do_iter(IntervalTreeNode *t,
+                                 const IntervalTreeNode *prev,
+                                 uint64_t start, uint64_t last)
+{
+    while (t) {
+        if (t->subtree_last < start) {
+            /* everything below @t ends before the range */
+            return NULL;
+        }
+        if (prev == NULL || node_before(prev, t)) {
+            IntervalTreeNode *found = do_iter(t->left, prev, start, last);
+
+            if (found) {
+                return found;
+            }
+            if (t->start > last) {
+                /* and so does everything to the right of @t */
+                return NULL;
+            }
+            if (t->last >= start) {
+                return t;
+            }
+        }
+        t = t->right;
+    }
+    return NULL;
+}
+
+IntervalTreeNode *interval_tree_iter_first(const IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last)
+{
+    return do_iter(root->root, NULL, start, last);
+}
+
+IntervalTreeNode *interval_tree_iter_next(const IntervalTreeRoot *root,
+                                          const IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last)
+{
+    return do_iter(root->root, node, start, last);
+}
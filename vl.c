@@ -130,6 +130,7 @@ int main(int argc, char **argv)
 #include "qapi/qapi-commands-run-state.h"
 #include "qapi/qmp/qerror.h"
 #include "sysemu/iothread.h"
+#include "perf.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -304,6 +305,16 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "superblock-threshold",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Executions after which a TCG superblock is formed",
+        },
+        {
+            .name = "quantum",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Instructions per quantum of multi-threaded icount",
+        },
         { /* end of list */ }
     },
 };
@@ -408,6 +419,24 @@ static QemuOptsList qemu_overcommit_opts = {
     },
 };
 
+static QemuOptsList qemu_tb_cache_opts = {
+    .name = "tb-cache",
+    .implied_opt_name = "file",
+    .merge_lists = true,
+    .head = QTAILQ_HEAD_INITIALIZER(qemu_tb_cache_opts.head),
+    .desc = {
+        {
+            .name = "file",
+            .type = QEMU_OPT_STRING,
+        },
+        {
+            .name = "size",
+            .type = QEMU_OPT_SIZE,
+        },
+        { /* end of list */ }
+    },
+};
+
 static QemuOptsList qemu_msg_opts = {
     .name = "msg",
     .head = QTAILQ_HEAD_INITIALIZER(qemu_msg_opts.head),
@@ -2987,6 +3016,7 @@ int main(int argc, char **argv, char **envp)
     qemu_add_opts(&qemu_object_opts);
     qemu_add_opts(&qemu_tpmdev_opts);
     qemu_add_opts(&qemu_realtime_opts);
+    qemu_add_opts(&qemu_tb_cache_opts);
     qemu_add_opts(&qemu_msg_opts);
     qemu_add_opts(&qemu_name_opts);
     qemu_add_opts(&qemu_numa_opts);
@@ -3293,6 +3323,12 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_singlestep:
                 singlestep = 1;
                 break;
+            case QEMU_OPTION_perfmap:
+                perf_enable_perfmap();
+                break;
+            case QEMU_OPTION_jitdump:
+                perf_enable_jitdump();
+                break;
             case QEMU_OPTION_S:
                 autostart = 0;
                 break;
@@ -3771,6 +3807,17 @@ int main(int argc, char **argv, char **envp)
                 }
                 configure_rtc(opts);
                 break;
+            case QEMU_OPTION_tb_cache:
+#ifndef CONFIG_TCG
+                error_report("TCG is disabled");
+                exit(1);
+#endif
+                opts = qemu_opts_parse_noisily(qemu_find_opts("tb-cache"),
+                                               optarg, true);
+                if (!opts) {
+                    exit(1);
+                }
+                break;
             case QEMU_OPTION_tb_size:
 #ifndef CONFIG_TCG
                 error_report("TCG is disabled");
@@ -4294,6 +4341,21 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
 
+    opts = qemu_opts_find(qemu_find_opts("tb-cache"), NULL);
+    if (opts) {
+        const char *path = qemu_opt_get(opts, "file");
+        char *config;
+
+        if (!path) {
+            error_report("-tb-cache: a file name is required");
+            exit(1);
+        }
+        config = g_strdup_printf("%s %s", machine_class->name,
+                                 cpu_model ? cpu_model : "");
+        tb_cache_enable(path, qemu_opt_get_size(opts, "size", 0), config);
+        g_free(config);
+    }
+
     configure_accelerator(current_machine);
 
     if (!qtest_enabled() && machine_class->deprecation_reason) {
@@ -4648,6 +4710,10 @@ int main(int argc, char **argv, char **envp)
     /* No more vcpu or device emulation activity beyond this point */
     vm_shutdown();
 
+    if (tcg_enabled()) {
+        tb_cache_save();
+    }
+
     job_cancel_sync_all();
     bdrv_close_all();
 